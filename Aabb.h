@@ -0,0 +1,81 @@
+#pragma once
+#include "Globals.h"
+#include <algorithm>
+
+//Axis-aligned bounding box
+struct Aabb {
+	glm::vec3 lo;
+	glm::vec3 hi;
+};
+
+inline Aabb Union(const Aabb& a, const Aabb& b) {
+	Aabb u;
+	u.lo = glm::vec3(glm::min(a.lo.x, b.lo.x), glm::min(a.lo.y, b.lo.y), glm::min(a.lo.z, b.lo.z));
+	u.hi = glm::vec3(glm::max(a.hi.x, b.hi.x), glm::max(a.hi.y, b.hi.y), glm::max(a.hi.z, b.hi.z));
+	return u;
+}
+
+inline float SurfaceArea(const Aabb& a) {
+	glm::vec3 d = a.hi - a.lo;
+	return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+
+inline bool Contains(const Aabb& outer, const Aabb& inner) {
+	return outer.lo.x <= inner.lo.x && outer.lo.y <= inner.lo.y && outer.lo.z <= inner.lo.z &&
+		inner.hi.x <= outer.hi.x && inner.hi.y <= outer.hi.y && inner.hi.z <= outer.hi.z;
+}
+
+inline bool Overlaps(const Aabb& a, const Aabb& b) {
+	return a.lo.x <= b.hi.x && b.lo.x <= a.hi.x &&
+		a.lo.y <= b.hi.y && b.lo.y <= a.hi.y &&
+		a.lo.z <= b.hi.z && b.lo.z <= a.hi.z;
+}
+
+//Slab test. inverseDirection is 1 / direction per axis. On a hit, t is the entry distance
+//along the ray, clamped to 0 for rays starting inside.
+inline bool RayHits(const Aabb& a, glm::vec3 origin, glm::vec3 inverseDirection, float maxT, float& t) {
+	float t0 = 0.0f;
+	float t1 = maxT;
+	for (int axis = 0; axis < 3; axis++) {
+		float enter = (a.lo[axis] - origin[axis]) * inverseDirection[axis];
+		float leave = (a.hi[axis] - origin[axis]) * inverseDirection[axis];
+		if (enter > leave) std::swap(enter, leave);
+		t0 = enter > t0 ? enter : t0;
+		t1 = leave < t1 ? leave : t1;
+		if (t0 > t1) return false;
+	}
+	t = t0;
+	return true;
+}
+
+//Plane (n, d) keeps points with dot(n, p) + d >= 0
+enum FrustumResult {
+	FrustumOutside,
+	FrustumIntersecting,
+	FrustumInside
+};
+
+//Gribb-Hartmann extraction of the six clip planes (left, right, bottom, top, near, far)
+//from a projection * view matrix, in world space
+inline void FrustumPlanes(const glm::mat4& viewProjection, glm::vec4 planes[6]) {
+	for (int axis = 0; axis < 3; axis++) {
+		for (int side = 0; side < 2; side++) {
+			const float sign = side == 0 ? 1.0f : -1.0f;
+			glm::vec4& plane = planes[axis * 2 + side];
+			for (int k = 0; k < 4; k++) plane[k] = viewProjection[k][3] + sign * viewProjection[k][axis];
+		}
+	}
+}
+
+inline FrustumResult TestFrustum(const Aabb& a, const glm::vec4* planes, int planeCount) {
+	FrustumResult result = FrustumInside;
+	for (int i = 0; i < planeCount; i++) {
+		const glm::vec4& p = planes[i];
+		//Corners furthest along and against the plane normal
+		glm::vec3 front(p.x >= 0.0f ? a.hi.x : a.lo.x, p.y >= 0.0f ? a.hi.y : a.lo.y, p.z >= 0.0f ? a.hi.z : a.lo.z);
+		glm::vec3 back(p.x >= 0.0f ? a.lo.x : a.hi.x, p.y >= 0.0f ? a.lo.y : a.hi.y, p.z >= 0.0f ? a.lo.z : a.hi.z);
+		if (p.x * front.x + p.y * front.y + p.z * front.z + p.w < 0.0f) return FrustumOutside;
+		if (p.x * back.x + p.y * back.y + p.z * back.z + p.w < 0.0f) result = FrustumIntersecting;
+	}
+	return result;
+}
@@ -0,0 +1,479 @@
+#include "Articulation.h"
+#include "ThreadPool.h"
+#include <cassert>
+#include <cmath>
+
+//Trees per task; most scenes have a few large trees or many small ones
+static const int TreeGrain = 4;
+
+static int DofCount(Articulation::JointType type) {
+	return type == Articulation::Free ? 6 : (type == Articulation::Ball ? 3 : 1);
+}
+
+//Matrix with m * v = r x v
+static glm::dmat3 Skew(glm::dvec3 r) {
+	return glm::dmat3(glm::dvec3(0, r.z, -r.y), glm::dvec3(-r.z, 0, r.x), glm::dvec3(r.y, -r.x, 0));
+}
+
+//Gauss-Jordan inverse of the n x n row-major matrix m, n <= 6. D is symmetric positive
+//definite for a link with mass and a box shape; a degenerate direction gets no acceleration.
+static void InvertSmall(double* m, double* out, int n) {
+	for (int i = 0; i < n * n; i++) out[i] = 0.0;
+	for (int i = 0; i < n; i++) out[i * n + i] = 1.0;
+	for (int col = 0; col < n; col++) {
+		int pivot = col;
+		for (int row = col + 1; row < n; row++) {
+			if (std::fabs(m[row * n + col]) > std::fabs(m[pivot * n + col])) pivot = row;
+		}
+		if (std::fabs(m[pivot * n + col]) < 1e-12) {
+			for (int i = 0; i < n; i++) out[col * n + i] = out[i * n + col] = 0.0;
+			continue;
+		}
+		for (int i = 0; i < n; i++) {
+			std::swap(m[col * n + i], m[pivot * n + i]);
+			std::swap(out[col * n + i], out[pivot * n + i]);
+		}
+		const double scale = 1.0 / m[col * n + col];
+		for (int i = 0; i < n; i++) {
+			m[col * n + i] *= scale;
+			out[col * n + i] *= scale;
+		}
+		for (int row = 0; row < n; row++) {
+			const double f = m[row * n + col];
+			if (row == col || f == 0.0) continue;
+			for (int i = 0; i < n; i++) {
+				m[row * n + i] -= f * m[col * n + i];
+				out[row * n + i] -= f * out[col * n + i];
+			}
+		}
+	}
+}
+
+int Articulation::addLink(const BodyStore& bodies, int body, int parent, JointType type, glm::vec3 anchor, glm::vec3 axis) {
+	assert(parent < (int)m_links.size());
+	assert(type != Free || parent == -1);
+	const glm::quat childRotation = bodies.orientation.get(body);
+	const glm::vec3 childCenter = bodies.currPos.get(body);
+	glm::quat parentRotation(1, 0, 0, 0);
+	glm::vec3 parentCenter(0, 0, 0);
+	if (parent >= 0) {
+		parentRotation = bodies.orientation.get(m_links[parent].body);
+		parentCenter = bodies.currPos.get(m_links[parent].body);
+	}
+
+	Link link;
+	link.body = body;
+	link.parent = parent;
+	link.type = type;
+	link.torque = glm::vec3(0, 0, 0);
+	if (type == Free) {
+		//A free root's pose is its own: the anchor is the centre of mass in the world
+		link.parentAnchor = childCenter;
+		link.childAnchor = glm::vec3(0, 0, 0);
+		link.rest = childRotation;
+	}
+	else {
+		link.parentAnchor = glm::inverse(parentRotation) * (anchor - parentCenter);
+		link.childAnchor = glm::inverse(childRotation) * (anchor - childCenter);
+		link.rest = glm::inverse(parentRotation) * childRotation;
+	}
+	link.axis = glm::normalize(glm::inverse(childRotation) * axis);
+
+	if ((int)m_linkOfBody.size() <= body) m_linkOfBody.resize(body + 1, -1);
+	assert(m_linkOfBody[body] == -1);
+	m_linkOfBody[body] = (int)m_links.size();
+	m_links.push_back(link);
+	m_dofCount += DofCount(type);
+	m_dirty = true;
+	return (int)m_links.size() - 1;
+}
+
+void Articulation::clear() {
+	m_links.clear();
+	m_linkOfBody.clear();
+	m_treeStart.assign(1, 0);
+	m_link.clear();
+	m_slotOfLink.clear();
+	m_dofCount = 0;
+	m_dirty = false;
+}
+
+float Articulation::hingeAngle(int link) const {
+	return link < (int)m_slotOfLink.size() ? m_angle[m_slotOfLink[link]] : 0.0f;
+}
+
+bool Articulation::jointed(int a, int b) const {
+	const int count = (int)m_linkOfBody.size();
+	const int la = a < count ? m_linkOfBody[a] : -1;
+	const int lb = b < count ? m_linkOfBody[b] : -1;
+	if (la < 0 || lb < 0) return false;
+	return m_links[la].parent == lb || m_links[lb].parent == la;
+}
+
+//Links added since the last build start at their joint's zero; the others keep their state
+void Articulation::build() {
+	const int count = (int)m_links.size();
+	std::vector<int> slotOfLink(count, -1);
+	for (int k = 0; k < (int)m_link.size(); k++) slotOfLink[m_link[k]] = k;
+	std::vector<float> angle(count, 0.0f);
+	std::vector<glm::quat> rotation(count);
+	std::vector<glm::vec3> position(count);
+	for (int l = 0; l < count; l++) {
+		const int k = slotOfLink[l];
+		angle[l] = k >= 0 ? m_angle[k] : 0.0f;
+		rotation[l] = k >= 0 ? m_rotation[k] : m_links[l].rest;
+		position[l] = k >= 0 ? m_position[k] : m_links[l].parentAnchor;
+	}
+
+	//Children of each link in insertion order, then an explicit-stack depth-first walk
+	std::vector<int> childStart(count + 1, 0);
+	for (int l = 0; l < count; l++) {
+		if (m_links[l].parent >= 0) childStart[m_links[l].parent + 1]++;
+	}
+	for (int l = 0; l < count; l++) childStart[l + 1] += childStart[l];
+	std::vector<int> children(childStart[count]);
+	std::vector<int> fill(childStart.begin(), childStart.end() - 1);
+	for (int l = 0; l < count; l++) {
+		if (m_links[l].parent >= 0) children[fill[m_links[l].parent]++] = l;
+	}
+
+	m_link.clear();
+	m_treeStart.assign(1, 0);
+	std::vector<int> stack;
+	for (int root = 0; root < count; root++) {
+		if (m_links[root].parent >= 0) continue;
+		stack.push_back(root);
+		while (!stack.empty()) {
+			const int l = stack.back();
+			stack.pop_back();
+			slotOfLink[l] = (int)m_link.size();
+			m_link.push_back(l);
+			for (int c = childStart[l + 1] - 1; c >= childStart[l]; c--) stack.push_back(children[c]);
+		}
+		m_treeStart.push_back((int)m_link.size());
+	}
+
+	m_parent.resize(count);
+	m_dofStart.resize(count + 1);
+	m_inverseStart.resize(count + 1);
+	m_angle.resize(count);
+	m_rotation.resize(count);
+	m_position.resize(count);
+	m_dofStart[0] = 0;
+	m_inverseStart[0] = 0;
+	for (int k = 0; k < count; k++) {
+		const Link& link = m_links[m_link[k]];
+		const int dofs = DofCount(link.type);
+		m_parent[k] = link.parent >= 0 ? slotOfLink[link.parent] : -1;
+		m_dofStart[k + 1] = m_dofStart[k] + dofs;
+		m_inverseStart[k + 1] = m_inverseStart[k] + dofs * dofs;
+		m_angle[k] = angle[m_link[k]];
+		m_rotation[k] = rotation[m_link[k]];
+		m_position[k] = position[m_link[k]];
+	}
+
+	m_frame.resize(count);
+	m_orientation.resize(count);
+	m_center.resize(count);
+	m_angular.resize(count);
+	m_linear.resize(count);
+	m_biasAngular.resize(count);
+	m_biasLinear.resize(count);
+	m_inertia.resize(count);
+	m_biasMoment.resize(count);
+	m_biasForce.resize(count);
+	m_accelAngular.resize(count);
+	m_accelLinear.resize(count);
+	m_inverse.resize(m_inverseStart[count]);
+	const int dofs = m_dofStart[count];
+	m_rate.assign(dofs, 0.0f);
+	m_force.resize(dofs);
+	m_motionAngular.resize(dofs);
+	m_motionLinear.resize(dofs);
+	m_uMoment.resize(dofs);
+	m_uForce.resize(dofs);
+	m_u.resize(dofs);
+
+	m_slotOfLink.swap(slotOfLink);
+	for (int k = 0; k < count; k++) pose(k);
+	m_dirty = false;
+}
+
+void Articulation::pose(int k) {
+	const Link& link = m_links[m_link[k]];
+	glm::quat rotation;
+	glm::vec3 center;
+	if (link.type == Free) {
+		rotation = m_rotation[k];
+		center = m_position[k];
+	}
+	else {
+		const int p = m_parent[k];
+		const glm::quat parentRotation = p >= 0 ? m_orientation[p] : glm::quat(1, 0, 0, 0);
+		const glm::vec3 parentCenter = p >= 0 ? m_center[p] : glm::vec3(0, 0, 0);
+		rotation = link.type == Ball ? parentRotation * m_rotation[k] : parentRotation * link.rest * glm::angleAxis(m_angle[k], link.axis);
+		rotation = glm::normalize(rotation);
+		center = parentCenter + parentRotation * link.parentAnchor - rotation * link.childAnchor;
+	}
+	m_orientation[k] = rotation;
+	m_frame[k] = glm::mat3_cast(rotation);
+	m_center[k] = center;
+}
+
+//Joint rotation rates are in the child's body axes, where their motion subspace is constant,
+//so the velocity-product acceleration is v x (S qd) over those columns. A free root's linear
+//rates are its world velocity; a pure translation is constant in the world and adds nothing.
+void Articulation::motion(int k) {
+	const Link& link = m_links[m_link[k]];
+	const glm::mat3& frame = m_frame[k];
+	const int first = m_dofStart[k];
+	//From the joint to the centre of mass
+	const glm::vec3 arm = -(frame * link.childAnchor);
+	if (link.type == Free) {
+		for (int j = 0; j < 3; j++) {
+			m_motionAngular[first + j] = frame[j];
+			m_motionLinear[first + j] = glm::vec3(0, 0, 0);
+			m_motionAngular[first + 3 + j] = glm::vec3(0, 0, 0);
+			m_motionLinear[first + 3 + j] = glm::vec3(j == 0, j == 1, j == 2);
+		}
+	}
+	else if (link.type == Ball) {
+		for (int j = 0; j < 3; j++) {
+			m_motionAngular[first + j] = frame[j];
+			m_motionLinear[first + j] = glm::cross(frame[j], arm);
+		}
+	}
+	else {
+		const glm::vec3 axis = frame * link.axis;
+		m_motionAngular[first] = axis;
+		m_motionLinear[first] = glm::cross(axis, arm);
+	}
+
+	glm::vec3 jointAngular(0, 0, 0);
+	glm::vec3 jointLinear(0, 0, 0);
+	for (int d = first; d < m_dofStart[k + 1]; d++) {
+		jointAngular += m_motionAngular[d] * m_rate[d];
+		jointLinear += m_motionLinear[d] * m_rate[d];
+	}
+	const glm::vec3 fixedLinear = link.type == Free ? glm::vec3(0, 0, 0) : jointLinear;
+	const int p = m_parent[k];
+	glm::vec3 angular = jointAngular;
+	glm::vec3 linear = jointLinear;
+	if (p >= 0) {
+		angular += m_angular[p];
+		linear += m_linear[p] + glm::cross(m_angular[p], m_center[k] - m_center[p]);
+	}
+	m_angular[k] = angular;
+	m_linear[k] = linear;
+	m_biasAngular[k] = glm::cross(angular, jointAngular);
+	m_biasLinear[k] = glm::cross(angular, fixedLinear) + glm::cross(linear, jointAngular);
+}
+
+//The joint state is the projection of the bodies' poses and velocities onto what the joints
+//allow: a ball takes the child's rotation relative to its parent, a hinge the twist of that
+//rotation about its axis, and only the angular velocities decide the joint rates. A free
+//root also takes its position and linear velocity.
+void Articulation::gather(const BodyStore& bodies) {
+	if (m_dirty) build();
+	ThreadPool::Global().parallelFor((int)m_treeStart.size() - 1, TreeGrain, [&](int begin, int end) {
+		for (int t = begin; t < end; t++) {
+			if (!bodies.isActive(m_links[m_link[m_treeStart[t]]].body)) continue;
+			for (int k = m_treeStart[t]; k < m_treeStart[t + 1]; k++) {
+				const Link& link = m_links[m_link[k]];
+				const int p = m_parent[k];
+				const glm::quat parentRotation = p >= 0 ? m_orientation[p] : glm::quat(1, 0, 0, 0);
+				const glm::quat rotation = bodies.orientation.get(link.body);
+				if (link.type == Free) {
+					m_rotation[k] = rotation;
+					m_position[k] = bodies.currPos.get(link.body);
+				}
+				else if (link.type == Ball) {
+					m_rotation[k] = glm::normalize(glm::conjugate(parentRotation) * rotation);
+				}
+				else {
+					//Twist about the axis, kept within half a turn of the last angle
+					const glm::quat turn = glm::conjugate(link.rest) * glm::conjugate(parentRotation) * rotation;
+					const float twist = 2.0f * std::atan2(glm::dot(glm::vec3(turn.x, turn.y, turn.z), link.axis), turn.w);
+					m_angle[k] += std::remainder(twist - m_angle[k], 2.0f * 3.14159265f);
+				}
+				pose(k);
+
+				const glm::mat3& frame = m_frame[k];
+				const int first = m_dofStart[k];
+				glm::vec3 angular = bodies.angularVelocity.get(link.body);
+				if (link.parent >= 0) angular -= bodies.angularVelocity.get(m_links[link.parent].body);
+				if (link.type == Hinge) {
+					m_rate[first] = glm::dot(frame * link.axis, angular);
+					continue;
+				}
+				for (int j = 0; j < 3; j++) m_rate[first + j] = glm::dot(frame[j], angular);
+				if (link.type == Free) {
+					const glm::vec3 linear = bodies.velocity.get(link.body);
+					for (int j = 0; j < 3; j++) m_rate[first + 3 + j] = linear[j];
+				}
+			}
+		}
+	});
+}
+
+void Articulation::step(BodyStore& bodies, float dt) {
+	if (m_dirty) build();
+	ThreadPool::Global().parallelFor((int)m_treeStart.size() - 1, TreeGrain, [&](int begin, int end) {
+		for (int t = begin; t < end; t++) solveTree(bodies, t, dt);
+	});
+}
+
+void Articulation::solveTree(BodyStore& bodies, int tree, float dt) {
+	const int begin = m_treeStart[tree];
+	const int end = m_treeStart[tree + 1];
+	if (!bodies.isActive(m_links[m_link[begin]].body)) return;
+
+	//Outward: velocities, rigid-body inertias and bias forces
+	for (int k = begin; k < end; k++) {
+		const Link& link = m_links[m_link[k]];
+		const int body = link.body;
+		pose(k);
+		motion(k);
+
+		const glm::vec3 inverse = bodies.inverseInertia.get(body);
+		const glm::vec3 moments(inverse.x > 0.0f ? 1.0f / inverse.x : 0.0f, inverse.y > 0.0f ? 1.0f / inverse.y : 0.0f, inverse.z > 0.0f ? 1.0f / inverse.z : 0.0f);
+		const glm::mat3& frame = m_frame[k];
+		const glm::mat3 rotational = frame * glm::mat3(glm::vec3(moments.x, 0, 0), glm::vec3(0, moments.y, 0), glm::vec3(0, 0, moments.z)) * glm::transpose(frame);
+		const float mass = bodies.mass[body];
+		m_inertia[k].a = glm::dmat3(rotational);
+		m_inertia[k].b = glm::dmat3(0.0);
+		m_inertia[k].c = glm::dmat3((double)mass);
+		m_biasMoment[k] = glm::dvec3(glm::cross(m_angular[k], rotational * m_angular[k]) - bodies.torque.get(body));
+		m_biasForce[k] = glm::dvec3(mass * glm::cross(m_angular[k], m_linear[k]) - bodies.force.get(body));
+
+		const int first = m_dofStart[k];
+		if (link.type == Hinge) {
+			m_force[first] = link.torque.x;
+		}
+		else if (link.type == Ball) {
+			for (int j = 0; j < 3; j++) m_force[first + j] = link.torque[j];
+		}
+		else {
+			for (int j = 0; j < 6; j++) m_force[first + j] = 0.0f;
+		}
+	}
+
+	//Inward: articulated inertias and bias forces, each folded into its parent
+	double scratch[36];
+	for (int k = end - 1; k >= begin; k--) {
+		const int first = m_dofStart[k];
+		const int dofs = m_dofStart[k + 1] - first;
+		SpatialInertia& inertia = m_inertia[k];
+		for (int j = first; j < first + dofs; j++) {
+			const glm::dvec3 angular(m_motionAngular[j]);
+			const glm::dvec3 linear(m_motionLinear[j]);
+			m_uMoment[j] = inertia.a * angular + inertia.b * linear;
+			m_uForce[j] = glm::transpose(inertia.b) * angular + inertia.c * linear;
+			m_u[j] = m_force[j] - glm::dot(angular, m_biasMoment[k]) - glm::dot(linear, m_biasForce[k]);
+		}
+		for (int i = 0; i < dofs; i++) {
+			const glm::dvec3 angular(m_motionAngular[first + i]);
+			const glm::dvec3 linear(m_motionLinear[first + i]);
+			for (int j = 0; j < dofs; j++) {
+				scratch[i * dofs + j] = glm::dot(angular, m_uMoment[first + j]) + glm::dot(linear, m_uForce[first + j]);
+			}
+		}
+		//D is symmetric, but rounding leaves it slightly lopsided, and along a long chain of
+		//ball joints that error doubles from link to link until the inverse overflows
+		for (int i = 0; i < dofs; i++) {
+			for (int j = 0; j < i; j++) {
+				const double mean = 0.5 * (scratch[i * dofs + j] + scratch[j * dofs + i]);
+				scratch[i * dofs + j] = mean;
+				scratch[j * dofs + i] = mean;
+			}
+		}
+		double* inverse = &m_inverse[m_inverseStart[k]];
+		InvertSmall(scratch, inverse, dofs);
+
+		const int p = m_parent[k];
+		if (p < 0) continue;
+		//Ia = I - U D^-1 U^T, pa = p + Ia c + U D^-1 u
+		SpatialInertia articulated = inertia;
+		glm::dvec3 moment = m_biasMoment[k];
+		glm::dvec3 force = m_biasForce[k];
+		for (int i = 0; i < dofs; i++) {
+			double weighted = 0.0;
+			for (int j = 0; j < dofs; j++) {
+				const double d = inverse[i * dofs + j];
+				weighted += d * m_u[first + j];
+				articulated.a -= d * glm::outerProduct(m_uMoment[first + i], m_uMoment[first + j]);
+				articulated.b -= d * glm::outerProduct(m_uMoment[first + i], m_uForce[first + j]);
+				articulated.c -= d * glm::outerProduct(m_uForce[first + i], m_uForce[first + j]);
+			}
+			moment += m_uMoment[first + i] * weighted;
+			force += m_uForce[first + i] * weighted;
+		}
+		const glm::dvec3 biasAngular(m_biasAngular[k]);
+		const glm::dvec3 biasLinear(m_biasLinear[k]);
+		moment += articulated.a * biasAngular + articulated.b * biasLinear;
+		force += glm::transpose(articulated.b) * biasAngular + articulated.c * biasLinear;
+
+		//Moved to the parent's centre: X^T Ia X with X the shift by r = c - c_parent
+		const glm::dvec3 offset(m_center[k] - m_center[p]);
+		const glm::dmat3 r = Skew(offset);
+		SpatialInertia& parent = m_inertia[p];
+		parent.a += articulated.a - articulated.b * r + r * glm::transpose(articulated.b) - r * articulated.c * r;
+		parent.b += articulated.b + r * articulated.c;
+		parent.c += articulated.c;
+		m_biasMoment[p] += moment + glm::cross(offset, force);
+		m_biasForce[p] += force;
+	}
+
+	//Outward: accelerations, then semi-implicit Euler on the joint rates and positions
+	for (int k = begin; k < end; k++) {
+		const int first = m_dofStart[k];
+		const int dofs = m_dofStart[k + 1] - first;
+		const int p = m_parent[k];
+		glm::dvec3 angular(m_biasAngular[k]);
+		glm::dvec3 linear(m_biasLinear[k]);
+		if (p >= 0) {
+			angular += m_accelAngular[p];
+			linear += m_accelLinear[p] + glm::cross(m_accelAngular[p], glm::dvec3(m_center[k] - m_center[p]));
+		}
+		double reduced[6];
+		for (int j = 0; j < dofs; j++) {
+			reduced[j] = m_u[first + j] - glm::dot(m_uMoment[first + j], angular) - glm::dot(m_uForce[first + j], linear);
+		}
+		const double* inverse = &m_inverse[m_inverseStart[k]];
+		for (int i = 0; i < dofs; i++) {
+			double acceleration = 0.0;
+			for (int j = 0; j < dofs; j++) acceleration += inverse[i * dofs + j] * reduced[j];
+			angular += glm::dvec3(m_motionAngular[first + i]) * acceleration;
+			linear += glm::dvec3(m_motionLinear[first + i]) * acceleration;
+			m_rate[first + i] += (float)acceleration * dt;
+		}
+		m_accelAngular[k] = angular;
+		m_accelLinear[k] = linear;
+	}
+
+	for (int k = begin; k < end; k++) {
+		const Link& link = m_links[m_link[k]];
+		const int first = m_dofStart[k];
+		if (link.type == Hinge) {
+			m_angle[k] += m_rate[first] * dt;
+			continue;
+		}
+		//Body-axis angular velocity: q' = q + dt / 2 q (0, w)
+		const glm::quat spin(0.0f, m_rate[first], m_rate[first + 1], m_rate[first + 2]);
+		m_rotation[k] = glm::normalize(m_rotation[k] + (m_rotation[k] * spin) * (0.5f * dt));
+		if (link.type == Free) {
+			m_position[k] += glm::vec3(m_rate[first + 3], m_rate[first + 4], m_rate[first + 5]) * dt;
+		}
+	}
+
+	for (int k = begin; k < end; k++) {
+		const int body = m_links[m_link[k]].body;
+		pose(k);
+		motion(k);
+		bodies.currPos.set(body, m_center[k]);
+		bodies.orientation.set(body, m_orientation[k]);
+		bodies.velocity.set(body, m_linear[k]);
+		bodies.angularVelocity.set(body, m_angular[k]);
+		bodies.updateInertia(body);
+	}
+}
@@ -0,0 +1,133 @@
+#pragma once
+#include "Globals.h"
+#include "BodyStore.h"
+#include <vector>
+
+//Trees of box bodies joined by ball and hinge joints, simulated in reduced coordinates with
+//Featherstone's articulated-body algorithm, so joints never drift apart and a step costs one
+//linear-time pass per tree however long the chain.
+//
+//Each link moves a body of the BodyStore on a joint to its parent link, or to the world for
+//a root. A root may also be free, which gives a floating base such as a ragdoll's pelvis.
+//The joint state (angles, relative rotations and the packed joint rates) lives here in
+//contiguous arrays in depth-first order, so each tree is one range, every parent comes
+//before its children, and the three passes of the algorithm stream through memory. Trees
+//are independent and run in parallel on the thread pool.
+//
+//Spatial quantities are taken at each link's centre of mass with world-aligned axes, so the
+//transform between a link and its parent is a pure translation. Per step:
+//	- gather() reads the joint state back from the body poses and velocities before the
+//	  integrator, so contact impulses and position corrections of the last step carry into
+//	  the tree. The part of a body's motion the joints cannot produce is dropped.
+//	- step() takes the external forces the integrator accumulated in bodies.force and
+//	  bodies.torque, computes the joint accelerations, integrates the rates and the joint
+//	  positions with semi-implicit Euler and writes every link's pose and velocity back to
+//	  the body store, leaving oldPos and oldOrientation alone.
+//The contact solver still treats links as single bodies, so contacts with an articulation are
+//softer than with an equally heavy free body. Contacts between a link and its parent are
+//dropped by PhysicsSystem, since jointed boxes usually overlap at the joint.
+class Articulation {
+public:
+	enum JointType {
+		//Six degrees of freedom; roots only
+		Free,
+		//Three rotational degrees of freedom about the anchor
+		Ball,
+		//One rotational degree of freedom about the axis through the anchor
+		Hinge
+	};
+
+	//Adds a link moving body on a joint to link parent, or to the world if parent is -1.
+	//anchor and axis are in world space at the bodies' current poses, which become the
+	//joint's zero. Parents must be added before their children. Returns the link index.
+	int addLink(const BodyStore& bodies, int body, int parent, JointType type, glm::vec3 anchor = glm::vec3(0, 0, 0), glm::vec3 axis = glm::vec3(0, 0, 1));
+	void clear();
+	int size() const { return (int)m_links.size(); }
+	int dofCount() const { return m_dofCount; }
+	int body(int link) const { return m_links[link].body; }
+	//Parent link, -1 for a root
+	int parent(int link) const { return m_links[link].parent; }
+
+	//Motor torque held on a joint: x about a hinge's axis, or a ball's torque in the link's
+	//body axes. Ignored for free roots.
+	void setJointTorque(int link, glm::vec3 torque) { m_links[link].torque = torque; }
+	//Current angle of a hinge, radians from where it was added
+	float hingeAngle(int link) const;
+
+	void gather(const BodyStore& bodies);
+	void step(BodyStore& bodies, float dt);
+
+	//True if a and b are the bodies of a link and its parent
+	bool jointed(int a, int b) const;
+private:
+	struct Link {
+		int body;
+		int parent;
+		JointType type;
+		//Joint anchor in the parent's body space (world space for the world) and the child's
+		glm::vec3 parentAnchor;
+		glm::vec3 childAnchor;
+		//Hinge axis in the child's body space
+		glm::vec3 axis;
+		//Child orientation relative to the parent at the joint's zero
+		glm::quat rest;
+		glm::vec3 torque;
+	};
+
+	//Spatial inertia at the centre of mass: maps (angular, linear) velocity to
+	//(moment, force) as (a w + b v, b^T w + c v). Doubles, since a thin link's inertia about
+	//its own axis is tiny beside the mass of a long chain hanging from it, and the shift to
+	//the parent's centre would round it away in floats.
+	struct SpatialInertia {
+		glm::dmat3 a;
+		glm::dmat3 b;
+		glm::dmat3 c;
+	};
+
+	//Puts the joint state into depth-first order; needed after addLink()
+	void build();
+	//Pose of slot k's link from its joint state and its parent's pose
+	void pose(int k);
+	//Velocity of slot k's link and the joint's motion subspace, from its parent's
+	void motion(int k);
+	void solveTree(BodyStore& bodies, int tree, float dt);
+
+	std::vector<Link> m_links;
+	std::vector<int> m_linkOfBody;
+	int m_dofCount = 0;
+	bool m_dirty = false;
+
+	//Depth-first state: tree t is slots [m_treeStart[t], m_treeStart[t + 1])
+	std::vector<int> m_treeStart;
+	std::vector<int> m_link;
+	std::vector<int> m_slotOfLink;
+	std::vector<int> m_parent;
+	std::vector<int> m_dofStart;
+	//Hinge angle, or ball rotation relative to the parent, or a free root's world pose
+	std::vector<float> m_angle;
+	std::vector<glm::quat> m_rotation;
+	std::vector<glm::vec3> m_position;
+
+	//Per slot, recomputed every step
+	std::vector<glm::quat> m_orientation;
+	std::vector<glm::mat3> m_frame;
+	std::vector<glm::vec3> m_center;
+	std::vector<glm::vec3> m_angular;
+	std::vector<glm::vec3> m_linear;
+	//Velocity-product acceleration, articulated inertia and bias force, acceleration
+	std::vector<glm::vec3> m_biasAngular, m_biasLinear;
+	std::vector<SpatialInertia> m_inertia;
+	std::vector<glm::dvec3> m_biasMoment, m_biasForce;
+	std::vector<glm::dvec3> m_accelAngular, m_accelLinear;
+	//Inverse of each joint's D = S^T I S, dofs^2 entries from m_inverseStart
+	std::vector<int> m_inverseStart;
+	std::vector<double> m_inverse;
+
+	//Per degree of freedom, packed in slot order: rate, applied force, motion subspace column
+	//in world space, U = I S, and u = force - S^T bias
+	std::vector<float> m_rate;
+	std::vector<float> m_force;
+	std::vector<glm::vec3> m_motionAngular, m_motionLinear;
+	std::vector<glm::dvec3> m_uMoment, m_uForce;
+	std::vector<double> m_u;
+};
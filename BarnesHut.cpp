@@ -0,0 +1,343 @@
+#include "BarnesHut.h"
+#include "ThreadPool.h"
+#include "Simd.h"
+#include <algorithm>
+#include <cmath>
+
+static const int GatherChunk = 4096;
+static const int ChunkSize = 256;
+static const int GroupChunk = 4;
+//21 bits per axis; a cell at this level is a single Morton code and is never split
+static const int MaxLevel = 21;
+//Each opened cell replaces itself with at most 8 children, once per level
+static const int StackSize = MaxLevel * 7 + 8;
+
+//Spreads the low 21 bits of v so there are two zero bits between each
+static inline uint64_t SpreadBits(uint64_t v) {
+	v &= 0x1FFFFF;
+	v = (v | v << 32) & 0x001F00000000FFFFull;
+	v = (v | v << 16) & 0x001F0000FF0000FFull;
+	v = (v | v << 8) & 0x100F00F00F00F00Full;
+	v = (v | v << 4) & 0x10C30C30C30C30C3ull;
+	v = (v | v << 2) & 0x1249249249249249ull;
+	return v;
+}
+
+//Child octant of a key at a level; level 0 is the root's split on the top bit of each axis
+static inline int Octant(uint64_t key, int level) {
+	return (int)(key >> (3 * (MaxLevel - 1 - level))) & 7;
+}
+
+static inline bool IsSource(const BodyStore& bodies, int i) {
+	return bodies.mass[i] > 0.0f && (bodies.isActive(i) || bodies.isSleeping(i));
+}
+
+void BarnesHut::apply(BodyStore& bodies) {
+	gather(bodies);
+	if (m_ids.empty()) {
+		m_nodes.clear();
+		m_levelStart.assign(1, 0);
+		return;
+	}
+	//Stable, so equal codes stay in id order
+	RadixSort::SortPairs(m_keys, m_ids, 3 * MaxLevel, m_sortBuffers);
+	buildTree();
+	summarize(bodies);
+	traverse(bodies);
+}
+
+//Compacts the massive live bodies into m_ids in id order and assigns their Morton codes
+void BarnesHut::gather(const BodyStore& bodies) {
+	ThreadPool& pool = ThreadPool::Global();
+	auto source = [&](int i) { return IsSource(bodies, i); };
+	glm::vec3 lo, hi;
+	const int total = ParallelGather::Count(bodies.capacity(), source, [&](int i) { return bodies.currPos.get(i); }, m_gatherBuffers, lo, hi);
+	m_ids.resize(total);
+	m_keys.resize(total);
+	if (total == 0) return;
+	ParallelGather::Compact(bodies.capacity(), source, [&](int k, int i) { m_ids[k] = i; }, m_gatherBuffers);
+
+	//Root cube; bodies on its far faces are clamped into the last cell
+	glm::vec3 extent = hi - lo;
+	m_size = std::max(extent.x, std::max(extent.y, extent.z));
+	if (m_size <= 0.0f) m_size = 1.0f;
+	const float scale = (float)(1 << MaxLevel) / m_size;
+	const float top = (float)((1 << MaxLevel) - 1);
+
+	pool.parallelFor(total, GatherChunk, [&](int begin, int end) {
+		for (int k = begin; k < end; k++) {
+			const int i = m_ids[k];
+			const float qx = std::min((bodies.currPos.x[i] - lo.x) * scale, top);
+			const float qy = std::min((bodies.currPos.y[i] - lo.y) * scale, top);
+			const float qz = std::min((bodies.currPos.z[i] - lo.z) * scale, top);
+			m_keys[k] = SpreadBits((uint64_t)qx) << 2 | SpreadBits((uint64_t)qy) << 1 | SpreadBits((uint64_t)qz);
+		}
+	});
+
+	//Sorted positions and masses, filled in once the order is known
+	m_px.resize(total);
+	m_py.resize(total);
+	m_pz.resize(total);
+	m_mass.resize(total);
+}
+
+//Splits cells level by level. Every cell of a level counts its non-empty octants, a scan
+//places the children, and a second pass writes them; sorted codes make each octant a
+//contiguous subrange found by binary search.
+void BarnesHut::buildTree() {
+	ThreadPool& pool = ThreadPool::Global();
+	const int count = (int)m_ids.size();
+
+	m_nodes.resize(1);
+	Node& root = m_nodes[0];
+	root.size = m_size;
+	root.begin = 0;
+	root.end = count;
+	root.firstChild = 0;
+	root.childCount = 0;
+	m_levelStart.assign(1, 0);
+	m_levelStart.push_back(1);
+
+	for (int level = 0; level < MaxLevel; level++) {
+		const int levelBegin = m_levelStart[level];
+		const int levelEnd = m_levelStart[level + 1];
+		const int frontier = levelEnd - levelBegin;
+
+		auto forEachOctant = [&](const Node& node, int& octants, Node* out) {
+			int begin = node.begin;
+			octants = 0;
+			while (begin < node.end) {
+				const int octant = Octant(m_keys[begin], level);
+				const int end = (int)(std::partition_point(m_keys.begin() + begin, m_keys.begin() + node.end,
+					[&](uint64_t key) { return Octant(key, level) <= octant; }) - m_keys.begin());
+				if (out) {
+					Node& child = out[octants];
+					child.size = node.size * 0.5f;
+					child.begin = begin;
+					child.end = end;
+					child.firstChild = 0;
+					child.childCount = 0;
+				}
+				octants++;
+				begin = end;
+			}
+		};
+
+		m_childOffset.resize(frontier + 1);
+		pool.parallelFor(frontier, ChunkSize, [&](int begin, int end) {
+			for (int k = begin; k < end; k++) {
+				const Node& node = m_nodes[levelBegin + k];
+				int octants = 0;
+				if (node.end - node.begin > leafSize) forEachOctant(node, octants, nullptr);
+				m_childOffset[k] = octants;
+			}
+		});
+
+		int total = 0;
+		for (int k = 0; k < frontier; k++) {
+			const int n = m_childOffset[k];
+			m_childOffset[k] = total;
+			total += n;
+		}
+		if (total == 0) break;
+
+		m_nodes.resize(levelEnd + total);
+		pool.parallelFor(frontier, ChunkSize, [&](int begin, int end) {
+			for (int k = begin; k < end; k++) {
+				Node& node = m_nodes[levelBegin + k];
+				if (node.end - node.begin <= leafSize) continue;
+				node.firstChild = levelEnd + m_childOffset[k];
+				forEachOctant(node, node.childCount, &m_nodes[node.firstChild]);
+			}
+		});
+		m_levelStart.push_back(levelEnd + total);
+	}
+
+	//Groups are the largest cells of at most groupSize bodies, and any larger leaves
+	m_groups.clear();
+	int stack[StackSize];
+	int top = 0;
+	stack[top++] = 0;
+	while (top > 0) {
+		const int n = stack[--top];
+		const Node& node = m_nodes[n];
+		if (node.childCount == 0 || node.end - node.begin <= groupSize) {
+			m_groups.push_back(n);
+			continue;
+		}
+		for (int c = node.firstChild + node.childCount - 1; c >= node.firstChild; c--) stack[top++] = c;
+	}
+}
+
+//Copies positions and masses into sorted order, then sums mass and centroid of every cell,
+//deepest level first so children are done before their parents
+void BarnesHut::summarize(const BodyStore& bodies) {
+	ThreadPool& pool = ThreadPool::Global();
+	const int count = (int)m_ids.size();
+
+	pool.parallelFor(count, GatherChunk, [&](int begin, int end) {
+		for (int k = begin; k < end; k++) {
+			const int i = m_ids[k];
+			m_px[k] = bodies.currPos.x[i];
+			m_py[k] = bodies.currPos.y[i];
+			m_pz[k] = bodies.currPos.z[i];
+			m_mass[k] = bodies.mass[i];
+		}
+	});
+
+	for (int level = (int)m_levelStart.size() - 2; level >= 0; level--) {
+		const int levelBegin = m_levelStart[level];
+		pool.parallelFor(m_levelStart[level + 1] - levelBegin, ChunkSize, [&](int begin, int end) {
+			for (int k = levelBegin + begin; k < levelBegin + end; k++) {
+				Node& node = m_nodes[k];
+				float mass = 0.0f, x = 0.0f, y = 0.0f, z = 0.0f;
+				if (node.childCount == 0) {
+					for (int j = node.begin; j < node.end; j++) {
+						mass += m_mass[j];
+						x += m_mass[j] * m_px[j];
+						y += m_mass[j] * m_py[j];
+						z += m_mass[j] * m_pz[j];
+					}
+				}
+				else {
+					for (int c = node.firstChild; c < node.firstChild + node.childCount; c++) {
+						const Node& child = m_nodes[c];
+						mass += child.mass;
+						x += child.mass * child.cx;
+						y += child.mass * child.cy;
+						z += child.mass * child.cz;
+					}
+				}
+				node.mass = mass;
+				node.cx = x / mass;
+				node.cy = y / mass;
+				node.cz = z / mass;
+			}
+		});
+	}
+}
+
+//Point masses acting on one group, one array per component
+struct InteractionList {
+	AlignedVector<float> x, y, z, mass;
+	int size = 0;
+
+	//Makes room for n more entries
+	void reserve(int n) {
+		if (size + n <= (int)mass.size()) return;
+		const size_t capacity = std::max(mass.size() * 2, (size_t)(size + n));
+		x.resize(capacity);
+		y.resize(capacity);
+		z.resize(capacity);
+		mass.resize(capacity);
+	}
+	void push(float px, float py, float pz, float m) {
+		x[size] = px;
+		y[size] = py;
+		z[size] = pz;
+		mass[size] = m;
+		size++;
+	}
+};
+
+//Each group walks the tree once for all of its bodies. A cell is accepted only if it passes
+//the opening test from every point of the sphere around the group's bodies, and is not an
+//ancestor of the group. Accepted cells and the bodies of opened leaves, the group's own
+//included, go into one list of point masses, which is then summed for each awake body of the
+//group a SIMD lane at a time. Zero distances are masked out, which drops each body's pull on
+//itself.
+void BarnesHut::traverse(BodyStore& bodies) const {
+	const float inverseTheta = theta > 0.0f ? 1.0f / theta : 0.0f;
+	const Simd::Float softening2 = Simd::Set1(softening * softening);
+	const Simd::Float one = Simd::Set1(1.0f);
+	const float g = gravitationalConstant;
+
+	ThreadPool::Global().parallelFor((int)m_groups.size(), GroupChunk, [&](int begin, int end) {
+		int stack[StackSize];
+		InteractionList list;
+		for (int n = begin; n < end; n++) {
+			const Node& group = m_nodes[m_groups[n]];
+			bool awake = false;
+			glm::vec3 lo(INFINITY, INFINITY, INFINITY);
+			glm::vec3 hi(-INFINITY, -INFINITY, -INFINITY);
+			for (int k = group.begin; k < group.end; k++) {
+				awake = awake || bodies.isActive(m_ids[k]);
+				lo = glm::vec3(std::min(lo.x, m_px[k]), std::min(lo.y, m_py[k]), std::min(lo.z, m_pz[k]));
+				hi = glm::vec3(std::max(hi.x, m_px[k]), std::max(hi.y, m_py[k]), std::max(hi.z, m_pz[k]));
+			}
+			if (!awake) continue;
+			const glm::vec3 center = (lo + hi) * 0.5f;
+			const glm::vec3 half = (hi - lo) * 0.5f;
+			const float radius = std::sqrt(half.x * half.x + half.y * half.y + half.z * half.z);
+
+			list.size = 0;
+			int top = 0;
+			stack[top++] = 0;
+			while (top > 0) {
+				const Node& node = m_nodes[stack[--top]];
+				const bool ancestor = node.begin <= group.begin && group.end <= node.end;
+				if (!ancestor && theta > 0.0f) {
+					const float dx = node.cx - center.x;
+					const float dy = node.cy - center.y;
+					const float dz = node.cz - center.z;
+					//s < theta * (d - radius), squared
+					const float reach = radius + node.size * inverseTheta;
+					if (dx * dx + dy * dy + dz * dz > reach * reach) {
+						list.reserve(1);
+						list.push(node.cx, node.cy, node.cz, node.mass);
+						continue;
+					}
+				}
+				if (node.childCount == 0) {
+					const int count = node.end - node.begin;
+					list.reserve(count);
+					std::copy(m_px.begin() + node.begin, m_px.begin() + node.end, list.x.begin() + list.size);
+					std::copy(m_py.begin() + node.begin, m_py.begin() + node.end, list.y.begin() + list.size);
+					std::copy(m_pz.begin() + node.begin, m_pz.begin() + node.end, list.z.begin() + list.size);
+					std::copy(m_mass.begin() + node.begin, m_mass.begin() + node.end, list.mass.begin() + list.size);
+					list.size += count;
+				}
+				else {
+					for (int c = node.firstChild; c < node.firstChild + node.childCount; c++) stack[top++] = c;
+				}
+			}
+			//Massless padding fills the last vector
+			list.reserve(SIMD_WIDTH);
+			while (list.size % SIMD_WIDTH) list.push(0.0f, 0.0f, 0.0f, 0.0f);
+
+			for (int k = group.begin; k < group.end; k++) {
+				const int i = m_ids[k];
+				if (!bodies.isActive(i)) continue;
+				const Simd::Float px = Simd::Set1(m_px[k]);
+				const Simd::Float py = Simd::Set1(m_py[k]);
+				const Simd::Float pz = Simd::Set1(m_pz[k]);
+				Simd::Float ax = Simd::Zero(), ay = Simd::Zero(), az = Simd::Zero();
+				for (int j = 0; j < list.size; j += SIMD_WIDTH) {
+					const Simd::Float rx = Simd::Sub(Simd::Load(&list.x[j]), px);
+					const Simd::Float ry = Simd::Sub(Simd::Load(&list.y[j]), py);
+					const Simd::Float rz = Simd::Sub(Simd::Load(&list.z[j]), pz);
+					const Simd::Float r2 = Simd::Add(Simd::Add(Simd::Mul(rx, rx), Simd::Mul(ry, ry)), Simd::Mul(rz, rz));
+					const Simd::Float inverse = Simd::And(Simd::Div(one, Simd::Sqrt(Simd::Add(r2, softening2))), Simd::NotEqual(r2, Simd::Zero()));
+					const Simd::Float s = Simd::Mul(Simd::Load(&list.mass[j]), Simd::Mul(Simd::Mul(inverse, inverse), inverse));
+					ax = Simd::Add(ax, Simd::Mul(s, rx));
+					ay = Simd::Add(ay, Simd::Mul(s, ry));
+					az = Simd::Add(az, Simd::Mul(s, rz));
+				}
+				float sx[SIMD_WIDTH], sy[SIMD_WIDTH], sz[SIMD_WIDTH];
+				Simd::Store(sx, ax);
+				Simd::Store(sy, ay);
+				Simd::Store(sz, az);
+				float fx = 0.0f, fy = 0.0f, fz = 0.0f;
+				for (int lane = 0; lane < SIMD_WIDTH; lane++) {
+					fx += sx[lane];
+					fy += sy[lane];
+					fz += sz[lane];
+				}
+				const float f = g * m_mass[k];
+				bodies.force.x[i] += f * fx;
+				bodies.force.y[i] += f * fy;
+				bodies.force.z[i] += f * fz;
+			}
+		}
+	});
+}
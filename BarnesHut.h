@@ -0,0 +1,78 @@
+#pragma once
+#include "BodyStore.h"
+#include "ParallelGather.h"
+#include "RadixSort.h"
+#include <cstdint>
+#include <vector>
+
+//Mutual gravitation between every massive body, in O(n log n) by the Barnes-Hut method.
+//
+//Each apply() rebuilds a linear octree from scratch. Massive live bodies get a 63-bit Morton
+//code inside the cube bounding them all, and are radix sorted by code, so every octree cell
+//is a contiguous range of the sorted bodies. Cells are split level by level while they hold
+//more than leafSize bodies. Each level's children are written in one parallel pass, so the
+//nodes end up in breadth-first order with siblings contiguous. Mass and centroid are then
+//summed bottom-up, one level at a time.
+//
+//Forces are found for groups of nearby bodies at a time. A cell of side s whose centroid is d
+//away from the nearest point of the group's bounding sphere is taken as a single point mass
+//when s < theta * d; otherwise it is opened. The resulting list of point masses is shared by
+//every body in the group and summed with SIMD. theta = 0 opens every cell and gives the
+//exact O(n^2) sum.
+//
+//Static (massless) bodies neither attract nor are attracted. Sleeping bodies still attract.
+//Results are independent of the thread count.
+class BarnesHut {
+public:
+	//Adds the pull of every massive live body to the force of every awake massive body
+	void apply(BodyStore& bodies);
+
+	//Opening angle; larger is faster and less accurate. Testing against the whole group is
+	//stricter than the classic per-body test, so 0.8 here is about as accurate as 0.5 there.
+	float theta = 0.8f;
+	//In simulation units
+	float gravitationalConstant = 1.0f;
+	//Plummer softening length; keeps close encounters finite
+	float softening = 0.05f;
+	//Cells holding at most this many bodies are not split
+	int leafSize = 16;
+	//Bodies in a cell of at most this many share one tree walk and interaction list. Larger
+	//groups walk less but open more cells.
+	int groupSize = 64;
+
+	int nodeCount() const { return (int)m_nodes.size(); }
+	int depth() const { return (int)m_levelStart.size() - 1; }
+private:
+	struct Node {
+		//Centroid and total mass of the bodies in the cell
+		float cx, cy, cz, mass;
+		//Edge length of the cell
+		float size;
+		//Sorted bodies m_keys[begin .. end)
+		int begin, end;
+		//Children are m_nodes[firstChild .. firstChild + childCount); none for a leaf
+		int firstChild, childCount;
+	};
+
+	void gather(const BodyStore& bodies);
+	void buildTree();
+	void summarize(const BodyStore& bodies);
+	void traverse(BodyStore& bodies) const;
+
+	std::vector<int> m_ids;
+	std::vector<uint64_t> m_keys;
+	RadixSort::Buffers<uint64_t> m_sortBuffers;
+	ParallelGather::Buffers m_gatherBuffers;
+
+	float m_size = 0.0f;
+
+	//Positions and masses in sorted order
+	AlignedVector<float> m_px, m_py, m_pz, m_mass;
+
+	std::vector<Node> m_nodes;
+	//Nodes of level l are m_nodes[m_levelStart[l] .. m_levelStart[l + 1])
+	std::vector<int> m_levelStart;
+	std::vector<int> m_childOffset;
+	//Cells whose bodies share one tree walk
+	std::vector<int> m_groups;
+};
@@ -0,0 +1,204 @@
+#include "BodyStore.h"
+#include "Inertia.h"
+#include "RotationKernels.h"
+#include <algorithm>
+
+void Vec3Stream::fill(float v) {
+	std::fill(x.begin(), x.end(), v);
+	std::fill(y.begin(), y.end(), v);
+	std::fill(z.begin(), z.end(), v);
+}
+
+void BodyStore::clearForces() {
+	forEachActiveRange([this](int begin, int end) {
+		std::fill(force.x.begin() + begin, force.x.begin() + end, 0.0f);
+		std::fill(force.y.begin() + begin, force.y.begin() + end, 0.0f);
+		std::fill(force.z.begin() + begin, force.z.begin() + end, 0.0f);
+		std::fill(torque.x.begin() + begin, torque.x.begin() + end, 0.0f);
+		std::fill(torque.y.begin() + begin, torque.y.begin() + end, 0.0f);
+		std::fill(torque.z.begin() + begin, torque.z.begin() + end, 0.0f);
+	});
+}
+
+int BodyStore::add(const PhysicsComponent& c) {
+	int id;
+	if (!m_freeSlots.empty()) {
+		id = m_freeSlots.back();
+		m_freeSlots.pop_back();
+	}
+	else {
+		id = m_slots;
+		grow(m_slots + 1);
+	}
+	m_liveMask[id >> 6] |= (1ull << (id & 63));
+	m_count++;
+	set(id, c);
+	return id;
+}
+
+void BodyStore::remove(int id) {
+	assert(id >= 0 && id < m_slots);
+	uint64_t bit = 1ull << (id & 63);
+	if (!(m_liveMask[id >> 6] & bit)) return;
+
+	//Clearing the live bit first makes set() leave the slot inactive
+	m_liveMask[id >> 6] &= ~bit;
+	set(id, PhysicsComponent());
+	m_freeSlots.push_back(id);
+	m_count--;
+}
+
+void BodyStore::reserve(int n) {
+	currPos.reserve(n);
+	oldPos.reserve(n);
+	velocity.reserve(n);
+	force.reserve(n);
+	halfExtent.reserve(n);
+	sweep.reserve(n);
+	orientation.reserve(n);
+	oldOrientation.reserve(n);
+	angularVelocity.reserve(n);
+	torque.reserve(n);
+	inverseInertia.reserve(n);
+	inverseInertiaWorld.reserve(n);
+	mass.reserve(n);
+	inverseMass.reserve(n);
+	restSteps.reserve(n);
+	activeMask.reserve((n + 63) >> 6);
+	sleepingMask.reserve((n + 63) >> 6);
+	m_liveMask.reserve((n + 63) >> 6);
+}
+
+void BodyStore::clear() {
+	currPos.resize(0);
+	oldPos.resize(0);
+	velocity.resize(0);
+	force.resize(0);
+	halfExtent.resize(0);
+	sweep.resize(0);
+	orientation.resize(0);
+	oldOrientation.resize(0);
+	angularVelocity.resize(0);
+	torque.resize(0);
+	inverseInertia.resize(0);
+	inverseInertiaWorld.resize(0);
+	mass.clear();
+	inverseMass.clear();
+	restSteps.clear();
+	activeMask.clear();
+	sleepingMask.clear();
+	m_liveMask.clear();
+	m_freeSlots.clear();
+	m_slots = 0;
+	m_count = 0;
+	m_activeVersion++;
+}
+
+PhysicsComponent BodyStore::get(int id) const {
+	PhysicsComponent c;
+	c.currPos = currPos.get(id);
+	c.oldPos = oldPos.get(id);
+	c.velocity = velocity.get(id);
+	c.angularVelocity = angularVelocity.get(id);
+	c.mass = mass[id];
+	c.halfExtent = halfExtent.get(id);
+	c.orientation = orientation.get(id);
+	c.active = isActive(id) || isSleeping(id);
+	return c;
+}
+
+void BodyStore::set(int id, const PhysicsComponent& c) {
+	currPos.set(id, c.currPos);
+	oldPos.set(id, c.oldPos);
+	velocity.set(id, c.velocity);
+	angularVelocity.set(id, c.angularVelocity);
+	force.set(id, glm::vec3(0, 0, 0));
+	torque.set(id, glm::vec3(0, 0, 0));
+	halfExtent.set(id, c.halfExtent);
+	sweep.set(id, glm::vec3(0, 0, 0));
+	orientation.set(id, c.orientation);
+	oldOrientation.set(id, c.orientation);
+	setMass(id, c.mass);
+	setActive(id, c.active);
+}
+
+void BodyStore::setMass(int id, float m) {
+	mass[id] = m;
+	inverseMass[id] = m > 0.0f ? 1.0f / m : 0.0f;
+	updateInertia(id);
+}
+
+void BodyStore::updateInertia(int id) {
+	glm::vec3 h = halfExtent.get(id);
+	glm::vec3 inverse = glm::vec3(0, 0, 0);
+	if (mass[id] > 0.0f && (h.x > 0.0f || h.y > 0.0f || h.z > 0.0f)) {
+		Inertia::Diagonal d = h == glm::vec3(0.5f, 0.5f, 0.5f) ? Inertia::UnitCube : Inertia::Box(h.x, h.y, h.z);
+		//A flat box has no moment about its normal; leave that axis unable to rotate
+		inverse.x = d.x > 0.0f ? 1.0f / (mass[id] * d.x) : 0.0f;
+		inverse.y = d.y > 0.0f ? 1.0f / (mass[id] * d.y) : 0.0f;
+		inverse.z = d.z > 0.0f ? 1.0f / (mass[id] * d.z) : 0.0f;
+	}
+	inverseInertia.set(id, inverse);
+	RotationKernels::WorldInverseInertia(&orientation.x[id], &orientation.y[id], &orientation.z[id], &orientation.w[id],
+		&inverseInertia.x[id], &inverseInertia.y[id], &inverseInertia.z[id],
+		&inverseInertiaWorld.xx[id], &inverseInertiaWorld.yy[id], &inverseInertiaWorld.zz[id],
+		&inverseInertiaWorld.xy[id], &inverseInertiaWorld.xz[id], &inverseInertiaWorld.yz[id], 1);
+}
+
+//Explicitly enabling or disabling a body also ends any sleep
+void BodyStore::setActive(int id, bool active) {
+	uint64_t bit = 1ull << (id & 63);
+	uint64_t before = activeMask[id >> 6];
+	if (active && (m_liveMask[id >> 6] & bit)) {
+		activeMask[id >> 6] |= bit;
+	}
+	else {
+		activeMask[id >> 6] &= ~bit;
+	}
+	sleepingMask[id >> 6] &= ~bit;
+	restSteps[id] = 0;
+	if (activeMask[id >> 6] != before) m_activeVersion++;
+}
+
+void BodyStore::sleep(int id) {
+	uint64_t bit = 1ull << (id & 63);
+	if (!(activeMask[id >> 6] & bit)) return;
+	activeMask[id >> 6] &= ~bit;
+	sleepingMask[id >> 6] |= bit;
+	velocity.set(id, glm::vec3(0, 0, 0));
+	angularVelocity.set(id, glm::vec3(0, 0, 0));
+	oldPos.set(id, currPos.get(id));
+	oldOrientation.set(id, orientation.get(id));
+	m_activeVersion++;
+}
+
+void BodyStore::wake(int id) {
+	uint64_t bit = 1ull << (id & 63);
+	if (!(sleepingMask[id >> 6] & bit)) return;
+	sleepingMask[id >> 6] &= ~bit;
+	activeMask[id >> 6] |= bit;
+	restSteps[id] = 0;
+	m_activeVersion++;
+}
+
+void BodyStore::grow(int slots) {
+	currPos.resize(slots);
+	oldPos.resize(slots);
+	velocity.resize(slots);
+	force.resize(slots);
+	halfExtent.resize(slots);
+	sweep.resize(slots);
+	orientation.resize(slots);
+	oldOrientation.resize(slots);
+	angularVelocity.resize(slots);
+	torque.resize(slots);
+	inverseInertia.resize(slots);
+	inverseInertiaWorld.resize(slots);
+	mass.resize(slots, 0.0f);
+	inverseMass.resize(slots, 0.0f);
+	restSteps.resize(slots, 0);
+	activeMask.resize((slots + 63) >> 6, 0);
+	sleepingMask.resize((slots + 63) >> 6, 0);
+	m_liveMask.resize((slots + 63) >> 6, 0);
+	m_slots = slots;
+}
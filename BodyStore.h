@@ -0,0 +1,174 @@
+#pragma once
+#include "Globals.h"
+#include "AlignedAllocator.h"
+#include <cstdint>
+#include <vector>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+//Description of a single body, used to add bodies to and read them back from the store
+struct PhysicsComponent {
+	glm::vec3 currPos = glm::vec3(0,0,0);
+	glm::vec3 oldPos = glm::vec3(0,0,0);
+	glm::vec3 velocity = glm::vec3(0,0,0);
+	glm::vec3 angularVelocity = glm::vec3(0,0,0); //World space, radians per second
+	float mass = 0; //0 = static, never integrated
+	glm::vec3 halfExtent = glm::vec3(0,0,0); //Box half size for collision, 0 = no collision shape
+	glm::quat orientation = glm::quat(1,0,0,0);
+	bool active = true;
+};
+
+inline int CountTrailingZeros(uint64_t bits) {
+#if defined(_MSC_VER) && defined(_M_X64)
+	unsigned long index;
+	_BitScanForward64(&index, bits);
+	return (int)index;
+#elif defined(_MSC_VER)
+	unsigned long index;
+	if (_BitScanForward(&index, (unsigned long)bits)) return (int)index;
+	_BitScanForward(&index, (unsigned long)(bits >> 32));
+	return (int)index + 32;
+#else
+	return __builtin_ctzll(bits);
+#endif
+}
+
+//One float array per axis so kernels can stream a single component at a time
+struct Vec3Stream {
+	AlignedVector<float> x, y, z;
+
+	glm::vec3 get(int i) const { return glm::vec3(x[i], y[i], z[i]); }
+	void set(int i, glm::vec3 v) { x[i] = v.x; y[i] = v.y; z[i] = v.z; }
+	void add(int i, glm::vec3 v) { x[i] += v.x; y[i] += v.y; z[i] += v.z; }
+	void resize(size_t n) { x.resize(n, 0.0f); y.resize(n, 0.0f); z.resize(n, 0.0f); }
+	void reserve(size_t n) { x.reserve(n); y.reserve(n); z.reserve(n); }
+	void fill(float v);
+};
+
+//Quaternion per body, one array per component; new entries are the identity
+struct QuatStream {
+	AlignedVector<float> x, y, z, w;
+
+	glm::quat get(int i) const { return glm::quat(w[i], x[i], y[i], z[i]); }
+	void set(int i, glm::quat q) { x[i] = q.x; y[i] = q.y; z[i] = q.z; w[i] = q.w; }
+	void resize(size_t n) { x.resize(n, 0.0f); y.resize(n, 0.0f); z.resize(n, 0.0f); w.resize(n, 1.0f); }
+	void reserve(size_t n) { x.reserve(n); y.reserve(n); z.reserve(n); w.reserve(n); }
+};
+
+//Symmetric 3x3 matrix per body: diagonal xx, yy, zz and off-diagonal xy, xz, yz
+struct SymMat3Stream {
+	AlignedVector<float> xx, yy, zz, xy, xz, yz;
+
+	glm::mat3 get(int i) const {
+		return glm::mat3(glm::vec3(xx[i], xy[i], xz[i]), glm::vec3(xy[i], yy[i], yz[i]), glm::vec3(xz[i], yz[i], zz[i]));
+	}
+	void resize(size_t n) { xx.resize(n, 0.0f); yy.resize(n, 0.0f); zz.resize(n, 0.0f); xy.resize(n, 0.0f); xz.resize(n, 0.0f); yz.resize(n, 0.0f); }
+	void reserve(size_t n) { xx.reserve(n); yy.reserve(n); zz.reserve(n); xy.reserve(n); xz.reserve(n); yz.reserve(n); }
+};
+
+//Structure-of-arrays storage for every body in the simulation.
+//Bodies are addressed by slot index; removed slots are recycled by later adds so
+//indices held elsewhere (springs, cubes) stay valid for the lifetime of the body.
+//
+//A sleeping body is live but has its active bit cleared, so every pass that walks the
+//active mask skips it. wake() or setActive(id, true) brings it back.
+class BodyStore {
+public:
+	int add(const PhysicsComponent& c);
+	void remove(int id);
+	void reserve(int n);
+	void clear();
+
+	PhysicsComponent get(int id) const;
+	void set(int id, const PhysicsComponent& c);
+	//Also rescales the inertia
+	void setMass(int id, float m);
+	//Recomputes inverseInertia and inverseInertiaWorld from the mass, box shape and
+	//orientation. Call after changing halfExtent or orientation of a body directly.
+	void updateInertia(int id);
+
+	bool isActive(int id) const { return (activeMask[id >> 6] >> (id & 63)) & 1; }
+	void setActive(int id, bool active);
+
+	bool isSleeping(int id) const { return (sleepingMask[id >> 6] >> (id & 63)) & 1; }
+	void sleep(int id);
+	void wake(int id);
+
+	//Bumped whenever any active bit changes, for caches built over the awake set
+	unsigned int activeVersion() const { return m_activeVersion; }
+
+	//Number of slots, including free ones. Every stream has this many entries.
+	int capacity() const { return m_slots; }
+	//Number of live bodies
+	int size() const { return m_count; }
+
+	//Clears forces and torques. Only slots in words with an active body are cleared. Forces
+	//of sleeping bodies are never read; a body is cleared again before its first step after waking.
+	void clearForces();
+
+	//Calls fn(i) for every active slot, running full 64-body words without bit tests
+	template <typename Fn>
+	void forEachActive(Fn fn) const {
+		for (size_t w = 0; w < activeMask.size(); w++) {
+			uint64_t bits = activeMask[w];
+			int base = (int)(w << 6);
+			if (bits == ~0ull) {
+				for (int i = base; i < base + 64; i++) fn(i);
+			}
+			else {
+				while (bits) {
+					fn(base + CountTrailingZeros(bits));
+					bits &= bits - 1;
+				}
+			}
+		}
+	}
+
+	//Calls fn(begin, end) for each run of 64-slot words that hold at least one active body,
+	//so dense SIMD kernels can skip large sleeping or empty regions
+	template <typename Fn>
+	void forEachActiveRange(Fn fn) const {
+		const int words = (int)activeMask.size();
+		int w = 0;
+		while (w < words) {
+			while (w < words && activeMask[w] == 0) w++;
+			if (w == words) break;
+			int begin = w;
+			while (w < words && activeMask[w] != 0) w++;
+			fn(begin << 6, (w << 6) < m_slots ? (w << 6) : m_slots);
+		}
+	}
+
+	Vec3Stream currPos;
+	Vec3Stream oldPos;
+	Vec3Stream velocity;
+	Vec3Stream force;
+	Vec3Stream halfExtent;
+	//Displacement the broadphase sweeps each box along. PhysicsSystem sets it to the coming
+	//step's motion for bodies under continuous collision; zero for every other body.
+	Vec3Stream sweep;
+	QuatStream orientation;
+	//Orientation at the start of the last step, for interpolated drawing
+	QuatStream oldOrientation;
+	Vec3Stream angularVelocity;
+	Vec3Stream torque;
+	//Body-space inverse principal moments; zero for static and shapeless bodies, which never rotate
+	Vec3Stream inverseInertia;
+	//inverseInertia rotated into world space, refreshed every step for awake bodies
+	SymMat3Stream inverseInertiaWorld;
+	AlignedVector<float> mass;
+	AlignedVector<float> inverseMass;
+	std::vector<uint64_t> activeMask;
+	std::vector<uint64_t> sleepingMask;
+	//Consecutive steps each body has spent below the sleep speed
+	std::vector<int> restSteps;
+private:
+	void grow(int slots);
+
+	std::vector<uint64_t> m_liveMask;
+	std::vector<int> m_freeSlots;
+	int m_slots = 0;
+	int m_count = 0;
+	unsigned int m_activeVersion = 0;
+};
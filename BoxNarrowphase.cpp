@@ -0,0 +1,369 @@
+#include "BoxNarrowphase.h"
+#include "Simd.h"
+#include "ThreadPool.h"
+#include <cfloat>
+
+using namespace Simd;
+
+static const int ChunkSize = 256;
+
+//Axis codes: 0-2 faces of a, 3-5 faces of b, 6 + 3i + j edge i of a x edge j of b
+static const int FirstEdgeAxis = 6;
+
+//Box axes (rotation matrix columns) of one quaternion per lane
+static inline void QuatAxes(Float x, Float y, Float z, Float w, Float axes[3][3]) {
+	const Float one = Set1(1.0f);
+	const Float two = Set1(2.0f);
+	const Float xx = Mul(x, x), yy = Mul(y, y), zz = Mul(z, z);
+	const Float xy = Mul(x, y), xz = Mul(x, z), yz = Mul(y, z);
+	const Float wx = Mul(w, x), wy = Mul(w, y), wz = Mul(w, z);
+	axes[0][0] = Sub(one, Mul(two, Add(yy, zz)));
+	axes[0][1] = Mul(two, Add(xy, wz));
+	axes[0][2] = Mul(two, Sub(xz, wy));
+	axes[1][0] = Mul(two, Sub(xy, wz));
+	axes[1][1] = Sub(one, Mul(two, Add(xx, zz)));
+	axes[1][2] = Mul(two, Add(yz, wx));
+	axes[2][0] = Mul(two, Add(xz, wy));
+	axes[2][1] = Mul(two, Sub(yz, wx));
+	axes[2][2] = Sub(one, Mul(two, Add(xx, yy)));
+}
+
+static inline Float Dot3(const Float a[3], const Float b[3]) {
+	return Add(Add(Mul(a[0], b[0]), Mul(a[1], b[1])), Mul(a[2], b[2]));
+}
+
+void BoxNarrowphase::collide(const BodyStore& bodies, const std::vector<BodyPair>& pairs) {
+	const int count = (int)pairs.size();
+	m_manifolds.clear();
+	if (count == 0) return;
+
+	//Pad with copies of the last pair so every batch is full
+	const int padded = (count + SIMD_WIDTH - 1) / SIMD_WIDTH * SIMD_WIDTH;
+	m_indexA.resize(padded);
+	m_indexB.resize(padded);
+	m_separation.resize(padded);
+	m_axis.resize(padded);
+	for (int p = 0; p < padded; p++) {
+		const BodyPair& pair = pairs[p < count ? p : count - 1];
+		m_indexA[p] = pair.a;
+		m_indexB[p] = pair.b;
+	}
+
+	ThreadPool& pool = ThreadPool::Global();
+	const int batches = padded / SIMD_WIDTH;
+	pool.parallelFor(batches, ChunkSize / SIMD_WIDTH, [&](int begin, int end) {
+		for (int batch = begin; batch < end; batch++) separatingAxes(bodies, batch * SIMD_WIDTH);
+	});
+
+	const int chunks = (count + ChunkSize - 1) / ChunkSize;
+	m_chunkManifolds.resize(chunks);
+	pool.parallelFor(count, ChunkSize, [&](int begin, int end) {
+		std::vector<ContactManifold>& out = m_chunkManifolds[begin / ChunkSize];
+		out.clear();
+		ContactManifold manifold;
+		for (int p = begin; p < end; p++) {
+			if (m_separation[p] > contactMargin) continue;
+			if (buildManifold(bodies, p, manifold)) out.push_back(manifold);
+		}
+	});
+	for (int c = 0; c < chunks; c++) {
+		m_manifolds.insert(m_manifolds.end(), m_chunkManifolds[c].begin(), m_chunkManifolds[c].end());
+	}
+}
+
+//Separating axis test for SIMD_WIDTH pairs. Works in a's frame: R[i][j] = a_i . b_j and
+//t = a's axes . (center b - center a). Stores the separation along the chosen axis
+//(positive means apart) and its code. Edge axes only win if clearly better than the best
+//face, since face contacts give the more stable manifold.
+void BoxNarrowphase::separatingAxes(const BodyStore& bodies, int first) {
+	const Int ia = LoadInt(&m_indexA[first]);
+	const Int ib = LoadInt(&m_indexB[first]);
+
+	Float axesA[3][3], axesB[3][3];
+	QuatAxes(Gather(bodies.orientation.x.data(), ia), Gather(bodies.orientation.y.data(), ia),
+		Gather(bodies.orientation.z.data(), ia), Gather(bodies.orientation.w.data(), ia), axesA);
+	QuatAxes(Gather(bodies.orientation.x.data(), ib), Gather(bodies.orientation.y.data(), ib),
+		Gather(bodies.orientation.z.data(), ib), Gather(bodies.orientation.w.data(), ib), axesB);
+	const Float ha[3] = { Gather(bodies.halfExtent.x.data(), ia), Gather(bodies.halfExtent.y.data(), ia), Gather(bodies.halfExtent.z.data(), ia) };
+	const Float hb[3] = { Gather(bodies.halfExtent.x.data(), ib), Gather(bodies.halfExtent.y.data(), ib), Gather(bodies.halfExtent.z.data(), ib) };
+	const Float d[3] = {
+		Sub(Gather(bodies.currPos.x.data(), ib), Gather(bodies.currPos.x.data(), ia)),
+		Sub(Gather(bodies.currPos.y.data(), ib), Gather(bodies.currPos.y.data(), ia)),
+		Sub(Gather(bodies.currPos.z.data(), ib), Gather(bodies.currPos.z.data(), ia)) };
+
+	//Epsilon keeps near-parallel edges from producing a false separating axis
+	const Float epsilon = Set1(1e-6f);
+	Float R[3][3], absR[3][3], t[3];
+	for (int i = 0; i < 3; i++) {
+		t[i] = Dot3(d, axesA[i]);
+		for (int j = 0; j < 3; j++) {
+			R[i][j] = Dot3(axesA[i], axesB[j]);
+			absR[i][j] = Add(Abs(R[i][j]), epsilon);
+		}
+	}
+
+	Float faceBest = Set1(-FLT_MAX);
+	Float faceAxis = Zero();
+	for (int i = 0; i < 3; i++) {
+		const Float rb = Add(Add(Mul(hb[0], absR[i][0]), Mul(hb[1], absR[i][1])), Mul(hb[2], absR[i][2]));
+		const Float separation = Sub(Abs(t[i]), Add(ha[i], rb));
+		const Float better = Greater(separation, faceBest);
+		faceBest = Select(better, separation, faceBest);
+		faceAxis = Select(better, Set1((float)i), faceAxis);
+	}
+	Float faceBestB = Set1(-FLT_MAX);
+	Float faceAxisB = Zero();
+	for (int j = 0; j < 3; j++) {
+		const Float ra = Add(Add(Mul(ha[0], absR[0][j]), Mul(ha[1], absR[1][j])), Mul(ha[2], absR[2][j]));
+		const Float tb = Add(Add(Mul(t[0], R[0][j]), Mul(t[1], R[1][j])), Mul(t[2], R[2][j]));
+		const Float separation = Sub(Abs(tb), Add(ra, hb[j]));
+		const Float better = Greater(separation, faceBestB);
+		faceBestB = Select(better, separation, faceBestB);
+		faceAxisB = Select(better, Set1((float)(3 + j)), faceAxisB);
+	}
+	//Faces of b likewise only win if clearly better, so resting boxes whose faces tie keep
+	//the same reference face, and with it the same feature ids, from step to step
+	const Float useB = Greater(faceBestB, Add(Mul(faceBest, Set1(0.95f)), Set1(0.01f)));
+	faceBest = Select(useB, faceBestB, faceBest);
+	faceAxis = Select(useB, faceAxisB, faceAxis);
+
+	//Axis a_i x b_j has length sqrt(1 - R[i][j]^2); separations are divided by it so they
+	//compare with the face separations
+	Float edgeBest = Set1(-FLT_MAX);
+	Float edgeAxis = Zero();
+	const Float one = Set1(1.0f);
+	const Float minLength2 = Set1(1e-6f);
+	for (int i = 0; i < 3; i++) {
+		const int i1 = (i + 1) % 3, i2 = (i + 2) % 3;
+		for (int j = 0; j < 3; j++) {
+			const int j1 = (j + 1) % 3, j2 = (j + 2) % 3;
+			const Float ra = Add(Mul(ha[i1], absR[i2][j]), Mul(ha[i2], absR[i1][j]));
+			const Float rb = Add(Mul(hb[j1], absR[i][j2]), Mul(hb[j2], absR[i][j1]));
+			const Float distance = Abs(Sub(Mul(t[i2], R[i1][j]), Mul(t[i1], R[i2][j])));
+			const Float length2 = Sub(one, Mul(R[i][j], R[i][j]));
+			const Float valid = Greater(length2, minLength2);
+			const Float separation = Div(Sub(distance, Add(ra, rb)), Sqrt(Max(length2, minLength2)));
+			const Float better = And(valid, Greater(separation, edgeBest));
+			edgeBest = Select(better, separation, edgeBest);
+			edgeAxis = Select(better, Set1((float)(FirstEdgeAxis + 3 * i + j)), edgeAxis);
+		}
+	}
+
+	const Float useEdge = Greater(edgeBest, Add(Mul(faceBest, Set1(0.95f)), Set1(0.01f)));
+	Float separation = Select(useEdge, edgeBest, faceBest);
+	const Float axis = Select(useEdge, edgeAxis, faceAxis);
+	//Any axis with a gap separates the boxes, whichever axis would be used for contacts
+	const Float largest = Max(Max(faceBest, faceBestB), edgeBest);
+	separation = Select(Greater(largest, Zero()), largest, separation);
+
+	Store(&m_separation[first], separation);
+	Store(&m_axis[first], axis);
+}
+
+namespace {
+	struct Box {
+		glm::vec3 center;
+		glm::vec3 axis[3];
+		float half[3];
+	};
+
+	Box LoadBox(const BodyStore& bodies, int i) {
+		Box box;
+		box.center = bodies.currPos.get(i);
+		glm::mat3 r = glm::mat3_cast(bodies.orientation.get(i));
+		for (int k = 0; k < 3; k++) box.axis[k] = r[k];
+		box.half[0] = bodies.halfExtent.x[i];
+		box.half[1] = bodies.halfExtent.y[i];
+		box.half[2] = bodies.halfExtent.z[i];
+		return box;
+	}
+
+	struct ClipVertex {
+		glm::vec3 position;
+		int id;
+	};
+
+	//Keeps the part of the polygon with dot(normal, p) <= offset. New vertices on the
+	//plane get an id from the plane and the edge they came from.
+	int ClipPolygon(const ClipVertex* in, int count, glm::vec3 normal, float offset, int plane, ClipVertex* out) {
+		int outCount = 0;
+		for (int k = 0; k < count; k++) {
+			const ClipVertex& a = in[k];
+			const ClipVertex& b = in[(k + 1) % count];
+			const float da = glm::dot(normal, a.position) - offset;
+			const float db = glm::dot(normal, b.position) - offset;
+			if (da <= 0.0f) out[outCount++] = a;
+			if ((da < 0.0f && db > 0.0f) || (da > 0.0f && db < 0.0f)) {
+				ClipVertex v;
+				v.position = a.position + (b.position - a.position) * (da / (da - db));
+				v.id = 16 * (plane + 1) + (a.id & 15);
+				out[outCount++] = v;
+			}
+		}
+		return outCount;
+	}
+}
+
+//Keeps the deepest point, the point furthest from it, and the two points spanning the
+//largest area on either side of the line between those
+static int ReduceContacts(ContactPoint* points, int count, glm::vec3 normal) {
+	if (count <= 4) return count;
+	int keep[4];
+	keep[0] = 0;
+	for (int k = 1; k < count; k++) {
+		if (points[k].depth > points[keep[0]].depth) keep[0] = k;
+	}
+	keep[1] = keep[0] == 0 ? 1 : 0;
+	float furthest = -1.0f;
+	for (int k = 0; k < count; k++) {
+		glm::vec3 d = points[k].position - points[keep[0]].position;
+		float distance = glm::dot(d, d);
+		if (k != keep[0] && distance > furthest) {
+			furthest = distance;
+			keep[1] = k;
+		}
+	}
+	const glm::vec3 edge = points[keep[1]].position - points[keep[0]].position;
+	float most = -FLT_MAX;
+	float least = FLT_MAX;
+	keep[2] = keep[3] = -1;
+	for (int k = 0; k < count; k++) {
+		if (k == keep[0] || k == keep[1]) continue;
+		float area = glm::dot(glm::cross(edge, points[k].position - points[keep[0]].position), normal);
+		if (area > most) { most = area; keep[2] = k; }
+		if (area < least) { least = area; keep[3] = k; }
+	}
+	if (keep[3] == keep[2]) keep[3] = -1;
+
+	ContactPoint reduced[4];
+	int reducedCount = 0;
+	for (int k = 0; k < 4; k++) {
+		if (keep[k] >= 0) reduced[reducedCount++] = points[keep[k]];
+	}
+	for (int k = 0; k < reducedCount; k++) points[k] = reduced[k];
+	return reducedCount;
+}
+
+bool BoxNarrowphase::buildManifold(const BodyStore& bodies, int pair, ContactManifold& out) const {
+	const int axisCode = (int)m_axis[pair];
+	const Box boxA = LoadBox(bodies, m_indexA[pair]);
+	const Box boxB = LoadBox(bodies, m_indexB[pair]);
+	const glm::vec3 d = boxB.center - boxA.center;
+	out.a = m_indexA[pair];
+	out.b = m_indexB[pair];
+	out.pointCount = 0;
+
+	if (axisCode >= FirstEdgeAxis) {
+		const int i = (axisCode - FirstEdgeAxis) / 3;
+		const int j = (axisCode - FirstEdgeAxis) % 3;
+		glm::vec3 n = glm::normalize(glm::cross(boxA.axis[i], boxB.axis[j]));
+		if (glm::dot(n, d) < 0.0f) n = -n;
+
+		//Support edges: the edge of a furthest along n and the edge of b furthest against it
+		glm::vec3 pointA = boxA.center;
+		glm::vec3 pointB = boxB.center;
+		int signs = 0;
+		for (int k = 0; k < 3; k++) {
+			if (k != i) {
+				const bool positive = glm::dot(n, boxA.axis[k]) > 0.0f;
+				pointA += boxA.axis[k] * (positive ? boxA.half[k] : -boxA.half[k]);
+				signs |= positive ? (1 << k) : 0;
+			}
+			if (k != j) {
+				const bool positive = glm::dot(n, boxB.axis[k]) < 0.0f;
+				pointB += boxB.axis[k] * (positive ? boxB.half[k] : -boxB.half[k]);
+				signs |= positive ? (8 << k) : 0;
+			}
+		}
+
+		//Closest points of the two edge lines, clamped to the edges
+		const glm::vec3 dirA = boxA.axis[i];
+		const glm::vec3 dirB = boxB.axis[j];
+		const glm::vec3 r = pointA - pointB;
+		const float b = glm::dot(dirA, dirB);
+		const float c = glm::dot(dirA, r);
+		const float f = glm::dot(dirB, r);
+		const float denominator = 1.0f - b * b;
+		float s = denominator > 1e-6f ? (b * f - c) / denominator : 0.0f;
+		float t = denominator > 1e-6f ? (f - b * c) / denominator : 0.0f;
+		s = glm::clamp(s, -boxA.half[i], boxA.half[i]);
+		t = glm::clamp(t, -boxB.half[j], boxB.half[j]);
+		const glm::vec3 closestA = pointA + dirA * s;
+		const glm::vec3 closestB = pointB + dirB * t;
+
+		out.normal = n;
+		out.pointCount = 1;
+		out.points[0].position = 0.5f * (closestA + closestB);
+		out.points[0].depth = -m_separation[pair];
+		out.points[0].feature = (axisCode << 16) | signs;
+		return true;
+	}
+
+	//Face contact: the reference face lies on the box whose axis separates least
+	const bool referenceIsA = axisCode < 3;
+	const Box& reference = referenceIsA ? boxA : boxB;
+	const Box& incident = referenceIsA ? boxB : boxA;
+	const int referenceAxis = referenceIsA ? axisCode : axisCode - 3;
+	glm::vec3 n = reference.axis[referenceAxis];
+	const glm::vec3 toIncident = incident.center - reference.center;
+	if (glm::dot(n, toIncident) < 0.0f) n = -n;
+
+	//Incident face: the face of the other box most opposed to n
+	int incidentAxis = 0;
+	float mostOpposed = 0.0f;
+	for (int k = 0; k < 3; k++) {
+		float alignment = std::fabs(glm::dot(incident.axis[k], n));
+		if (alignment > mostOpposed) {
+			mostOpposed = alignment;
+			incidentAxis = k;
+		}
+	}
+	const bool incidentPositive = glm::dot(incident.axis[incidentAxis], n) < 0.0f;
+	const glm::vec3 incidentNormal = incident.axis[incidentAxis] * (incidentPositive ? 1.0f : -1.0f);
+	const glm::vec3 faceCenter = incident.center + incidentNormal * incident.half[incidentAxis];
+	const int u = (incidentAxis + 1) % 3;
+	const int v = (incidentAxis + 2) % 3;
+	const glm::vec3 du = incident.axis[u] * incident.half[u];
+	const glm::vec3 dv = incident.axis[v] * incident.half[v];
+
+	ClipVertex polygon[2][8];
+	polygon[0][0].position = faceCenter + du + dv;
+	polygon[0][1].position = faceCenter - du + dv;
+	polygon[0][2].position = faceCenter - du - dv;
+	polygon[0][3].position = faceCenter + du - dv;
+	for (int k = 0; k < 4; k++) polygon[0][k].id = k;
+	int count = 4;
+	int current = 0;
+
+	//Side planes of the reference face
+	const int ru = (referenceAxis + 1) % 3;
+	const int rv = (referenceAxis + 2) % 3;
+	const glm::vec3 sideNormals[4] = { reference.axis[ru], -reference.axis[ru], reference.axis[rv], -reference.axis[rv] };
+	const float sideHalf[4] = { reference.half[ru], reference.half[ru], reference.half[rv], reference.half[rv] };
+	for (int plane = 0; plane < 4 && count > 0; plane++) {
+		const float offset = glm::dot(sideNormals[plane], reference.center) + sideHalf[plane];
+		count = ClipPolygon(polygon[current], count, sideNormals[plane], offset, plane, polygon[1 - current]);
+		current = 1 - current;
+	}
+
+	const glm::vec3 referenceFace = reference.center + n * reference.half[referenceAxis];
+	const int featureBase = (axisCode << 16) | (((incidentAxis << 1) | (incidentPositive ? 1 : 0)) << 8);
+	ContactPoint points[8];
+	int pointCount = 0;
+	for (int k = 0; k < count; k++) {
+		const glm::vec3 p = polygon[current][k].position;
+		const float depth = glm::dot(n, referenceFace - p);
+		if (depth < -contactMargin) continue;
+		ContactPoint& point = points[pointCount++];
+		point.position = p + n * (0.5f * depth);
+		point.depth = depth;
+		point.feature = featureBase | polygon[current][k].id;
+	}
+	if (pointCount == 0) return false;
+
+	out.normal = referenceIsA ? n : -n;
+	pointCount = ReduceContacts(points, pointCount, n);
+	out.pointCount = pointCount;
+	for (int k = 0; k < pointCount; k++) out.points[k] = points[k];
+	return true;
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include "Broadphase.h"
+#include <vector>
+
+struct ContactPoint {
+	glm::vec3 position;
+	//Overlap along the normal; negative within contactMargin of touching
+	float depth;
+	//Which box features produced the point. Stays the same from step to step while the
+	//boxes keep touching the same way, so solvers can match points for warm starting.
+	int feature;
+};
+
+//Up to four contact points between bodies a and b, sharing one normal from a to b
+struct ContactManifold {
+	int a;
+	int b;
+	glm::vec3 normal;
+	int pointCount;
+	ContactPoint points[4];
+};
+
+//Oriented box vs oriented box contact generation for the broadphase pairs.
+//
+//The separating axis test over the 15 candidate axes (3 face normals per box, 9 edge
+//cross products) runs SIMD_WIDTH pairs at a time with one pair per lane. Pairs that
+//overlap then build their manifold one at a time: for a face axis the incident face is
+//clipped against the side planes of the reference face and reduced to at most 4 points;
+//for an edge axis the closest points of the two edges give one point.
+class BoxNarrowphase {
+public:
+	void collide(const BodyStore& bodies, const std::vector<BodyPair>& pairs);
+
+	//Manifolds of touching pairs, in the order of the input pairs
+	const std::vector<ContactManifold>& manifolds() const { return m_manifolds; }
+
+	//Points up to this far apart are still reported, with negative depth
+	float contactMargin = 0.02f;
+private:
+	void separatingAxes(const BodyStore& bodies, int first);
+	bool buildManifold(const BodyStore& bodies, int pair, ContactManifold& out) const;
+
+	//Per pair, padded to a multiple of SIMD_WIDTH
+	std::vector<int> m_indexA;
+	std::vector<int> m_indexB;
+	std::vector<float> m_separation;
+	std::vector<float> m_axis;
+
+	std::vector<std::vector<ContactManifold>> m_chunkManifolds;
+	std::vector<ContactManifold> m_manifolds;
+};
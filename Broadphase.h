@@ -0,0 +1,37 @@
+#pragma once
+#include "BodyStore.h"
+#include "Aabb.h"
+
+//Candidate collision pair from a broadphase, with a < b
+struct BodyPair {
+	int a;
+	int b;
+};
+
+//A body takes part in collision if it has a shape and is awake or asleep
+inline bool IsCollidable(const BodyStore& bodies, int i) {
+	return (bodies.isActive(i) || bodies.isSleeping(i)) &&
+		(bodies.halfExtent.x[i] > 0.0f || bodies.halfExtent.y[i] > 0.0f || bodies.halfExtent.z[i] > 0.0f);
+}
+
+//Half size of the world axis-aligned box around body i's oriented box
+inline glm::vec3 WorldHalfExtent(const BodyStore& bodies, int i) {
+	glm::vec3 h = bodies.halfExtent.get(i);
+	glm::mat3 r = glm::mat3_cast(bodies.orientation.get(i));
+	return glm::abs(r[0]) * h.x + glm::abs(r[1]) * h.y + glm::abs(r[2]) * h.z;
+}
+
+//World axis-aligned bounds of body i: its box at currPos, stretched along bodies.sweep
+inline void SweptBounds(const BodyStore& bodies, int i, glm::vec3& lo, glm::vec3& hi) {
+	const glm::vec3 p = bodies.currPos.get(i);
+	const glm::vec3 h = WorldHalfExtent(bodies, i);
+	const glm::vec3 s = bodies.sweep.get(i);
+	lo = p - h + glm::min(s, glm::vec3(0, 0, 0));
+	hi = p + h + glm::max(s, glm::vec3(0, 0, 0));
+}
+
+inline bool Overlaps(glm::vec3 loA, glm::vec3 hiA, glm::vec3 loB, glm::vec3 hiB) {
+	return loA.x <= hiB.x && loB.x <= hiA.x &&
+		loA.y <= hiB.y && loB.y <= hiA.y &&
+		loA.z <= hiB.z && loB.z <= hiA.z;
+}
@@ -0,0 +1,75 @@
+#include "BvhBroadphase.h"
+#include "ThreadPool.h"
+#include <algorithm>
+
+static const int ChunkSize = 256;
+
+void BvhBroadphase::reset() {
+	tree.clear();
+	m_proxyOf.clear();
+	m_pairs.clear();
+}
+
+void BvhBroadphase::build(const BodyStore& bodies) {
+	const int slots = bodies.capacity();
+	if ((int)m_proxyOf.size() > slots) reset();
+	m_proxyOf.resize(slots, DynamicAabbTree::Null);
+	m_box.resize(slots);
+	m_moving.resize(slots);
+	m_queries.clear();
+	m_reinserted = 0;
+
+	//Tree updates are serial; only proxies that left their fat box do any real work
+	for (int i = 0; i < slots; i++) {
+		if (!IsCollidable(bodies, i)) {
+			if (m_proxyOf[i] != DynamicAabbTree::Null) {
+				tree.destroyProxy(m_proxyOf[i]);
+				m_proxyOf[i] = DynamicAabbTree::Null;
+			}
+			continue;
+		}
+
+		const glm::vec3 p = bodies.currPos.get(i);
+		SweptBounds(bodies, i, m_box[i].lo, m_box[i].hi);
+		m_moving[i] = bodies.isActive(i) && bodies.inverseMass[i] != 0.0f;
+		if (m_moving[i]) m_queries.push_back(i);
+
+		if (m_proxyOf[i] == DynamicAabbTree::Null) {
+			m_proxyOf[i] = tree.createProxy(m_box[i], i);
+			m_reinserted++;
+		}
+		else if (m_moving[i]) {
+			if (tree.moveProxy(m_proxyOf[i], m_box[i], p - bodies.oldPos.get(i))) m_reinserted++;
+		}
+		else {
+			//Static and sleeping bodies can still be teleported by the user
+			if (tree.moveProxy(m_proxyOf[i], m_box[i], glm::vec3(0, 0, 0))) m_reinserted++;
+		}
+	}
+
+	//Queries only read the tree, so they run in parallel. A pair of two moving bodies is
+	//reported by the lower id only.
+	const int count = (int)m_queries.size();
+	const int chunks = (count + ChunkSize - 1) / ChunkSize;
+	m_chunkPairs.resize(chunks);
+	ThreadPool::Global().parallelFor(count, ChunkSize, [&](int begin, int end) {
+		std::vector<BodyPair>& out = m_chunkPairs[begin / ChunkSize];
+		out.clear();
+		for (int k = begin; k < end; k++) {
+			const int i = m_queries[k];
+			tree.query(m_box[i], [&](int proxy) {
+				const int j = tree.userData(proxy);
+				if (j == i || (m_moving[j] && j < i)) return;
+				if (!Overlaps(m_box[i], m_box[j])) return;
+				BodyPair pair;
+				pair.a = std::min(i, j);
+				pair.b = std::max(i, j);
+				out.push_back(pair);
+			});
+		}
+	});
+	m_pairs.clear();
+	for (int c = 0; c < chunks; c++) {
+		m_pairs.insert(m_pairs.end(), m_chunkPairs[c].begin(), m_chunkPairs[c].end());
+	}
+}
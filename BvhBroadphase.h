@@ -0,0 +1,31 @@
+#pragma once
+#include "Broadphase.h"
+#include "DynamicAabbTree.h"
+#include <vector>
+
+//Broadphase over a DynamicAabbTree holding one proxy per collidable body.
+//Proxies persist between steps; bodies that stay inside their fat box are not touched.
+//Each awake dynamic body then queries the tree with its real box.
+//
+//The tree is public so the same structure can answer ray casts and other spatial queries;
+//proxy user data is the body id.
+class BvhBroadphase {
+public:
+	void build(const BodyStore& bodies);
+	void reset();
+
+	const std::vector<BodyPair>& pairs() const { return m_pairs; }
+	//Proxies reinserted by the last build
+	int lastReinserted() const { return m_reinserted; }
+
+	DynamicAabbTree tree;
+private:
+	//Proxy of each body, DynamicAabbTree::Null if none
+	std::vector<int> m_proxyOf;
+	std::vector<Aabb> m_box;
+	std::vector<unsigned char> m_moving;
+	std::vector<int> m_queries;
+	std::vector<std::vector<BodyPair>> m_chunkPairs;
+	std::vector<BodyPair> m_pairs;
+	int m_reinserted = 0;
+};
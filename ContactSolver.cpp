@@ -0,0 +1,262 @@
+#include "ContactSolver.h"
+#include "ThreadPool.h"
+#include <algorithm>
+
+uint64_t ContactSolver::PairKey(int a, int b) {
+	return ((uint64_t)(uint32_t)std::min(a, b) << 32) | (uint32_t)std::max(a, b);
+}
+
+void ContactSolver::reset() {
+	m_constraints.clear();
+	m_previous.clear();
+	m_previousIndex.clear();
+}
+
+void ContactSolver::solve(BodyStore& bodies, const std::vector<ContactManifold>& manifolds, const IslandGraph& islands, float dt, bool verlet) {
+	m_constraints.swap(m_previous);
+	m_previousIndex.clear();
+	for (int k = 0; k < (int)m_previous.size(); k++) {
+		m_previousIndex[PairKey(m_previous[k].a, m_previous[k].b)] = k;
+	}
+	prepare(bodies, manifolds);
+	m_deltaV.resize(bodies.capacity());
+	m_deltaW.resize(bodies.capacity());
+	m_pushV.resize(bodies.capacity());
+	m_pushW.resize(bodies.capacity());
+	if (m_constraints.empty()) return;
+
+	//Counting sort by island. Static bodies have no island, but every pair has a dynamic body.
+	const int islandCount = islands.count();
+	m_islandStart.assign(islandCount + 1, 0);
+	std::vector<int> islandOf(m_constraints.size());
+	for (size_t k = 0; k < m_constraints.size(); k++) {
+		const Constraint& c = m_constraints[k];
+		islandOf[k] = islands.islandOf(c.a) >= 0 ? islands.islandOf(c.a) : islands.islandOf(c.b);
+		m_islandStart[islandOf[k] + 1]++;
+	}
+	for (int n = 0; n < islandCount; n++) m_islandStart[n + 1] += m_islandStart[n];
+	m_order.resize(m_constraints.size());
+	std::vector<int> cursor(m_islandStart.begin(), m_islandStart.end() - 1);
+	for (size_t k = 0; k < m_constraints.size(); k++) {
+		m_order[cursor[islandOf[k]]++] = (int)k;
+	}
+
+	const std::vector<int>& bodyStart = islands.bodyStart();
+	const std::vector<int>& islandBodies = islands.bodies();
+	ThreadPool::Global().parallelFor(islandCount, 16, [&](int begin, int end) {
+		for (int n = begin; n < end; n++) {
+			const int first = m_islandStart[n];
+			const int last = m_islandStart[n + 1];
+			if (first == last) continue;
+
+			if (warmStarting) {
+				for (int k = first; k < last; k++) {
+					const Constraint& c = m_constraints[m_order[k]];
+					for (int p = 0; p < c.pointCount; p++) {
+						const Point& point = c.points[p];
+						applyImpulse(c, point, c.normal * point.normalImpulse +
+							c.tangent[0] * point.tangentImpulse[0] + c.tangent[1] * point.tangentImpulse[1]);
+					}
+				}
+			}
+			for (int it = 0; it < iterations; it++) {
+				for (int k = first; k < last; k++) solveConstraint(bodies, m_constraints[m_order[k]], dt);
+			}
+
+			//Move each body by what its velocity change would have covered over the step,
+			//plus the push out of penetration
+			for (int k = bodyStart[n]; k < bodyStart[n + 1]; k++) {
+				const int i = islandBodies[k];
+				const glm::vec3 turn = m_deltaW.get(i) + m_pushW.get(i);
+				if (turn != glm::vec3(0, 0, 0)) {
+					glm::quat q = bodies.orientation.get(i);
+					q = glm::normalize(q + (glm::quat(0.0f, turn.x, turn.y, turn.z) * q) * (0.5f * dt));
+					bodies.orientation.set(i, q);
+				}
+				bodies.angularVelocity.add(i, m_deltaW.get(i));
+				m_deltaW.set(i, glm::vec3(0, 0, 0));
+				m_pushW.set(i, glm::vec3(0, 0, 0));
+				bodies.currPos.x[i] += (m_deltaV.x[i] + m_pushV.x[i]) * dt;
+				bodies.currPos.y[i] += (m_deltaV.y[i] + m_pushV.y[i]) * dt;
+				bodies.currPos.z[i] += (m_deltaV.z[i] + m_pushV.z[i]) * dt;
+				if (verlet) {
+					bodies.oldPos.x[i] += m_pushV.x[i] * dt;
+					bodies.oldPos.y[i] += m_pushV.y[i] * dt;
+					bodies.oldPos.z[i] += m_pushV.z[i] * dt;
+				}
+				bodies.velocity.x[i] += m_deltaV.x[i];
+				bodies.velocity.y[i] += m_deltaV.y[i];
+				bodies.velocity.z[i] += m_deltaV.z[i];
+				m_deltaV.set(i, glm::vec3(0, 0, 0));
+				m_pushV.set(i, glm::vec3(0, 0, 0));
+			}
+		}
+	});
+}
+
+void ContactSolver::prepare(const BodyStore& bodies, const std::vector<ContactManifold>& manifolds) {
+	m_constraints.clear();
+	for (size_t m = 0; m < manifolds.size(); m++) {
+		const ContactManifold& manifold = manifolds[m];
+		Constraint c;
+		c.a = manifold.a;
+		c.b = manifold.b;
+		//Sleeping bodies are not integrated this step, so they act as static
+		c.invMassA = bodies.isActive(c.a) ? bodies.inverseMass[c.a] : 0.0f;
+		c.invMassB = bodies.isActive(c.b) ? bodies.inverseMass[c.b] : 0.0f;
+		if (c.invMassA + c.invMassB == 0.0f) continue;
+		c.invInertiaA = c.invMassA != 0.0f ? bodies.inverseInertiaWorld.get(c.a) : glm::mat3(0.0f);
+		c.invInertiaB = c.invMassB != 0.0f ? bodies.inverseInertiaWorld.get(c.b) : glm::mat3(0.0f);
+		const glm::vec3 centerA = bodies.currPos.get(c.a);
+		const glm::vec3 centerB = bodies.currPos.get(c.b);
+
+		//Fixed basis from the normal, so an unchanged normal gives unchanged tangents
+		const glm::vec3 n = manifold.normal;
+		c.normal = n;
+		if (std::abs(n.x) >= 0.57735f) c.tangent[0] = glm::normalize(glm::vec3(n.y, -n.x, 0.0f));
+		else c.tangent[0] = glm::normalize(glm::vec3(0.0f, n.z, -n.y));
+		c.tangent[1] = glm::cross(n, c.tangent[0]);
+
+		c.pointCount = manifold.pointCount;
+		for (int p = 0; p < c.pointCount; p++) {
+			Point& point = c.points[p];
+			point.feature = manifold.points[p].feature;
+			point.depth = manifold.points[p].depth;
+			point.rA = manifold.points[p].position - centerA;
+			point.rB = manifold.points[p].position - centerB;
+			point.normalMass = EffectiveMass(c, point, c.normal);
+			point.tangentMass[0] = EffectiveMass(c, point, c.tangent[0]);
+			point.tangentMass[1] = EffectiveMass(c, point, c.tangent[1]);
+			point.normalImpulse = 0.0f;
+			point.pushImpulse = 0.0f;
+			point.tangentImpulse[0] = 0.0f;
+			point.tangentImpulse[1] = 0.0f;
+		}
+
+		if (warmStarting) {
+			std::unordered_map<uint64_t, int>::const_iterator it = m_previousIndex.find(PairKey(c.a, c.b));
+			if (it != m_previousIndex.end()) warmStart(m_previous[it->second], c);
+		}
+		m_constraints.push_back(c);
+	}
+}
+
+//Carries over the impulses of points with the same feature id. Where box edges line up the
+//clipper can describe the same point by a different feature from one step to the next, so
+//a point without a feature match takes the nearest unclaimed old point within
+//matchDistance instead. Friction is re-projected onto the new tangents, since they turn
+//with the normal.
+void ContactSolver::warmStart(const Constraint& previous, Constraint& c) const {
+	bool claimed[4] = {};
+	int match[4];
+	for (int p = 0; p < c.pointCount; p++) {
+		match[p] = -1;
+		for (int q = 0; q < previous.pointCount; q++) {
+			if (!claimed[q] && previous.points[q].feature == c.points[p].feature) {
+				match[p] = q;
+				claimed[q] = true;
+				break;
+			}
+		}
+	}
+	for (int p = 0; p < c.pointCount; p++) {
+		if (match[p] >= 0) continue;
+		float best = matchDistance * matchDistance;
+		for (int q = 0; q < previous.pointCount; q++) {
+			if (claimed[q]) continue;
+			const glm::vec3 d = previous.points[q].rA - c.points[p].rA;
+			const float distance2 = glm::dot(d, d);
+			if (distance2 < best) {
+				best = distance2;
+				match[p] = q;
+			}
+		}
+		if (match[p] >= 0) claimed[match[p]] = true;
+	}
+
+	for (int p = 0; p < c.pointCount; p++) {
+		if (match[p] < 0) continue;
+		Point& point = c.points[p];
+		const Point& old = previous.points[match[p]];
+		glm::vec3 tangentImpulse = previous.tangent[0] * old.tangentImpulse[0] + previous.tangent[1] * old.tangentImpulse[1];
+		point.normalImpulse = old.normalImpulse;
+		point.tangentImpulse[0] = glm::dot(tangentImpulse, c.tangent[0]);
+		point.tangentImpulse[1] = glm::dot(tangentImpulse, c.tangent[1]);
+	}
+}
+
+//1 / (invMassA + invMassB + (rA x d) . invInertiaA (rA x d) + (rB x d) . invInertiaB (rB x d))
+float ContactSolver::EffectiveMass(const Constraint& c, const Point& point, glm::vec3 direction) {
+	const glm::vec3 armA = glm::cross(point.rA, direction);
+	const glm::vec3 armB = glm::cross(point.rB, direction);
+	const float k = c.invMassA + c.invMassB + glm::dot(armA, c.invInertiaA * armA) + glm::dot(armB, c.invInertiaB * armB);
+	return 1.0f / k;
+}
+
+//Impulse acts on b at the point, and its opposite on a
+void ContactSolver::applyImpulse(const Constraint& c, const Point& point, glm::vec3 impulse) {
+	if (c.invMassA != 0.0f) {
+		m_deltaV.set(c.a, m_deltaV.get(c.a) - impulse * c.invMassA);
+		m_deltaW.set(c.a, m_deltaW.get(c.a) - c.invInertiaA * glm::cross(point.rA, impulse));
+	}
+	if (c.invMassB != 0.0f) {
+		m_deltaV.set(c.b, m_deltaV.get(c.b) + impulse * c.invMassB);
+		m_deltaW.set(c.b, m_deltaW.get(c.b) + c.invInertiaB * glm::cross(point.rB, impulse));
+	}
+}
+
+void ContactSolver::applyPush(const Constraint& c, const Point& point, glm::vec3 impulse) {
+	if (c.invMassA != 0.0f) {
+		m_pushV.set(c.a, m_pushV.get(c.a) - impulse * c.invMassA);
+		m_pushW.set(c.a, m_pushW.get(c.a) - c.invInertiaA * glm::cross(point.rA, impulse));
+	}
+	if (c.invMassB != 0.0f) {
+		m_pushV.set(c.b, m_pushV.get(c.b) + impulse * c.invMassB);
+		m_pushW.set(c.b, m_pushW.get(c.b) + c.invInertiaB * glm::cross(point.rB, impulse));
+	}
+}
+
+//Velocity of b relative to a at the point, including what the solver has added so far
+glm::vec3 ContactSolver::relativeVelocity(const BodyStore& bodies, const Constraint& c, const Point& point) const {
+	const glm::vec3 velocityA = bodies.velocity.get(c.a) + m_deltaV.get(c.a) +
+		glm::cross(bodies.angularVelocity.get(c.a) + m_deltaW.get(c.a), point.rA);
+	const glm::vec3 velocityB = bodies.velocity.get(c.b) + m_deltaV.get(c.b) +
+		glm::cross(bodies.angularVelocity.get(c.b) + m_deltaW.get(c.b), point.rB);
+	return velocityB - velocityA;
+}
+
+void ContactSolver::solveConstraint(const BodyStore& bodies, Constraint& c, float dt) {
+	for (int p = 0; p < c.pointCount; p++) {
+		Point& point = c.points[p];
+
+		//Friction first, bounded by the normal impulse of the last pass
+		const float limit = friction * point.normalImpulse;
+		for (int t = 0; t < 2; t++) {
+			float vt = glm::dot(relativeVelocity(bodies, c, point), c.tangent[t]);
+			float accumulated = std::max(-limit, std::min(point.tangentImpulse[t] - vt * point.tangentMass[t], limit));
+			float lambda = accumulated - point.tangentImpulse[t];
+			point.tangentImpulse[t] = accumulated;
+			applyImpulse(c, point, c.tangent[t] * lambda);
+		}
+
+		//Separated points may close the gap this step, touching ones may not approach
+		float target = std::min(point.depth, 0.0f) / dt;
+		float vn = glm::dot(relativeVelocity(bodies, c, point), c.normal);
+		float accumulated = std::max(point.normalImpulse + (target - vn) * point.normalMass, 0.0f);
+		float lambda = accumulated - point.normalImpulse;
+		point.normalImpulse = accumulated;
+		applyImpulse(c, point, c.normal * lambda);
+
+		//Overlap beyond the slop is pushed apart by a separate velocity that only moves the
+		//bodies. Feeding it into the real velocity would bounce resting stacks, and warm
+		//starting would carry it into the next step.
+		float push = baumgarte * std::max(point.depth - slop, 0.0f) / dt;
+		const glm::vec3 pushA = m_pushV.get(c.a) + glm::cross(m_pushW.get(c.a), point.rA);
+		const glm::vec3 pushB = m_pushV.get(c.b) + glm::cross(m_pushW.get(c.b), point.rB);
+		float pushed = glm::dot(pushB - pushA, c.normal);
+		accumulated = std::max(point.pushImpulse + (push - pushed) * point.normalMass, 0.0f);
+		lambda = accumulated - point.pushImpulse;
+		point.pushImpulse = accumulated;
+		applyPush(c, point, c.normal * lambda);
+	}
+}
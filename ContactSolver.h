@@ -0,0 +1,92 @@
+#pragma once
+#include "BoxNarrowphase.h"
+#include "IslandGraph.h"
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+//Sequential impulse contact solver (projected Gauss-Seidel) for the narrowphase manifolds.
+//
+//Runs after the integrator: every contact point gets a normal impulse and two friction
+//impulses, acting at the point so they change both linear and angular velocity. The
+//accumulated impulse per point is clamped, not the per-iteration delta, so the normal
+//impulse stays >= 0 and friction stays inside the friction box |tangent| <= friction *
+//normal. Positions then take the velocity change times dt. Penetration is removed by a
+//separate push impulse that moves bodies without changing their velocity (split impulse).
+//
+//Accumulated impulses are cached per body pair and matched by feature id next step, or
+//failing that by position. With warm starting a resting stack starts each step already
+//close to its solution, so a few iterations are enough where a cold start needs many.
+//
+//Islands are solved as independent tasks; contacts within an island run in manifold order,
+//so results do not depend on the thread count.
+class ContactSolver {
+public:
+	//verlet: the integrator reads velocity back from oldPos, so oldPos moves with the push
+	//to keep it from turning into velocity
+	void solve(BodyStore& bodies, const std::vector<ContactManifold>& manifolds, const IslandGraph& islands, float dt, bool verlet);
+	//Drops the impulse cache; the next step starts cold
+	void reset();
+
+	int iterations = 8;
+	bool warmStarting = true;
+	float friction = 0.5f;
+	//Fraction of the penetration removed per step, and the penetration left alone
+	float baumgarte = 0.2f;
+	float slop = 0.005f;
+	//Points whose feature changed still inherit impulses from an old point this close
+	float matchDistance = 0.05f;
+private:
+	struct Point {
+		int feature;
+		float depth;
+		//Point relative to the centres of a and b
+		glm::vec3 rA;
+		glm::vec3 rB;
+		//Inverse effective mass along the normal and the tangents
+		float normalMass;
+		float tangentMass[2];
+		float normalImpulse;
+		float tangentImpulse[2];
+		//Accumulated impulse of the penetration push, never warm started
+		float pushImpulse;
+	};
+
+	struct Constraint {
+		int a;
+		int b;
+		glm::vec3 normal;
+		glm::vec3 tangent[2];
+		float invMassA;
+		float invMassB;
+		glm::mat3 invInertiaA;
+		glm::mat3 invInertiaB;
+		int pointCount;
+		Point points[4];
+	};
+
+	static uint64_t PairKey(int a, int b);
+	void prepare(const BodyStore& bodies, const std::vector<ContactManifold>& manifolds);
+	void warmStart(const Constraint& previous, Constraint& c) const;
+	static float EffectiveMass(const Constraint& c, const Point& point, glm::vec3 direction);
+	void applyImpulse(const Constraint& c, const Point& point, glm::vec3 impulse);
+	void applyPush(const Constraint& c, const Point& point, glm::vec3 impulse);
+	glm::vec3 relativeVelocity(const BodyStore& bodies, const Constraint& c, const Point& point) const;
+	void solveConstraint(const BodyStore& bodies, Constraint& c, float dt);
+
+	std::vector<Constraint> m_constraints;
+	//Last step's constraints and their index by PairKey
+	std::vector<Constraint> m_previous;
+	std::unordered_map<uint64_t, int> m_previousIndex;
+
+	//Constraints grouped by island
+	std::vector<int> m_islandStart;
+	std::vector<int> m_order;
+
+	//Velocity change of each body during the solve, and the velocity that only moves it
+	//out of penetration
+	Vec3Stream m_deltaV;
+	Vec3Stream m_deltaW;
+	Vec3Stream m_pushV;
+	Vec3Stream m_pushW;
+};
@@ -0,0 +1,212 @@
+#include "ContinuousCollision.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+//Advancement steps per pair before settling for the last safe time
+static const int MaxAdvances = 32;
+
+void ContinuousCollision::clear(BodyStore& bodies) {
+	for (size_t f = 0; f < m_fast.size(); f++) {
+		const int i = m_fast[f];
+		if (i < bodies.capacity()) bodies.sweep.set(i, glm::vec3(0, 0, 0));
+		if (i < (int)m_fastIndex.size()) m_fastIndex[i] = -1;
+	}
+	m_fast.clear();
+}
+
+void ContinuousCollision::predict(BodyStore& bodies, float dt) {
+	clear(bodies);
+	m_fastIndex.resize(bodies.capacity(), -1);
+
+	const float* vx = bodies.velocity.x.data();
+	const float* vy = bodies.velocity.y.data();
+	const float* vz = bodies.velocity.z.data();
+	const float* hx = bodies.halfExtent.x.data();
+	const float* hy = bodies.halfExtent.y.data();
+	const float* hz = bodies.halfExtent.z.data();
+	const float* invMass = bodies.inverseMass.data();
+	bodies.forEachActive([&](int i) {
+		if (invMass[i] == 0.0f || (hx[i] <= 0.0f && hy[i] <= 0.0f && hz[i] <= 0.0f)) return;
+		const glm::vec3 d = glm::vec3(vx[i], vy[i], vz[i]) * dt;
+		const float limit = motionThreshold * std::min(hx[i], std::min(hy[i], hz[i]));
+		if (glm::dot(d, d) <= limit * limit) return;
+		bodies.sweep.set(i, d);
+		m_fastIndex[i] = (int)m_fast.size();
+		m_fast.push_back(i);
+	});
+}
+
+float ContinuousCollision::Separation(const BodyStore& bodies, int a, glm::vec3 ca, glm::quat qa, int b, glm::vec3 cb, glm::quat qb, glm::vec3& axis) {
+	const glm::mat3 ra = glm::mat3_cast(qa);
+	const glm::mat3 rb = glm::mat3_cast(qb);
+	const glm::vec3 ha = bodies.halfExtent.get(a);
+	const glm::vec3 hb = bodies.halfExtent.get(b);
+	const glm::vec3 offset = cb - ca;
+
+	glm::vec3 axes[15];
+	for (int k = 0; k < 3; k++) {
+		axes[k] = ra[k];
+		axes[3 + k] = rb[k];
+		for (int j = 0; j < 3; j++) axes[6 + 3 * k + j] = glm::cross(ra[k], rb[j]);
+	}
+
+	float best = -FLT_MAX;
+	for (int k = 0; k < 15; k++) {
+		glm::vec3 l = axes[k];
+		//Parallel edges give no axis; the face axes cover that case
+		const float lengthSq = glm::dot(l, l);
+		if (lengthSq < 1e-6f) continue;
+		l *= 1.0f / std::sqrt(lengthSq);
+
+		const float reach =
+			ha.x * std::fabs(glm::dot(l, ra[0])) + ha.y * std::fabs(glm::dot(l, ra[1])) + ha.z * std::fabs(glm::dot(l, ra[2])) +
+			hb.x * std::fabs(glm::dot(l, rb[0])) + hb.y * std::fabs(glm::dot(l, rb[1])) + hb.z * std::fabs(glm::dot(l, rb[2]));
+		const float along = glm::dot(l, offset);
+		const float separation = std::fabs(along) - reach;
+		if (separation > best) {
+			best = separation;
+			axis = along >= 0.0f ? l : -l;
+		}
+	}
+	return best;
+}
+
+//Rotation angle between two orientations
+static float TurnAngle(glm::quat from, glm::quat to) {
+	const float c = std::min(1.0f, std::fabs(glm::dot(from, to)));
+	return 2.0f * std::acos(c);
+}
+
+bool ContinuousCollision::timeOfImpact(const BodyStore& bodies, int a, const Motion& ma, int b, const Motion& mb, Impact& out) const {
+	const glm::vec3 motion = (mb.to - mb.from) - (ma.to - ma.from);
+	const float turning =
+		TurnAngle(ma.turnFrom, ma.turnTo) * glm::length(bodies.halfExtent.get(a)) +
+		TurnAngle(mb.turnFrom, mb.turnTo) * glm::length(bodies.halfExtent.get(b));
+
+	float t = 0.0f;
+	for (int k = 0; k < MaxAdvances; k++) {
+		glm::vec3 axis;
+		const float gap = Separation(bodies,
+			a, glm::mix(ma.from, ma.to, t), glm::slerp(ma.turnFrom, ma.turnTo, t),
+			b, glm::mix(mb.from, mb.to, t), glm::slerp(mb.turnFrom, mb.turnTo, t), axis);
+		if (gap <= 2.0f * backoff) {
+			if (t == 0.0f) return false;
+			out.time = t;
+			out.normal = axis;
+			return true;
+		}
+		//Fastest the gap along axis can close per unit of t
+		const float closing = std::max(0.0f, -glm::dot(motion, axis)) + turning;
+		if (closing <= 1e-9f) return false;
+		t += (gap - backoff) / closing;
+		if (t >= 1.0f) return false;
+		out.normal = axis;
+	}
+	//Still short of contact, but every advance so far was safe
+	out.time = t;
+	return true;
+}
+
+void ContinuousCollision::solve(BodyStore& bodies, const std::vector<BodyPair>& pairs, float dt, bool verlet) {
+	m_impacts = 0;
+	m_changed.clear();
+	const int fast = (int)m_fast.size();
+	if (fast == 0) return;
+
+	//Broadphase pairs of each fast body, in pair order
+	m_pairStart.assign(fast + 1, 0);
+	for (size_t p = 0; p < pairs.size(); p++) {
+		if (m_fastIndex[pairs[p].a] >= 0) m_pairStart[m_fastIndex[pairs[p].a] + 1]++;
+		if (m_fastIndex[pairs[p].b] >= 0) m_pairStart[m_fastIndex[pairs[p].b] + 1]++;
+	}
+	for (int f = 0; f < fast; f++) m_pairStart[f + 1] += m_pairStart[f];
+	m_pairOther.resize(m_pairStart[fast]);
+	std::vector<int> cursor(m_pairStart.begin(), m_pairStart.end() - 1);
+	for (size_t p = 0; p < pairs.size(); p++) {
+		if (m_fastIndex[pairs[p].a] >= 0) m_pairOther[cursor[m_fastIndex[pairs[p].a]]++] = pairs[p].b;
+		if (m_fastIndex[pairs[p].b] >= 0) m_pairOther[cursor[m_fastIndex[pairs[p].b]]++] = pairs[p].a;
+	}
+
+	for (int f = 0; f < fast; f++) {
+		const int i = m_fast[f];
+		if (m_pairStart[f] == m_pairStart[f + 1]) continue;
+		const float invMassA = bodies.inverseMass[i];
+		const glm::quat startTurn = bodies.oldOrientation.get(i);
+		const glm::quat endTurn = bodies.orientation.get(i);
+
+		//The body covers self over the fraction of the step from elapsed to 1
+		Motion self;
+		self.from = bodies.oldPos.get(i);
+		self.to = bodies.currPos.get(i);
+		self.turnFrom = startTurn;
+		self.turnTo = endTurn;
+		glm::vec3 velocity = bodies.velocity.get(i);
+		float elapsed = 0.0f;
+		bool hit = false;
+		for (int sub = 0; sub < maxSubsteps; sub++) {
+			Impact first;
+			first.time = FLT_MAX;
+			int other = -1;
+			for (int k = m_pairStart[f]; k < m_pairStart[f + 1]; k++) {
+				const int j = m_pairOther[k];
+				//Others follow their own step unchanged; sleeping and static bodies stay put
+				Motion motion;
+				motion.to = bodies.currPos.get(j);
+				motion.turnTo = bodies.orientation.get(j);
+				motion.from = motion.to;
+				motion.turnFrom = motion.turnTo;
+				if (bodies.isActive(j)) {
+					motion.from = glm::mix(bodies.oldPos.get(j), motion.to, elapsed);
+					motion.turnFrom = glm::slerp(bodies.oldOrientation.get(j), motion.turnTo, elapsed);
+				}
+				Impact impact;
+				if (timeOfImpact(bodies, i, self, j, motion, impact) && impact.time < first.time) {
+					first = impact;
+					other = j;
+				}
+			}
+			if (other < 0) break;
+
+			hit = true;
+			m_impacts++;
+			const glm::vec3 n = first.normal;
+			elapsed += first.time * (1.0f - elapsed);
+			self.from = glm::mix(self.from, self.to, first.time);
+			self.turnFrom = glm::slerp(startTurn, endTurn, elapsed);
+
+			//Perfectly inelastic along the normal, like the contact solver
+			const float invMassB = bodies.isActive(other) ? bodies.inverseMass[other] : 0.0f;
+			const glm::vec3 otherVelocity = invMassB > 0.0f ? bodies.velocity.get(other) : glm::vec3(0, 0, 0);
+			const float approach = glm::dot(otherVelocity - velocity, n);
+			if (approach < 0.0f) {
+				const float impulse = -approach / (invMassA + invMassB);
+				velocity -= n * (impulse * invMassA);
+				if (invMassB > 0.0f) {
+					bodies.velocity.add(other, n * (impulse * invMassB));
+					m_changed.push_back(other);
+				}
+			}
+
+			//A struck dynamic body only takes the new velocity; it is swept next step. The
+			//fast body waits at the impact so it does not run into it meanwhile. Out of
+			//substeps, it also stops rather than risk the rest of the motion.
+			self.to = self.from;
+			self.turnTo = self.turnFrom;
+			if (invMassB > 0.0f || sub + 1 == maxSubsteps) break;
+			self.to = self.from + velocity * ((1.0f - elapsed) * dt);
+			self.turnTo = endTurn;
+		}
+		if (!hit) continue;
+		bodies.currPos.set(i, self.to);
+		bodies.orientation.set(i, self.turnTo);
+		bodies.velocity.set(i, velocity);
+		m_changed.push_back(i);
+	}
+
+	if (!verlet) return;
+	for (size_t k = 0; k < m_changed.size(); k++) {
+		const int i = m_changed[k];
+		bodies.oldPos.set(i, bodies.currPos.get(i) - bodies.velocity.get(i) * dt);
+	}
+}
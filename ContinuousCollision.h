@@ -0,0 +1,72 @@
+#pragma once
+#include "Broadphase.h"
+#include <vector>
+
+//Continuous collision for bodies that move too far in one step for the discrete contacts
+//to catch, so a large step does not let them tunnel through thin boxes.
+//
+//Only the few fast movers pay for it:
+//	- predict() marks every awake dynamic box whose velocity would carry it more than
+//	  motionThreshold of its smallest half extent in the coming step, and sets its
+//	  BodyStore::sweep so the broadphase pairs it with everything along the way
+//	- solve() runs after the contact solver. For each fast body, in id order, it finds the
+//	  earliest time of impact against its broadphase pairs, moves the body back to it and
+//	  removes the approaching normal velocity of both bodies. Against a static or sleeping
+//	  body it spends the rest of the step sliding with the new velocity, checked again
+//	  against the same pairs up to maxSubsteps times. Against a dynamic body, or out of
+//	  substeps, it stops at the impact and the next step carries on.
+//
+//The time of impact comes from conservative advancement. Over the step both boxes move in
+//a straight line and turn from their start to their end orientation. The separating axis
+//test gives a distance the boxes are at least apart; along its axis they cannot close
+//faster than their relative motion plus each turning angle times the box radius, so the
+//pair is advanced by that distance over that speed until the gap is down to backoff.
+//Pairs already touching at the start are left to the contact solver.
+class ContinuousCollision {
+public:
+	void predict(BodyStore& bodies, float dt);
+	//verlet: the integrator reads velocity back from oldPos, which is then rewritten for
+	//every body whose velocity changed
+	void solve(BodyStore& bodies, const std::vector<BodyPair>& pairs, float dt, bool verlet);
+	//Clears the sweep of the bodies marked by the last predict()
+	void clear(BodyStore& bodies);
+
+	//A body is fast when its step would carry it this fraction of its smallest half extent
+	float motionThreshold = 0.5f;
+	int maxSubsteps = 4;
+	//Gap left between a body and what it hit, well inside the narrowphase margin
+	float backoff = 0.005f;
+
+	//Bodies marked fast and impacts resolved by the last step
+	int fastCount() const { return (int)m_fast.size(); }
+	int lastImpacts() const { return m_impacts; }
+private:
+	//Straight-line motion and turn of one box over the part of the step being checked
+	struct Motion {
+		glm::vec3 from;
+		glm::vec3 to;
+		glm::quat turnFrom;
+		glm::quat turnTo;
+	};
+	struct Impact {
+		//Fraction of the motion at which the boxes first touch
+		float time;
+		//Separating axis at that time, from a to b
+		glm::vec3 normal;
+	};
+	//Largest separation of boxes a and b over the 15 candidate axes, which is never more
+	//than their distance. Negative if they overlap.
+	static float Separation(const BodyStore& bodies, int a, glm::vec3 ca, glm::quat qa, int b, glm::vec3 cb, glm::quat qb, glm::vec3& axis);
+	//Earliest touch within the motions. False if they miss, or already touch at the start.
+	bool timeOfImpact(const BodyStore& bodies, int a, const Motion& ma, int b, const Motion& mb, Impact& out) const;
+
+	std::vector<int> m_fast;
+	//Position of each body in m_fast, -1 if it is not fast
+	std::vector<int> m_fastIndex;
+	//Pairs of each fast body in m_fast order: m_pairOther[m_pairStart[f] .. m_pairStart[f + 1])
+	std::vector<int> m_pairStart;
+	std::vector<int> m_pairOther;
+	//Bodies whose velocity changed, for the oldPos rewrite
+	std::vector<int> m_changed;
+	int m_impacts = 0;
+};
@@ -0,0 +1,257 @@
+#include "DynamicAabbTree.h"
+
+int DynamicAabbTree::allocateNode() {
+	int index;
+	if (m_freeList != Null) {
+		index = m_freeList;
+		m_freeList = m_nodes[index].parent;
+	}
+	else {
+		index = (int)m_nodes.size();
+		m_nodes.push_back(Node());
+	}
+	Node& node = m_nodes[index];
+	node.parent = Null;
+	node.child1 = Null;
+	node.child2 = Null;
+	node.height = 0;
+	node.userData = -1;
+	return index;
+}
+
+void DynamicAabbTree::freeNode(int node) {
+	m_nodes[node].parent = m_freeList;
+	m_nodes[node].height = -1;
+	m_freeList = node;
+}
+
+void DynamicAabbTree::clear() {
+	m_nodes.clear();
+	m_root = Null;
+	m_freeList = Null;
+	m_proxyCount = 0;
+}
+
+//Fat box: the real box plus the margin, stretched along the predicted motion
+static Aabb Fatten(const Aabb& box, glm::vec3 displacement, float margin) {
+	Aabb fat;
+	fat.lo = box.lo - glm::vec3(margin, margin, margin);
+	fat.hi = box.hi + glm::vec3(margin, margin, margin);
+	for (int axis = 0; axis < 3; axis++) {
+		if (displacement[axis] < 0.0f) fat.lo[axis] += displacement[axis];
+		else fat.hi[axis] += displacement[axis];
+	}
+	return fat;
+}
+
+int DynamicAabbTree::createProxy(const Aabb& box, int userData) {
+	const int proxy = allocateNode();
+	m_nodes[proxy].box = Fatten(box, glm::vec3(0, 0, 0), margin);
+	m_nodes[proxy].userData = userData;
+	insertLeaf(proxy);
+	m_proxyCount++;
+	return proxy;
+}
+
+void DynamicAabbTree::destroyProxy(int proxy) {
+	removeLeaf(proxy);
+	freeNode(proxy);
+	m_proxyCount--;
+}
+
+bool DynamicAabbTree::moveProxy(int proxy, const Aabb& box, glm::vec3 displacement) {
+	const Aabb fat = Fatten(box, displacement * displacementScale, margin);
+	const Aabb& current = m_nodes[proxy].box;
+	if (Contains(current, box)) {
+		//Still inside, unless an earlier fast move left the fat box much too large
+		const float slack = 4.0f * margin;
+		Aabb limit;
+		limit.lo = fat.lo - glm::vec3(slack, slack, slack);
+		limit.hi = fat.hi + glm::vec3(slack, slack, slack);
+		if (Contains(limit, current)) return false;
+	}
+
+	removeLeaf(proxy);
+	m_nodes[proxy].box = fat;
+	insertLeaf(proxy);
+	return true;
+}
+
+void DynamicAabbTree::refit(int index) {
+	Node& node = m_nodes[index];
+	const Node& child1 = m_nodes[node.child1];
+	const Node& child2 = m_nodes[node.child2];
+	node.box = Union(child1.box, child2.box);
+	node.height = 1 + std::max(child1.height, child2.height);
+}
+
+//Descends towards the sibling that adds the least surface area. At each node the cost of
+//pairing the leaf with that whole subtree is compared against the cheaper child, counting
+//the area every ancestor grows by (the inherited cost).
+void DynamicAabbTree::insertLeaf(int leaf) {
+	if (m_root == Null) {
+		m_root = leaf;
+		m_nodes[leaf].parent = Null;
+		return;
+	}
+
+	const Aabb leafBox = m_nodes[leaf].box;
+	int index = m_root;
+	while (!m_nodes[index].isLeaf()) {
+		const Node& node = m_nodes[index];
+		const float area = SurfaceArea(node.box);
+		const float combinedArea = SurfaceArea(Union(node.box, leafBox));
+
+		const float cost = 2.0f * combinedArea;
+		const float inherited = 2.0f * (combinedArea - area);
+
+		const Node& child1 = m_nodes[node.child1];
+		float cost1 = SurfaceArea(Union(leafBox, child1.box)) + inherited;
+		if (!child1.isLeaf()) cost1 -= SurfaceArea(child1.box);
+
+		const Node& child2 = m_nodes[node.child2];
+		float cost2 = SurfaceArea(Union(leafBox, child2.box)) + inherited;
+		if (!child2.isLeaf()) cost2 -= SurfaceArea(child2.box);
+
+		if (cost < cost1 && cost < cost2) break;
+		index = cost1 < cost2 ? node.child1 : node.child2;
+	}
+
+	const int sibling = index;
+	const int oldParent = m_nodes[sibling].parent;
+	const int newParent = allocateNode();
+	Node& parent = m_nodes[newParent];
+	parent.parent = oldParent;
+	parent.box = Union(leafBox, m_nodes[sibling].box);
+	parent.height = m_nodes[sibling].height + 1;
+	parent.child1 = sibling;
+	parent.child2 = leaf;
+	m_nodes[sibling].parent = newParent;
+	m_nodes[leaf].parent = newParent;
+
+	if (oldParent == Null) {
+		m_root = newParent;
+	}
+	else if (m_nodes[oldParent].child1 == sibling) {
+		m_nodes[oldParent].child1 = newParent;
+	}
+	else {
+		m_nodes[oldParent].child2 = newParent;
+	}
+
+	for (index = m_nodes[leaf].parent; index != Null; index = m_nodes[index].parent) {
+		index = balance(index);
+		refit(index);
+	}
+}
+
+void DynamicAabbTree::removeLeaf(int leaf) {
+	if (leaf == m_root) {
+		m_root = Null;
+		return;
+	}
+
+	const int parent = m_nodes[leaf].parent;
+	const int grandParent = m_nodes[parent].parent;
+	const int sibling = m_nodes[parent].child1 == leaf ? m_nodes[parent].child2 : m_nodes[parent].child1;
+	freeNode(parent);
+
+	if (grandParent == Null) {
+		m_root = sibling;
+		m_nodes[sibling].parent = Null;
+		return;
+	}
+
+	if (m_nodes[grandParent].child1 == parent) m_nodes[grandParent].child1 = sibling;
+	else m_nodes[grandParent].child2 = sibling;
+	m_nodes[sibling].parent = grandParent;
+
+	for (int index = grandParent; index != Null; index = m_nodes[index].parent) {
+		index = balance(index);
+		refit(index);
+	}
+}
+
+//If one child of a is more than one level taller than the other, the taller child is
+//rotated up into a's place and a takes the shorter of its grandchildren. Returns the
+//index now at a's position.
+int DynamicAabbTree::balance(int iA) {
+	Node& a = m_nodes[iA];
+	if (a.isLeaf() || a.height < 2) return iA;
+
+	const int iB = a.child1;
+	const int iC = a.child2;
+	Node& b = m_nodes[iB];
+	Node& c = m_nodes[iC];
+	const int difference = c.height - b.height;
+
+	if (difference > 1) {
+		const int iF = c.child1;
+		const int iG = c.child2;
+		Node& f = m_nodes[iF];
+		Node& g = m_nodes[iG];
+
+		c.child1 = iA;
+		c.parent = a.parent;
+		a.parent = iC;
+		if (c.parent == Null) m_root = iC;
+		else if (m_nodes[c.parent].child1 == iA) m_nodes[c.parent].child1 = iC;
+		else m_nodes[c.parent].child2 = iC;
+
+		if (f.height > g.height) {
+			c.child2 = iF;
+			a.child2 = iG;
+			g.parent = iA;
+			a.box = Union(b.box, g.box);
+			c.box = Union(a.box, f.box);
+			a.height = 1 + std::max(b.height, g.height);
+			c.height = 1 + std::max(a.height, f.height);
+		}
+		else {
+			c.child2 = iG;
+			a.child2 = iF;
+			f.parent = iA;
+			a.box = Union(b.box, f.box);
+			c.box = Union(a.box, g.box);
+			a.height = 1 + std::max(b.height, f.height);
+			c.height = 1 + std::max(a.height, g.height);
+		}
+		return iC;
+	}
+
+	if (difference < -1) {
+		const int iD = b.child1;
+		const int iE = b.child2;
+		Node& d = m_nodes[iD];
+		Node& e = m_nodes[iE];
+
+		b.child1 = iA;
+		b.parent = a.parent;
+		a.parent = iB;
+		if (b.parent == Null) m_root = iB;
+		else if (m_nodes[b.parent].child1 == iA) m_nodes[b.parent].child1 = iB;
+		else m_nodes[b.parent].child2 = iB;
+
+		if (d.height > e.height) {
+			b.child2 = iD;
+			a.child1 = iE;
+			e.parent = iA;
+			a.box = Union(c.box, e.box);
+			b.box = Union(a.box, d.box);
+			a.height = 1 + std::max(c.height, e.height);
+			b.height = 1 + std::max(a.height, d.height);
+		}
+		else {
+			b.child2 = iE;
+			a.child1 = iD;
+			d.parent = iA;
+			a.box = Union(c.box, d.box);
+			b.box = Union(a.box, e.box);
+			a.height = 1 + std::max(c.height, d.height);
+			b.height = 1 + std::max(a.height, e.height);
+		}
+		return iB;
+	}
+
+	return iA;
+}
@@ -0,0 +1,185 @@
+#pragma once
+#include "Aabb.h"
+#include <vector>
+
+//Traversal stack that only touches the heap for very deep trees
+class TreeStack {
+public:
+	void push(int node) {
+		if (m_count < FixedSize) m_fixed[m_count] = node;
+		else m_heap.push_back(node);
+		m_count++;
+	}
+	int pop() {
+		m_count--;
+		if (m_count < FixedSize) return m_fixed[m_count];
+		int node = m_heap.back();
+		m_heap.pop_back();
+		return node;
+	}
+	bool empty() const { return m_count == 0; }
+private:
+	static const int FixedSize = 128;
+	int m_fixed[FixedSize];
+	std::vector<int> m_heap;
+	int m_count = 0;
+};
+
+//Dynamic bounding volume hierarchy over boxes tagged with an int.
+//
+//Leaves store "fat" boxes: the real box grown by a margin and by the predicted motion, so
+//an object that moves a little stays inside its leaf and costs nothing to update. Only
+//objects that leave their fat box are removed and reinserted. Insertion picks the sibling
+//with the surface area heuristic, and every node on the way back to the root is rotated
+//if its children's heights differ by more than one.
+//
+//Nodes live in one contiguous pool and refer to each other by index; freed nodes are
+//chained through their parent index and reused.
+class DynamicAabbTree {
+public:
+	enum { Null = -1 };
+
+	int createProxy(const Aabb& box, int userData);
+	void destroyProxy(int proxy);
+	//Returns true if box left the proxy's fat box and it was reinserted.
+	//displacement is the expected motion over the next step.
+	bool moveProxy(int proxy, const Aabb& box, glm::vec3 displacement);
+	void clear();
+
+	const Aabb& fatAabb(int proxy) const { return m_nodes[proxy].box; }
+	int userData(int proxy) const { return m_nodes[proxy].userData; }
+	int height() const { return m_root == Null ? 0 : m_nodes[m_root].height; }
+	int proxyCount() const { return m_proxyCount; }
+
+	//Calls fn(proxy) for every proxy whose fat box overlaps box
+	template <typename Fn>
+	void query(const Aabb& box, Fn fn) const;
+
+	//Finds the closest hit along origin + t * direction for t in [0, maxT]. hitTest(proxy, maxT)
+	//is called for proxies whose fat box the ray enters; it returns the hit distance on the
+	//real object, or a negative value for a miss. Returns the closest proxy hit or Null,
+	//with maxT lowered to its distance.
+	template <typename Fn>
+	int rayCast(glm::vec3 origin, glm::vec3 direction, float& maxT, Fn hitTest) const;
+
+	//Calls fn(proxy) for every proxy whose fat box is not fully outside the planes. Subtrees
+	//fully inside are reported without further tests.
+	template <typename Fn>
+	void queryFrustum(const glm::vec4* planes, int planeCount, Fn fn) const;
+
+	//Added around each real box
+	float margin = 0.1f;
+	//Multiplier on displacement when predicting motion
+	float displacementScale = 2.0f;
+private:
+	struct Node {
+		Aabb box;
+		//Parent, or next free node while on the free list
+		int parent;
+		int child1;
+		int child2;
+		//Leaves are 0, free nodes -1
+		int height;
+		int userData;
+		bool isLeaf() const { return child1 == Null; }
+	};
+
+	int allocateNode();
+	void freeNode(int node);
+	void insertLeaf(int leaf);
+	void removeLeaf(int leaf);
+	int balance(int node);
+	void refit(int node);
+
+	//Calls fn(proxy) for every leaf under node
+	template <typename Fn>
+	void forEachLeaf(int node, Fn fn) const;
+
+	std::vector<Node> m_nodes;
+	int m_root = Null;
+	int m_freeList = Null;
+	int m_proxyCount = 0;
+};
+
+template <typename Fn>
+void DynamicAabbTree::query(const Aabb& box, Fn fn) const {
+	if (m_root == Null) return;
+	TreeStack stack;
+	stack.push(m_root);
+	while (!stack.empty()) {
+		const int index = stack.pop();
+		const Node& node = m_nodes[index];
+		if (!Overlaps(node.box, box)) continue;
+		if (node.isLeaf()) {
+			fn(index);
+		}
+		else {
+			stack.push(node.child1);
+			stack.push(node.child2);
+		}
+	}
+}
+
+template <typename Fn>
+int DynamicAabbTree::rayCast(glm::vec3 origin, glm::vec3 direction, float& maxT, Fn hitTest) const {
+	if (m_root == Null) return Null;
+	const glm::vec3 inverseDirection(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+	int closest = Null;
+	TreeStack stack;
+	stack.push(m_root);
+	while (!stack.empty()) {
+		const int index = stack.pop();
+		const Node& node = m_nodes[index];
+		float t;
+		if (!RayHits(node.box, origin, inverseDirection, maxT, t)) continue;
+		if (node.isLeaf()) {
+			float hit = hitTest(index, maxT);
+			if (hit >= 0.0f && hit <= maxT) {
+				maxT = hit;
+				closest = index;
+			}
+		}
+		else {
+			stack.push(node.child1);
+			stack.push(node.child2);
+		}
+	}
+	return closest;
+}
+
+template <typename Fn>
+void DynamicAabbTree::queryFrustum(const glm::vec4* planes, int planeCount, Fn fn) const {
+	if (m_root == Null) return;
+	TreeStack stack;
+	stack.push(m_root);
+	while (!stack.empty()) {
+		const int index = stack.pop();
+		const Node& node = m_nodes[index];
+		FrustumResult result = TestFrustum(node.box, planes, planeCount);
+		if (result == FrustumOutside) continue;
+		if (result == FrustumInside || node.isLeaf()) {
+			forEachLeaf(index, fn);
+		}
+		else {
+			stack.push(node.child1);
+			stack.push(node.child2);
+		}
+	}
+}
+
+template <typename Fn>
+void DynamicAabbTree::forEachLeaf(int root, Fn fn) const {
+	TreeStack stack;
+	stack.push(root);
+	while (!stack.empty()) {
+		const int index = stack.pop();
+		const Node& node = m_nodes[index];
+		if (node.isLeaf()) {
+			fn(index);
+		}
+		else {
+			stack.push(node.child1);
+			stack.push(node.child2);
+		}
+	}
+}
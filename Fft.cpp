@@ -0,0 +1,50 @@
+#include "Fft.h"
+#include <cassert>
+#include <cmath>
+#include <utility>
+
+void Fft::plan(int n) {
+	assert(n > 0 && (n & (n - 1)) == 0);
+	if (n == m_size) return;
+	m_size = n;
+
+	int bits = 0;
+	while ((1 << bits) < n) bits++;
+	m_reversed.resize(n);
+	for (int i = 0; i < n; i++) {
+		int r = 0;
+		for (int b = 0; b < bits; b++) r |= ((i >> b) & 1) << (bits - 1 - b);
+		m_reversed[i] = r;
+	}
+
+	//Twiddles in double so long transforms do not accumulate angle error
+	m_twiddles.resize(n / 2);
+	const double step = -2.0 * 3.14159265358979323846 / n;
+	for (int k = 0; k < n / 2; k++) {
+		m_twiddles[k] = std::complex<float>((float)std::cos(step * k), (float)std::sin(step * k));
+	}
+}
+
+void Fft::transform(std::complex<float>* data, bool inverse) const {
+	const int n = m_size;
+	for (int i = 0; i < n; i++) {
+		if (i < m_reversed[i]) std::swap(data[i], data[m_reversed[i]]);
+	}
+
+	for (int length = 2; length <= n; length <<= 1) {
+		const int half = length >> 1;
+		const int stride = n / length;
+		for (int start = 0; start < n; start += length) {
+			for (int k = 0; k < half; k++) {
+				//Multiplied out by hand; std::complex's operator* adds inf/NaN recovery
+				const std::complex<float> w = m_twiddles[k * stride];
+				const float wi = inverse ? -w.imag() : w.imag();
+				const std::complex<float> a = data[start + k];
+				const std::complex<float> c = data[start + k + half];
+				const std::complex<float> b(c.real() * w.real() - c.imag() * wi, c.real() * wi + c.imag() * w.real());
+				data[start + k] = a + b;
+				data[start + k + half] = a - b;
+			}
+		}
+	}
+}
@@ -0,0 +1,21 @@
+#pragma once
+#include <complex>
+#include <vector>
+
+//Iterative radix-2 complex FFT of one power-of-two length.
+//plan() precomputes the bit-reversal permutation and twiddles once; transform() only reads
+//them, so one plan can be shared by threads transforming different lines.
+class Fft {
+public:
+	//n must be a power of two
+	void plan(int n);
+	int size() const { return m_size; }
+
+	//In place. The inverse is unscaled: a forward and inverse pair multiplies by size().
+	void transform(std::complex<float>* data, bool inverse) const;
+private:
+	int m_size = 0;
+	std::vector<int> m_reversed;
+	//exp(-2 pi i k / n) for k < n / 2
+	std::vector<std::complex<float>> m_twiddles;
+};
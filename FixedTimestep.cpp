@@ -0,0 +1,19 @@
+#include "FixedTimestep.h"
+
+int FixedTimestep::advance(float frameDt) {
+	if (frameDt > 0.0f) m_accumulator += frameDt;
+
+	int steps = (int)(m_accumulator / step);
+	if (steps > maxSubsteps) {
+		steps = maxSubsteps;
+		m_accumulator = (float)steps * step;
+	}
+	m_accumulator -= (float)steps * step;
+	if (m_accumulator < 0.0f) m_accumulator = 0.0f;
+	return steps;
+}
+
+float FixedTimestep::alpha() const {
+	float a = m_accumulator / step;
+	return a < 1.0f ? a : 1.0f;
+}
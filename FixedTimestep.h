@@ -0,0 +1,22 @@
+#pragma once
+
+//Turns variable frame times into a whole number of fixed physics steps.
+//Leftover time carries over to the next frame; alpha() says how far the renderer
+//is between the last two physics states.
+class FixedTimestep {
+public:
+	//Adds frameDt to the accumulator and returns how many steps of size step to run.
+	//At most maxSubsteps are returned; time beyond that is dropped so a slow frame
+	//cannot snowball into ever more physics work (the "spiral of death").
+	int advance(float frameDt);
+
+	//Fraction of a step left in the accumulator, in [0, 1)
+	float alpha() const;
+
+	void reset() { m_accumulator = 0.0f; }
+
+	float step = 1.0f / 120.0f;
+	int maxSubsteps = 8;
+private:
+	float m_accumulator = 0.0f;
+};
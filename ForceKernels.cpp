@@ -0,0 +1,130 @@
+#include "ForceKernels.h"
+#include "KernelOps.h"
+
+//One spring's worth of SpringForces. Operation order must match the vector loop below.
+static inline void SpringForceScalar(int s, const int* a, const int* b,
+	const float* stiffness, const float* damping, const float* restLength,
+	const float* px, const float* py, const float* pz,
+	const float* vx, const float* vy, const float* vz,
+	float* outX, float* outY, float* outZ) {
+	const int ia = a[s];
+	const int ib = b[s];
+	float dx = px[ia] - px[ib];
+	float dy = py[ia] - py[ib];
+	float dz = pz[ia] - pz[ib];
+	const float length = sqrtf(dx * dx + dy * dy + dz * dz);
+	const float inv = length != 0.0f ? 1.0f / length : 0.0f;
+	dx = dx * inv;
+	dy = dy * inv;
+	dz = dz * inv;
+
+	const float rvx = vx[ia] - vx[ib];
+	const float rvy = vy[ia] - vy[ib];
+	const float rvz = vz[ia] - vz[ib];
+	const float closing = rvx * dx + rvy * dy + rvz * dz;
+
+	const float f = stiffness[s] * (restLength[s] - length) - damping[s] * closing;
+	outX[s] = f * dx;
+	outY[s] = f * dy;
+	outZ[s] = f * dz;
+}
+
+void ForceKernels::Gravity(const float* mass, float* fy, int count, float gravity, Mode mode) {
+	int i = 0;
+	if (mode == Vectorized) {
+		const Simd::Float g = Simd::Set1(gravity);
+		for (; i + SIMD_WIDTH <= count; i += SIMD_WIDTH) {
+			Simd::Store(fy + i, Simd::Add(Simd::Load(fy + i), Simd::Mul(Simd::Load(mass + i), g)));
+		}
+	}
+	for (; i < count; i++) {
+		fy[i] = fy[i] + mass[i] * gravity;
+	}
+}
+
+void ForceKernels::Drag(const float* vx, const float* vy, const float* vz,
+	float* fx, float* fy, float* fz, int count, float coefficient, Mode mode) {
+	int i = 0;
+	if (mode == Vectorized) {
+		const Simd::Float c = Simd::Set1(coefficient);
+		for (; i + SIMD_WIDTH <= count; i += SIMD_WIDTH) {
+			Simd::Store(fx + i, Simd::Sub(Simd::Load(fx + i), Simd::Mul(Simd::Load(vx + i), c)));
+			Simd::Store(fy + i, Simd::Sub(Simd::Load(fy + i), Simd::Mul(Simd::Load(vy + i), c)));
+			Simd::Store(fz + i, Simd::Sub(Simd::Load(fz + i), Simd::Mul(Simd::Load(vz + i), c)));
+		}
+	}
+	for (; i < count; i++) {
+		fx[i] = fx[i] - vx[i] * coefficient;
+		fy[i] = fy[i] - vy[i] * coefficient;
+		fz[i] = fz[i] - vz[i] * coefficient;
+	}
+}
+
+void ForceKernels::Length(const float* x, const float* y, const float* z, float* out, int count, Mode mode) {
+	int i = 0;
+	if (mode == Vectorized) {
+		for (; i + SIMD_WIDTH <= count; i += SIMD_WIDTH) {
+			Simd::Store(out + i, Simd::Length(Simd::Load(x + i), Simd::Load(y + i), Simd::Load(z + i)));
+		}
+	}
+	for (; i < count; i++) {
+		out[i] = sqrtf(x[i] * x[i] + y[i] * y[i] + z[i] * z[i]);
+	}
+}
+
+void ForceKernels::Normalize(float* x, float* y, float* z, float* length, int count, Mode mode) {
+	int i = 0;
+	if (mode == Vectorized) {
+		for (; i + SIMD_WIDTH <= count; i += SIMD_WIDTH) {
+			Simd::Float vx = Simd::Load(x + i);
+			Simd::Float vy = Simd::Load(y + i);
+			Simd::Float vz = Simd::Load(z + i);
+			Simd::Float l = Simd::NormalizeMasked(vx, vy, vz);
+			Simd::Store(x + i, vx);
+			Simd::Store(y + i, vy);
+			Simd::Store(z + i, vz);
+			if (length) Simd::Store(length + i, l);
+		}
+	}
+	for (; i < count; i++) {
+		const float l = sqrtf(x[i] * x[i] + y[i] * y[i] + z[i] * z[i]);
+		const float inv = l != 0.0f ? 1.0f / l : 0.0f;
+		x[i] = x[i] * inv;
+		y[i] = y[i] * inv;
+		z[i] = z[i] * inv;
+		if (length) length[i] = l;
+	}
+}
+
+void ForceKernels::SpringForces(const int* a, const int* b,
+	const float* stiffness, const float* damping, const float* restLength, int count,
+	const float* px, const float* py, const float* pz,
+	const float* vx, const float* vy, const float* vz,
+	float* outX, float* outY, float* outZ, Mode mode) {
+	int s = 0;
+	if (mode == Vectorized) {
+		for (; s + SIMD_WIDTH <= count; s += SIMD_WIDTH) {
+			const Simd::Int ia = Simd::LoadInt(a + s);
+			const Simd::Int ib = Simd::LoadInt(b + s);
+
+			Simd::Float dx = Simd::Sub(Simd::Gather(px, ia), Simd::Gather(px, ib));
+			Simd::Float dy = Simd::Sub(Simd::Gather(py, ia), Simd::Gather(py, ib));
+			Simd::Float dz = Simd::Sub(Simd::Gather(pz, ia), Simd::Gather(pz, ib));
+			const Simd::Float length = Simd::NormalizeMasked(dx, dy, dz);
+
+			const Simd::Float rvx = Simd::Sub(Simd::Gather(vx, ia), Simd::Gather(vx, ib));
+			const Simd::Float rvy = Simd::Sub(Simd::Gather(vy, ia), Simd::Gather(vy, ib));
+			const Simd::Float rvz = Simd::Sub(Simd::Gather(vz, ia), Simd::Gather(vz, ib));
+			const Simd::Float closing = Simd::Add(Simd::Add(Simd::Mul(rvx, dx), Simd::Mul(rvy, dy)), Simd::Mul(rvz, dz));
+
+			const Simd::Float stretch = Simd::Sub(Simd::Load(restLength + s), length);
+			const Simd::Float f = Simd::Sub(Simd::Mul(Simd::Load(stiffness + s), stretch), Simd::Mul(Simd::Load(damping + s), closing));
+			Simd::Store(outX + s, Simd::Mul(f, dx));
+			Simd::Store(outY + s, Simd::Mul(f, dy));
+			Simd::Store(outZ + s, Simd::Mul(f, dz));
+		}
+	}
+	for (; s < count; s++) {
+		SpringForceScalar(s, a, b, stiffness, damping, restLength, px, py, pz, vx, vy, vz, outX, outY, outZ);
+	}
+}
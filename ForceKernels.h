@@ -0,0 +1,35 @@
+#pragma once
+#include "Simd.h"
+
+//Batched force kernels over structure-of-arrays body data.
+//Every kernel runs SIMD_WIDTH lanes at a time with a scalar tail. ScalarReference runs the
+//whole range through the tail code instead; both paths perform the same IEEE operations in
+//the same order, so their results are bit-identical and can be compared directly.
+namespace ForceKernels {
+	enum Mode {
+		Vectorized,
+		ScalarReference
+	};
+
+	//fy[i] += mass[i] * gravity
+	void Gravity(const float* mass, float* fy, int count, float gravity, Mode mode = Vectorized);
+
+	//f[i] -= v[i] * coefficient
+	void Drag(const float* vx, const float* vy, const float* vz,
+		float* fx, float* fy, float* fz, int count, float coefficient, Mode mode = Vectorized);
+
+	//out[i] = |(x[i], y[i], z[i])|
+	void Length(const float* x, const float* y, const float* z, float* out, int count, Mode mode = Vectorized);
+
+	//Normalizes each vector in place, zero-length vectors stay zero. length may be null.
+	void Normalize(float* x, float* y, float* z, float* length, int count, Mode mode = Vectorized);
+
+	//Damped spring forces on endpoint a of each spring, written per spring to out.
+	//Endpoint b receives the negated force; scattering is left to the caller so the
+	//kernel itself never writes to shared body data.
+	void SpringForces(const int* a, const int* b,
+		const float* stiffness, const float* damping, const float* restLength, int count,
+		const float* px, const float* py, const float* pz,
+		const float* vx, const float* vy, const float* vz,
+		float* outX, float* outY, float* outZ, Mode mode = Vectorized);
+}
@@ -0,0 +1,85 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "BodyStore.h"
+
+//Greedy coloring of constraints (springs, elements, ...) over bodies so that no two
+//constraints with the same color touch the same body. Each color can then be processed
+//in parallel without atomics. New constraints are colored incrementally against the
+//existing ones; reset() forces a full recolor.
+//
+//Up to 64 colors are tracked with one bitmask per body. Anything that does not fit goes
+//into a final overflow group, which callers must process serially.
+class GraphColoring {
+public:
+	void reset() {
+		m_colored = 0;
+		m_colorOf.clear();
+		m_bodyMask.clear();
+		m_dirtyGroups = true;
+	}
+
+	//Colors items [colored(), count). bodyOf(item, k) returns the k-th body of item.
+	template <typename BodyFn>
+	void extend(int count, int bodiesPerItem, int bodyCount, BodyFn bodyOf) {
+		if ((int)m_bodyMask.size() < bodyCount) m_bodyMask.resize(bodyCount, 0);
+		m_colorOf.resize(count);
+		for (int item = m_colored; item < count; item++) {
+			uint64_t used = 0;
+			for (int k = 0; k < bodiesPerItem; k++) used |= m_bodyMask[bodyOf(item, k)];
+
+			int color = OverflowColor;
+			if (used != ~0ull) {
+				color = CountTrailingZeros(~used);
+				for (int k = 0; k < bodiesPerItem; k++) m_bodyMask[bodyOf(item, k)] |= (1ull << color);
+			}
+			m_colorOf[item] = color;
+		}
+		if (count != m_colored) m_dirtyGroups = true;
+		m_colored = count;
+	}
+
+	int colored() const { return m_colored; }
+	int colorOf(int item) const { return m_colorOf[item]; }
+
+	//Items grouped by color, overflow group last: group g is
+	//items()[groupStart()[g] .. groupStart()[g + 1])
+	int groupCount() { buildGroups(); return (int)m_groupStart.size() - 1; }
+	const std::vector<int>& groupStart() { buildGroups(); return m_groupStart; }
+	const std::vector<int>& items() { buildGroups(); return m_items; }
+	//True if the last group holds overflow items that must not run in parallel
+	bool hasOverflow() { buildGroups(); return m_hasOverflow; }
+
+	static const int OverflowColor = 64;
+private:
+	void buildGroups() {
+		if (!m_dirtyGroups) return;
+		int counts[OverflowColor + 1] = {};
+		for (int i = 0; i < m_colored; i++) counts[m_colorOf[i]]++;
+
+		m_groupStart.assign(1, 0);
+		int groupOf[OverflowColor + 1];
+		for (int c = 0; c <= OverflowColor; c++) {
+			groupOf[c] = -1;
+			if (counts[c] == 0) continue;
+			groupOf[c] = (int)m_groupStart.size() - 1;
+			m_groupStart.push_back(m_groupStart.back() + counts[c]);
+		}
+		m_hasOverflow = counts[OverflowColor] > 0;
+
+		m_items.resize(m_colored);
+		std::vector<int> cursor(m_groupStart.begin(), m_groupStart.end() - 1);
+		for (int i = 0; i < m_colored; i++) {
+			m_items[cursor[groupOf[m_colorOf[i]]]++] = i;
+		}
+		m_dirtyGroups = false;
+	}
+
+	std::vector<int> m_colorOf;
+	std::vector<uint64_t> m_bodyMask;
+	std::vector<int> m_groupStart;
+	std::vector<int> m_items;
+	int m_colored = 0;
+	bool m_hasOverflow = false;
+	bool m_dirtyGroups = true;
+};
@@ -0,0 +1,296 @@
+#include "ImplicitSolver.h"
+#include "ThreadPool.h"
+
+static const int ChunkSize = 2048;
+//Chains per task; most chains are single free bodies
+static const int ChainGrain = 64;
+
+//Dot product over all bodies, summed per fixed-size chunk and then in chunk order so
+//the result does not depend on the thread count
+static float ParallelDot(const std::vector<glm::vec3>& a, const std::vector<glm::vec3>& b, std::vector<float>& partials) {
+	const int count = (int)a.size();
+	const int chunks = (count + ChunkSize - 1) / ChunkSize;
+	partials.assign(chunks, 0.0f);
+	ThreadPool::Global().parallelFor(count, ChunkSize, [&](int begin, int end) {
+		float sum = 0.0f;
+		for (int i = begin; i < end; i++) sum += glm::dot(a[i], b[i]);
+		partials[begin / ChunkSize] = sum;
+	});
+	float total = 0.0f;
+	for (int c = 0; c < chunks; c++) total += partials[c];
+	return total;
+}
+
+void ImplicitSolver::step(BodyStore& bodies, SpringNetwork& springs, float dragCoefficient, float dt) {
+	assemble(bodies, springs, dragCoefficient, dt);
+	findChains(springs);
+	solveChains(springs);
+	m_lastIterations = solve(springs);
+
+	float* px = bodies.currPos.x.data();
+	float* py = bodies.currPos.y.data();
+	float* pz = bodies.currPos.z.data();
+	float* vx = bodies.velocity.x.data();
+	float* vy = bodies.velocity.y.data();
+	float* vz = bodies.velocity.z.data();
+	bodies.forEachActive([&](int i) {
+		bodies.oldPos.set(i, glm::vec3(px[i], py[i], pz[i]));
+		if (m_fixed[i]) return;
+		vx[i] += m_dv[i].x;
+		vy[i] += m_dv[i].y;
+		vz[i] += m_dv[i].z;
+		px[i] += vx[i] * dt;
+		py[i] += vy[i] * dt;
+		pz[i] += vz[i] * dt;
+	});
+}
+
+void ImplicitSolver::assemble(const BodyStore& bodies, SpringNetwork& springs, float dragCoefficient, float h) {
+	const int bodyCount = bodies.capacity();
+	const int springCount = springs.size();
+	springs.updateAdjacency(bodyCount);
+
+	m_springBlocks.resize(springCount);
+	m_springRhs.resize(springCount);
+	m_diagonal.resize(bodyCount);
+	m_inverseDiagonal.resize(bodyCount);
+	m_fixed.resize(bodyCount);
+	m_rhs.resize(bodyCount);
+
+	for (int i = 0; i < bodyCount; i++) {
+		m_fixed[i] = !bodies.isActive(i) || bodies.inverseMass[i] == 0.0f;
+	}
+
+	ThreadPool& pool = ThreadPool::Global();
+	const float h2 = h * h;
+
+	pool.parallelFor(springCount, ChunkSize, [&](int begin, int end) {
+		for (int s = begin; s < end; s++) {
+			const int a = springs.bodyA[s];
+			const int b = springs.bodyB[s];
+			glm::vec3 d = bodies.currPos.get(a) - bodies.currPos.get(b);
+			float length = glm::length(d);
+			if (length == 0.0f) {
+				m_springBlocks[s] = glm::mat3(0.0f);
+				m_springRhs[s] = glm::vec3(0, 0, 0);
+				continue;
+			}
+			glm::vec3 n = d / length;
+			glm::mat3 nn = glm::outerProduct(n, n);
+
+			//Stiffness Jacobian; the transverse term is clamped at zero under compression
+			//so the matrix stays positive definite
+			float transverse = glm::max(0.0f, 1.0f - springs.restLength[s] / length);
+			glm::mat3 K = springs.stiffness[s] * (nn + transverse * (glm::mat3(1.0f) - nn));
+			glm::mat3 D = springs.damping[s] * nn;
+
+			m_springBlocks[s] = h * D + h2 * K;
+			m_springRhs[s] = h2 * (K * (bodies.velocity.get(a) - bodies.velocity.get(b)));
+		}
+	});
+
+	const std::vector<int>& start = springs.adjacencyStart();
+	const std::vector<int>& adjacent = springs.adjacencySprings();
+	pool.parallelFor(bodyCount, ChunkSize, [&](int begin, int end) {
+		for (int i = begin; i < end; i++) {
+			if (m_fixed[i]) {
+				m_diagonal[i] = glm::mat3(1.0f);
+				m_inverseDiagonal[i] = glm::mat3(1.0f);
+				m_rhs[i] = glm::vec3(0, 0, 0);
+				continue;
+			}
+			glm::mat3 diagonal = glm::mat3(bodies.mass[i] + h * dragCoefficient);
+			glm::vec3 rhs = h * bodies.force.get(i);
+			for (int k = start[i]; k < start[i + 1]; k++) {
+				const int s = adjacent[k];
+				diagonal += m_springBlocks[s];
+				rhs += springs.bodyA[s] == i ? -m_springRhs[s] : m_springRhs[s];
+			}
+			m_diagonal[i] = diagonal;
+			m_inverseDiagonal[i] = glm::inverse(diagonal);
+			m_rhs[i] = rhs;
+		}
+	});
+}
+
+//A chain can only start at a body with at most one free neighbour, so loops are never
+//walked. A walk that reaches a body with three or more is dropped, and its group is left to CG.
+void ImplicitSolver::findChains(const SpringNetwork& springs) {
+	const int count = (int)m_fixed.size();
+	m_direct.assign(count, 0);
+	m_chainStart.assign(1, 0);
+	m_chainBodies.clear();
+	if (!directChains) return;
+
+	const std::vector<int>& start = springs.adjacencyStart();
+	const std::vector<int>& other = springs.adjacencyBodies();
+	m_links.resize(2 * count);
+	m_degree.resize(count);
+	ThreadPool::Global().parallelFor(count, ChunkSize, [&](int begin, int end) {
+		for (int i = begin; i < end; i++) {
+			int* links = &m_links[2 * i];
+			links[0] = links[1] = -1;
+			int degree = 0;
+			if (!m_fixed[i]) {
+				for (int k = start[i]; k < start[i + 1] && degree < 3; k++) {
+					const int j = other[k];
+					if (j == i || m_fixed[j] || j == links[0] || j == links[1]) continue;
+					if (degree < 2) links[degree] = j;
+					degree++;
+				}
+			}
+			m_degree[i] = (unsigned char)degree;
+		}
+	});
+
+	for (int i = 0; i < count; i++) {
+		if (m_fixed[i] || m_direct[i] || m_degree[i] > 1) continue;
+		const int first = (int)m_chainBodies.size();
+		int previous = -1;
+		int body = i;
+		while (body >= 0 && m_degree[body] <= 2) {
+			m_chainBodies.push_back(body);
+			const int next = m_links[2 * body] != previous ? m_links[2 * body] : m_links[2 * body + 1];
+			previous = body;
+			body = next;
+		}
+		if (body >= 0) {
+			m_chainBodies.resize(first);
+			continue;
+		}
+		for (int k = first; k < (int)m_chainBodies.size(); k++) m_direct[m_chainBodies[k]] = 1;
+		m_chainStart.push_back((int)m_chainBodies.size());
+	}
+}
+
+//Along a chain, row k of the system reads D_k dv_k - B_(k-1) dv_(k-1) - B_k dv_(k+1) = r_k,
+//with B_k the sum of the spring blocks between bodies k and k + 1. Forward elimination
+//folds each row into the next:
+//	D'_k = D_k - B_(k-1) D'_(k-1)^-1 B_(k-1),	r'_k = r_k + B_(k-1) D'_(k-1)^-1 r'_(k-1)
+//and back substitution gives dv_k = D'_k^-1 (r'_k + B_k dv_(k+1)). Every D'_k stays
+//positive definite, so no pivoting is needed.
+void ImplicitSolver::solveChains(const SpringNetwork& springs) {
+	const int count = (int)m_fixed.size();
+	if ((int)m_dv.size() != count) m_dv.assign(count, glm::vec3(0, 0, 0));
+	const int total = (int)m_chainBodies.size();
+	m_chainInverse.resize(total);
+	m_chainCoupling.resize(total);
+	m_chainRhs.resize(total);
+
+	const std::vector<int>& start = springs.adjacencyStart();
+	const std::vector<int>& adjacent = springs.adjacencySprings();
+	const std::vector<int>& other = springs.adjacencyBodies();
+	ThreadPool::Global().parallelFor(lastChains(), ChainGrain, [&](int begin, int end) {
+		for (int c = begin; c < end; c++) {
+			const int first = m_chainStart[c];
+			const int last = m_chainStart[c + 1] - 1;
+			for (int k = first; k <= last; k++) {
+				const int i = m_chainBodies[k];
+				glm::mat3 diagonal = m_diagonal[i];
+				glm::vec3 rhs = m_rhs[i];
+				if (k > first) {
+					const glm::mat3 w = m_chainCoupling[k - 1] * m_chainInverse[k - 1];
+					diagonal -= w * m_chainCoupling[k - 1];
+					rhs += w * m_chainRhs[k - 1];
+				}
+				glm::mat3 coupling(0.0f);
+				if (k < last) {
+					const int next = m_chainBodies[k + 1];
+					for (int p = start[i]; p < start[i + 1]; p++) {
+						if (other[p] == next) coupling += m_springBlocks[adjacent[p]];
+					}
+				}
+				m_chainInverse[k] = glm::inverse(diagonal);
+				m_chainCoupling[k] = coupling;
+				m_chainRhs[k] = rhs;
+			}
+
+			glm::vec3 next(0, 0, 0);
+			for (int k = last; k >= first; k--) {
+				const int i = m_chainBodies[k];
+				next = m_chainInverse[k] * (m_chainRhs[k] + m_chainCoupling[k] * next);
+				m_dv[i] = next;
+				m_rhs[i] = glm::vec3(0, 0, 0);
+			}
+		}
+	});
+}
+
+//Chain bodies are skipped: their dv is final, and no spring links them to a body CG solves
+void ImplicitSolver::multiply(const std::vector<glm::vec3>& x, std::vector<glm::vec3>& out, const SpringNetwork& springs) const {
+	const std::vector<int>& start = springs.adjacencyStart();
+	const std::vector<int>& adjacent = springs.adjacencySprings();
+	const std::vector<int>& other = springs.adjacencyBodies();
+	ThreadPool::Global().parallelFor((int)x.size(), ChunkSize, [&](int begin, int end) {
+		for (int i = begin; i < end; i++) {
+			if (m_fixed[i] || m_direct[i]) {
+				out[i] = glm::vec3(0, 0, 0);
+				continue;
+			}
+			glm::vec3 sum = m_diagonal[i] * x[i];
+			for (int k = start[i]; k < start[i + 1]; k++) {
+				sum -= m_springBlocks[adjacent[k]] * x[other[k]];
+			}
+			out[i] = sum;
+		}
+	});
+}
+
+int ImplicitSolver::solve(const SpringNetwork& springs) {
+	const int count = (int)m_rhs.size();
+	if ((int)m_dv.size() != count) m_dv.assign(count, glm::vec3(0, 0, 0));
+	m_r.resize(count);
+	m_z.resize(count);
+	m_p.resize(count);
+	m_q.resize(count);
+
+	for (int i = 0; i < count; i++) {
+		if (m_fixed[i]) m_dv[i] = glm::vec3(0, 0, 0);
+	}
+
+	const float rhsNorm = ParallelDot(m_rhs, m_rhs, m_partials);
+	if (rhsNorm == 0.0f) {
+		for (int i = 0; i < count; i++) {
+			if (!m_direct[i]) m_dv[i] = glm::vec3(0, 0, 0);
+		}
+		return 0;
+	}
+	const float threshold = tolerance * tolerance * rhsNorm;
+
+	//Warm start: r = b - A dv
+	multiply(m_dv, m_q, springs);
+	for (int i = 0; i < count; i++) {
+		m_r[i] = m_rhs[i] - m_q[i];
+		m_z[i] = m_inverseDiagonal[i] * m_r[i];
+		m_p[i] = m_z[i];
+	}
+	float rz = ParallelDot(m_r, m_z, m_partials);
+
+	int iteration = 0;
+	for (; iteration < maxIterations; iteration++) {
+		if (ParallelDot(m_r, m_r, m_partials) <= threshold) break;
+
+		multiply(m_p, m_q, springs);
+		const float pq = ParallelDot(m_p, m_q, m_partials);
+		if (pq <= 0.0f) break;
+		const float alpha = rz / pq;
+
+		ThreadPool::Global().parallelFor(count, ChunkSize, [&](int begin, int end) {
+			for (int i = begin; i < end; i++) {
+				m_dv[i] += alpha * m_p[i];
+				m_r[i] -= alpha * m_q[i];
+				m_z[i] = m_inverseDiagonal[i] * m_r[i];
+			}
+		});
+
+		const float rzNext = ParallelDot(m_r, m_z, m_partials);
+		const float beta = rzNext / rz;
+		rz = rzNext;
+		ThreadPool::Global().parallelFor(count, ChunkSize, [&](int begin, int end) {
+			for (int i = begin; i < end; i++) {
+				m_p[i] = m_z[i] + beta * m_p[i];
+			}
+		});
+	}
+	return iteration;
+}
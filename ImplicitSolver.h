@@ -0,0 +1,79 @@
+#pragma once
+#include "Globals.h"
+#include "BodyStore.h"
+#include "SpringNetwork.h"
+#include <vector>
+
+//Linearized backward Euler step (Baraff & Witkin) for the spring network:
+//
+//	(M - h D - h^2 K) dv = h (f + h K v)
+//
+//K and D are the spring stiffness and damping Jacobians. The matrix is a sparse 3x3 block
+//matrix whose row structure is the spring network's CSR adjacency, so it is only rebuilt
+//when the topology changes; each step just refills the per-spring and per-body blocks.
+//The system is solved with block-Jacobi preconditioned conjugate gradients, warm started
+//from the previous step's dv. Static and inactive bodies are held fixed.
+//
+//Ropes and chains are solved exactly instead. A connected group of free bodies in which
+//every body has at most two free neighbours, and that is not a loop, makes the matrix block
+//tridiagonal along the chain; block Thomas elimination solves it in one linear-time pass,
+//where CG would need about as many iterations as the chain has links. Free bodies on no
+//spring are chains of one. Chains are found afresh every step and solved in parallel with
+//each other; CG only sees the bodies left over.
+class ImplicitSolver {
+public:
+	//Advances every active body by dt. bodies.force must already hold the forces at the
+	//start of the step.
+	void step(BodyStore& bodies, SpringNetwork& springs, float dragCoefficient, float dt);
+
+	//Solve spring chains directly rather than with CG
+	bool directChains = true;
+	int maxIterations = 50;
+	//Relative residual at which CG stops
+	float tolerance = 1e-4f;
+
+	int lastIterations() const { return m_lastIterations; }
+	//Bodies solved directly by the last step, and the chains they formed
+	int lastChainBodies() const { return (int)m_chainBodies.size(); }
+	int lastChains() const { return (int)m_chainStart.size() - 1; }
+private:
+	void assemble(const BodyStore& bodies, SpringNetwork& springs, float dragCoefficient, float h);
+	void findChains(const SpringNetwork& springs);
+	//Writes dv of every chain body and clears its right hand side, so CG leaves it alone
+	void solveChains(const SpringNetwork& springs);
+	void multiply(const std::vector<glm::vec3>& x, std::vector<glm::vec3>& out, const SpringNetwork& springs) const;
+	int solve(const SpringNetwork& springs);
+
+	//Per spring: the off-diagonal block is -(h D_s + h^2 K_s)
+	std::vector<glm::mat3> m_springBlocks;
+	//Per spring: h^2 K_s (v_a - v_b), the spring's share of the right hand side
+	std::vector<glm::vec3> m_springRhs;
+	//Per body: diagonal block and its inverse (the preconditioner)
+	std::vector<glm::mat3> m_diagonal;
+	std::vector<glm::mat3> m_inverseDiagonal;
+	std::vector<unsigned char> m_fixed;
+	//Per body: solved by solveChains() this step
+	std::vector<unsigned char> m_direct;
+
+	//Up to two distinct free neighbours per body, and how many there are, capped at 3
+	std::vector<int> m_links;
+	std::vector<unsigned char> m_degree;
+	//Chain c is m_chainBodies[m_chainStart[c] .. m_chainStart[c + 1]), end to end
+	std::vector<int> m_chainStart;
+	std::vector<int> m_chainBodies;
+	//Per chain body: inverse of its eliminated diagonal block, the coupling block to the
+	//next body and the eliminated right hand side
+	std::vector<glm::mat3> m_chainInverse;
+	std::vector<glm::mat3> m_chainCoupling;
+	std::vector<glm::vec3> m_chainRhs;
+
+	std::vector<glm::vec3> m_rhs;
+	std::vector<glm::vec3> m_dv;
+	std::vector<glm::vec3> m_r;
+	std::vector<glm::vec3> m_z;
+	std::vector<glm::vec3> m_p;
+	std::vector<glm::vec3> m_q;
+	std::vector<float> m_partials;
+
+	int m_lastIterations = 0;
+};
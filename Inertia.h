@@ -0,0 +1,18 @@
+#pragma once
+
+//Principal moments of inertia per unit mass, about the centre of mass in body space.
+//Evaluated at compile time for fixed shapes, so bodies only scale them by their mass.
+namespace Inertia {
+	struct Diagonal {
+		float x, y, z;
+	};
+
+	//Solid box with half extents (hx, hy, hz)
+	constexpr Diagonal Box(float hx, float hy, float hz) {
+		return Diagonal{ (hy * hy + hz * hz) / 3.0f, (hx * hx + hz * hz) / 3.0f, (hx * hx + hy * hy) / 3.0f };
+	}
+
+	//Side 1, the shape of every Cube in the scene
+	constexpr Diagonal UnitCube = Box(0.5f, 0.5f, 0.5f);
+	static_assert(UnitCube.x == UnitCube.y && UnitCube.y == UnitCube.z, "a cube has equal principal moments");
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+//Integrator policies for PhysicsSystem::Step<Policy>.
+//
+//A step evaluates forces Policy::Stages times. Before the first evaluation Begin() may move
+//the evaluation point away from the start state; after evaluation K, Stage<K> receives the
+//acceleration there and sets the next evaluation point, or the final state after the last
+//stage. Everything works on one scalar component of one body so the same code handles
+//x, y and z and inlines straight into the body loop. K is a template argument so
+//multi-stage schemes select their stage at compile time, not per body.
+//
+//	x0, v0      state at the start of the step
+//	old         position at the start of the previous step (oldPos)
+//	x, v        current evaluation point, in/out
+//	accX, accV  per-body scratch for multi-stage schemes
+namespace Integrators {
+	struct StepContext {
+		float dt;
+		//dt / previous dt, for schemes that step from the previous position
+		float dtRatio;
+	};
+
+	//x += v dt, v += a dt. Velocity is read before it is updated; unstable for undamped springs.
+	struct ExplicitEuler {
+		static const int Stages = 1;
+		static inline void Begin(const StepContext&, float, float, float&, float&) {}
+		template <int K>
+		static inline void Stage(const StepContext& c, float x0, float v0, float, float& x, float& v, float a, float&, float&) {
+			x = x0 + v0 * c.dt;
+			v = v0 + a * c.dt;
+		}
+	};
+
+	//v += a dt, then x += v dt. Symplectic, first order.
+	struct SemiImplicitEuler {
+		static const int Stages = 1;
+		static inline void Begin(const StepContext&, float, float, float&, float&) {}
+		template <int K>
+		static inline void Stage(const StepContext& c, float x0, float v0, float, float& x, float& v, float a, float&, float&) {
+			v = v0 + a * c.dt;
+			x = x0 + v * c.dt;
+		}
+	};
+
+	//Drift-kick-drift leapfrog: forces are evaluated at the half step. Symplectic, second order,
+	//one force evaluation per step.
+	struct Leapfrog {
+		static const int Stages = 1;
+		static inline void Begin(const StepContext& c, float x0, float v0, float& x, float& v) {
+			x = x0 + v0 * (0.5f * c.dt);
+			v = v0;
+		}
+		template <int K>
+		static inline void Stage(const StepContext& c, float, float v0, float, float& x, float& v, float a, float&, float&) {
+			v = v0 + a * c.dt;
+			x = x + v * (0.5f * c.dt);
+		}
+	};
+
+	//Time-corrected Stormer-Verlet from the current and previous positions. Velocity is only an
+	//estimate from the last displacement; to launch a body set oldPos = currPos - velocity * dt.
+	struct Verlet {
+		static const int Stages = 1;
+		static inline void Begin(const StepContext&, float, float, float&, float&) {}
+		template <int K>
+		static inline void Stage(const StepContext& c, float x0, float, float old, float& x, float& v, float a, float&, float&) {
+			x = x0 + (x0 - old) * c.dtRatio + a * (c.dt * c.dt);
+			v = (x - x0) / c.dt;
+		}
+	};
+
+	//Classic fourth order Runge-Kutta on (x, v). Four force evaluations per step.
+	struct RK4 {
+		static const int Stages = 4;
+		static inline void Begin(const StepContext&, float, float, float&, float&) {}
+		template <int K>
+		static inline void Stage(const StepContext& c, float x0, float v0, float, float& x, float& v, float a, float& accX, float& accV) {
+			const float h = c.dt;
+			if (K == 0) {
+				accX = v;
+				accV = a;
+				x = x0 + v * (0.5f * h);
+				v = v0 + a * (0.5f * h);
+			}
+			else if (K == 1 || K == 2) {
+				accX += 2.0f * v;
+				accV += 2.0f * a;
+				const float t = K == 1 ? 0.5f * h : h;
+				x = x0 + v * t;
+				v = v0 + a * t;
+			}
+			else {
+				accX += v;
+				accV += a;
+				x = x0 + accX * (h / 6.0f);
+				v = v0 + accV * (h / 6.0f);
+			}
+		}
+	};
+}
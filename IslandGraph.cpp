@@ -0,0 +1,78 @@
+#include "IslandGraph.h"
+#include <algorithm>
+
+//Bodies outside any island have parent -1
+void IslandGraph::reset(const BodyStore& bodies) {
+	const int bodyCount = bodies.capacity();
+	m_parent.resize(bodyCount);
+	m_size.assign(bodyCount, 1);
+	m_islandOf.resize(bodyCount);
+	for (int i = 0; i < bodyCount; i++) {
+		bool live = bodies.isActive(i) || bodies.isSleeping(i);
+		m_parent[i] = live && bodies.inverseMass[i] != 0.0f ? i : -1;
+	}
+}
+
+//Path halving: every visited node skips to its grandparent
+int IslandGraph::find(int i) {
+	while (m_parent[i] != i) {
+		m_parent[i] = m_parent[m_parent[i]];
+		i = m_parent[i];
+	}
+	return i;
+}
+
+void IslandGraph::link(int a, int b) {
+	if (m_parent[a] < 0 || m_parent[b] < 0) return;
+	a = find(a);
+	b = find(b);
+	if (a == b) return;
+	//Union by size keeps the trees shallow
+	if (m_size[a] < m_size[b]) std::swap(a, b);
+	m_parent[b] = a;
+	m_size[a] += m_size[b];
+}
+
+void IslandGraph::finish(const AlignedVector<int>& springA, const AlignedVector<int>& springB) {
+	const int bodyCount = (int)m_parent.size();
+
+	//Number the roots, then give every body its root's number
+	int islands = 0;
+	for (int i = 0; i < bodyCount; i++) {
+		m_islandOf[i] = m_parent[i] == i ? islands++ : -1;
+	}
+	for (int i = 0; i < bodyCount; i++) {
+		if (m_parent[i] >= 0) m_islandOf[i] = m_islandOf[find(i)];
+	}
+
+	//Counting sort of bodies by island
+	m_bodyStart.assign(islands + 1, 0);
+	for (int i = 0; i < bodyCount; i++) {
+		if (m_islandOf[i] >= 0) m_bodyStart[m_islandOf[i] + 1]++;
+	}
+	for (int n = 0; n < islands; n++) m_bodyStart[n + 1] += m_bodyStart[n];
+	m_bodies.resize(m_bodyStart[islands]);
+	m_cursor.assign(m_bodyStart.begin(), m_bodyStart.end() - 1);
+	for (int i = 0; i < bodyCount; i++) {
+		if (m_islandOf[i] >= 0) m_bodies[m_cursor[m_islandOf[i]]++] = i;
+	}
+
+	//Springs follow whichever endpoint is dynamic; springs between two static bodies are dropped
+	const int springCount = (int)springA.size();
+	m_springStart.assign(islands + 1, 0);
+	for (int s = 0; s < springCount; s++) {
+		int n = m_islandOf[springA[s]] >= 0 ? m_islandOf[springA[s]] : m_islandOf[springB[s]];
+		if (n >= 0) m_springStart[n + 1]++;
+	}
+	m_largestSpringCount = 0;
+	for (int n = 0; n < islands; n++) {
+		m_largestSpringCount = std::max(m_largestSpringCount, m_springStart[n + 1]);
+		m_springStart[n + 1] += m_springStart[n];
+	}
+	m_springs.resize(m_springStart[islands]);
+	m_cursor.assign(m_springStart.begin(), m_springStart.end() - 1);
+	for (int s = 0; s < springCount; s++) {
+		int n = m_islandOf[springA[s]] >= 0 ? m_islandOf[springA[s]] : m_islandOf[springB[s]];
+		if (n >= 0) m_springs[m_cursor[n]++] = s;
+	}
+}
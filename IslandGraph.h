@@ -0,0 +1,43 @@
+#pragma once
+#include "BodyStore.h"
+#include <vector>
+
+//Connected components ("islands") of dynamic bodies linked by springs or contacts.
+//Rebuilt from scratch every step with union-find: reset(), link() each constraint, then
+//finish(). Static bodies never join an island, so one anchor shared by many rigs does not
+//merge them. Bodies in different islands never interact during a step, so islands can be
+//solved as independent tasks and put to sleep as a whole.
+class IslandGraph {
+public:
+	//Starts every awake or sleeping dynamic body in an island of its own
+	void reset(const BodyStore& bodies);
+	//Joins the islands of bodies a and b. Ignored unless both are in an island.
+	void link(int a, int b);
+	//Numbers the islands and groups their bodies and the given springs
+	void finish(const AlignedVector<int>& springA, const AlignedVector<int>& springB);
+
+	int count() const { return (int)m_bodyStart.size() - 1; }
+	//Spring count of the island with the most springs
+	int largestSpringCount() const { return m_largestSpringCount; }
+	//Island of body i, or -1 for static, removed and free slots
+	int islandOf(int i) const { return m_islandOf[i]; }
+
+	//Bodies of island n are bodies()[bodyStart()[n] .. bodyStart()[n + 1]),
+	//and its springs are springs()[springStart()[n] .. springStart()[n + 1])
+	const std::vector<int>& bodyStart() const { return m_bodyStart; }
+	const std::vector<int>& bodies() const { return m_bodies; }
+	const std::vector<int>& springStart() const { return m_springStart; }
+	const std::vector<int>& springs() const { return m_springs; }
+private:
+	int find(int i);
+
+	std::vector<int> m_parent;
+	std::vector<int> m_size;
+	std::vector<int> m_islandOf;
+	std::vector<int> m_bodyStart;
+	std::vector<int> m_bodies;
+	std::vector<int> m_springStart;
+	std::vector<int> m_springs;
+	std::vector<int> m_cursor;
+	int m_largestSpringCount = 0;
+};
@@ -0,0 +1,42 @@
+#pragma once
+#include "Simd.h"
+#include <cmath>
+
+//Shared by the kernel translation units; include it from .cpp files only, since the pragma
+//below applies to the rest of the including file.
+
+//ScalarReference is only bit-exact if a*b+c is never fused into an FMA
+#if defined(_MSC_VER)
+#pragma fp_contract(off)
+#elif defined(__clang__)
+#pragma STDC FP_CONTRACT OFF
+#elif defined(__GNUC__)
+//GCC ignores the standard pragma and contracts by default
+#pragma GCC optimize("fp-contract=off")
+#endif
+
+//A kernel body written once against Ops can be instantiated for the vector loop and the
+//scalar tail, so both always perform the same operations in the same order
+struct VectorOps {
+	typedef Simd::Float T;
+	static T Load(const float* p) { return Simd::Load(p); }
+	static void Store(float* p, T v) { Simd::Store(p, v); }
+	static T Set1(float v) { return Simd::Set1(v); }
+	static T Add(T a, T b) { return Simd::Add(a, b); }
+	static T Sub(T a, T b) { return Simd::Sub(a, b); }
+	static T Mul(T a, T b) { return Simd::Mul(a, b); }
+	static T Div(T a, T b) { return Simd::Div(a, b); }
+	static T Sqrt(T a) { return Simd::Sqrt(a); }
+};
+
+struct ScalarOps {
+	typedef float T;
+	static T Load(const float* p) { return *p; }
+	static void Store(float* p, T v) { *p = v; }
+	static T Set1(float v) { return v; }
+	static T Add(T a, T b) { return a + b; }
+	static T Sub(T a, T b) { return a - b; }
+	static T Mul(T a, T b) { return a * b; }
+	static T Div(T a, T b) { return a / b; }
+	static T Sqrt(T a) { return sqrtf(a); }
+};
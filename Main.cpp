@@ -1,6 +1,10 @@
 #include "Globals.h"
 #include "dcRenderer.h"
 #include "dcMath.h"
+#include "PhysicsSystem.h"
+#include "FixedTimestep.h"
+#include "Transform.h"
+#include "DynamicAabbTree.h"
 
 unsigned int SCREEN_WIDTH = 1280;
 unsigned int SCREEN_HEIGHT = 720;
@@ -8,92 +12,21 @@ unsigned int SCREEN_HEIGHT = 720;
 //Window to be displayed throughout game
 //sf::Window window;
 
-struct Transform {
-	glm::quat rotation;
-	glm::vec3 position;
-	glm::vec3 scale;
-};
-
-struct PhysicsComponent {
-	glm::vec3 currPos = glm::vec3(0,0,0);
-	glm::vec3 oldPos = glm::vec3(0,0,0);
-	glm::vec3 velocity = glm::vec3(0,0,0);
-	float mass = 0;
-	bool active = true;
-};
-
-class PhysicsSystem {
-public:
-	void update(float dt);
-	void ApplyForce(glm::vec3 force);
-
-	glm::vec3 ComputeGravity(const PhysicsComponent& c);
-	glm::vec3 ComputeDrag(const PhysicsComponent& c);
-	glm::vec3 ComputeSpring(PhysicsComponent* a, PhysicsComponent* b);
-
-	int numEntities = 2;
-	PhysicsComponent entities[2];
-private:
-	glm::vec3 resultantForce = glm::vec3(0, 0, 0);
-	float dragCoefficient = 0.5f;
-	float stiffness = 8.0f;
-	float damping = 0.1f;
-	float restLength = 1.0f;
-};
-
-void PhysicsSystem::update(float dt) {
-	resultantForce = glm::vec3(0, 0, 0);
-	ApplyForce(ComputeGravity(entities[1]));
-	ApplyForce(ComputeDrag(entities[1]));
-	ApplyForce(ComputeSpring(&entities[0], &entities[1]));
-
-	glm::vec3 acceleration = resultantForce / entities[1].mass;
-	entities[1].currPos += entities[1].velocity * dt;
-	entities[1].velocity += acceleration * dt;
-}
-
-void PhysicsSystem::ApplyForce(glm::vec3 force) {
-	resultantForce += force;
-}
-
-glm::vec3 PhysicsSystem::ComputeGravity(const PhysicsComponent& c) {
-	glm::vec3 acceleration = glm::vec3(0.0f, -9.81f, 0.0f);
-	return c.mass * acceleration;
-}
-
-glm::vec3 PhysicsSystem::ComputeDrag(const PhysicsComponent& c) {
-	return -(c.velocity * dragCoefficient);
-}
-
-glm::vec3 PhysicsSystem::ComputeSpring(PhysicsComponent* a, PhysicsComponent* b) {
-	glm::vec3 direction = a->currPos - b->currPos;
-	glm::vec3 force = glm::vec3(0, 0, 0);
-	if (direction != glm::vec3(0, 0, 0)) {
-		float length = dcMath::Magnitude(direction);
-		dcMath::Normalize(direction);
-
-		force = -stiffness * ((length - restLength) * direction);
-
-		force += -damping * dcMath::Dot(a->velocity - b->velocity, direction);
-
-		return -force;
-	}
-	return force;
-}
-
 class Cube {
 public:
 	Cube();
 	~Cube();
-	void init(glm::vec3 position, PhysicsComponent* p, dcRender::Shader* shader, glm::vec3 color);
-	void update(float dt);
+	void init(glm::vec3 position, BodyStore* bodies, dcRender::Shader* shader, glm::vec3 color);
+	void update(float alpha);
 	void draw(glm::mat4 view);
 	void destroy();
+	int body() const { return m_body; }
 	Transform m_transform;
 private:
 	dcRender::Shader* m_shader;
 	dcRender::CubeRenderer m_renderer;
-	PhysicsComponent* m_phys;
+	BodyStore* m_bodies;
+	int m_body = -1;
 	glm::vec3 m_color;
 };
 
@@ -105,9 +38,9 @@ Cube::~Cube() {
 
 }
 
-void Cube::init(glm::vec3 position, PhysicsComponent* p, dcRender::Shader* shader, glm::vec3 color = glm::vec3(0.516f, 0.461f, 0.550f)) {
-	assert(p != nullptr);
-	m_phys = p;
+void Cube::init(glm::vec3 position, BodyStore* bodies, dcRender::Shader* shader, glm::vec3 color = glm::vec3(0.516f, 0.461f, 0.550f)) {
+	assert(bodies != nullptr);
+	m_bodies = bodies;
 
 	assert(shader != nullptr);
 	m_shader = shader;
@@ -119,15 +52,21 @@ void Cube::init(glm::vec3 position, PhysicsComponent* p, dcRender::Shader* shade
 	m_transform.rotation = glm::quat(glm::vec3(0.0f, 0.0f, 0.0f));
 	m_transform.scale = glm::vec3(1, 1, 1);
 
-	m_phys->mass = 1.0f;
-	m_phys->currPos = m_transform.position;
-	m_phys->oldPos = m_phys->currPos;
+	PhysicsComponent p;
+	p.mass = 1.0f;
+	p.currPos = m_transform.position;
+	p.oldPos = p.currPos;
+	p.halfExtent = 0.5f * m_transform.scale;
+	p.orientation = m_transform.rotation;
+	m_body = m_bodies->add(p);
 	
 	m_color = color;
 }
 
-void Cube::update(float dt) {
-	m_transform.position = m_phys->currPos;
+//alpha blends between the last two physics steps, see FixedTimestep::alpha
+void Cube::update(float alpha) {
+	m_transform.position = glm::mix(m_bodies->oldPos.get(m_body), m_bodies->currPos.get(m_body), alpha);
+	m_transform.rotation = glm::slerp(m_bodies->oldOrientation.get(m_body), m_bodies->orientation.get(m_body), alpha);
 }
 
 void Cube::draw(glm::mat4 view) {
@@ -137,6 +76,7 @@ void Cube::draw(glm::mat4 view) {
 
 void Cube::destroy() {
 	m_renderer.destroy();
+	m_bodies->remove(m_body);
 }
 
 static void glfw_error_callback(int error, const char* description)
@@ -252,15 +192,28 @@ int main()
 	}
 
 	PhysicsSystem physicsSystem;
+	physicsSystem.integrator = PhysicsSystem::Verlet;
+	FixedTimestep timestep;
 
 	dcRender::Shader cubeShader;
 	cubeShader.loadFromFile("lamp.vert", "lamp.frag");
-	Cube cube;
-
-	cube.init(glm::vec3(0.0f, -2.0f, 0.0f), &physicsSystem.entities[1], &cubeShader);
-
+	//The red cube is a static anchor, the other hangs from it on a spring
 	Cube cube2;
-	cube2.init(glm::vec3(0.0f, 2.0f, 0.0f), &physicsSystem.entities[0], &cubeShader, glm::vec3(1.0f, 0.0f, 0.0f));
+	cube2.init(glm::vec3(0.0f, 2.0f, 0.0f), &physicsSystem.bodies, &cubeShader, glm::vec3(1.0f, 0.0f, 0.0f));
+	physicsSystem.bodies.setMass(cube2.body(), 0.0f);
+
+	Cube cube;
+	cube.init(glm::vec3(0.0f, -2.0f, 0.0f), &physicsSystem.bodies, &cubeShader);
+	physicsSystem.springs.add(cube2.body(), cube.body());
+
+	//Scene bounds for view culling, one proxy per cube with the cube's index as user data
+	Cube* cubes[] = { &cube, &cube2 };
+	const int cubeCount = sizeof(cubes) / sizeof(cubes[0]);
+	DynamicAabbTree sceneTree;
+	int cubeProxies[cubeCount];
+	for (int i = 0; i < cubeCount; i++) {
+		cubeProxies[i] = sceneTree.createProxy(BoxAabb(cubes[i]->m_transform), i);
+	}
 
 	sf::Clock clock;
 
@@ -391,9 +344,24 @@ int main()
 
 		view = (camera.GetOrientation() * glm::translate(view, camera.position));
 
-		physicsSystem.update(dt);
-		cube.update(dt);
-		cube2.update(dt);
+		int steps = timestep.advance(dt);
+		for (int i = 0; i < steps; i++) {
+			physicsSystem.update(timestep.step);
+		}
+		for (int i = 0; i < cubeCount; i++) {
+			cubes[i]->update(timestep.alpha());
+			sceneTree.moveProxy(cubeProxies[i], BoxAabb(cubes[i]->m_transform), glm::vec3(0, 0, 0));
+		}
+
+		glm::mat4 proj = glm::perspective(glm::radians(45.0f), (float)SCREEN_WIDTH / (float)SCREEN_HEIGHT, 0.1f, 100.0f);
+		glm::vec4 frustum[6];
+		FrustumPlanes(proj * view, frustum);
+		bool visible[cubeCount] = {};
+		int visibleCount = 0;
+		sceneTree.queryFrustum(frustum, 6, [&](int proxy) {
+			visible[sceneTree.userData(proxy)] = true;
+			visibleCount++;
+		});
 
 		// Start the Dear ImGui frame
 		ImGui_ImplOpenGL3_NewFrame();
@@ -413,6 +381,30 @@ int main()
 			ImGui::SliderFloat("RedCube x", &cube2.m_transform.position.x, -5.0f, 5.0f);
 			ImGui::SliderFloat("RedCube y", &cube2.m_transform.position.y, -5.0f, 5.0f);
 			ImGui::SliderFloat("RedCube z", &cube2.m_transform.position.z, -5.0f, 5.0f);
+			int broadphase = physicsSystem.broadphase;
+			ImGui::RadioButton("Hash grid", &broadphase, PhysicsSystem::HashGrid); ImGui::SameLine();
+			ImGui::RadioButton("Sweep and prune", &broadphase, PhysicsSystem::SweepPrune); ImGui::SameLine();
+			ImGui::RadioButton("AABB tree", &broadphase, PhysicsSystem::Bvh);
+			physicsSystem.broadphase = (PhysicsSystem::Broadphase)broadphase;
+			int integrator = physicsSystem.integrator;
+			ImGui::Combo("Integrator", &integrator, [](void*, int i, const char** name) { *name = PhysicsSystem::IntegratorRegistry[i].name; return true; }, nullptr, PhysicsSystem::IntegratorCount);
+			physicsSystem.integrator = (PhysicsSystem::Integrator)integrator;
+			if (physicsSystem.integrator == PhysicsSystem::PositionBased) ImGui::SliderInt("XPBD substeps", &physicsSystem.xpbd.substeps, 1, 32);
+			if (physicsSystem.integrator == PhysicsSystem::ProjectiveDynamics) ImGui::SliderInt("PD iterations", &physicsSystem.projectiveSolver.iterations, 1, 50);
+			if (physicsSystem.softBody.size() > 0) ImGui::SliderInt("FEM rotation iterations", &physicsSystem.softBody.rotationIterations, 1, 8);
+			int gravity = physicsSystem.gravity;
+			ImGui::RadioButton("Uniform gravity", &gravity, PhysicsSystem::UniformGravity); ImGui::SameLine();
+			ImGui::RadioButton("Mutual gravity", &gravity, PhysicsSystem::MutualGravity); ImGui::SameLine();
+			ImGui::RadioButton("Mesh gravity", &gravity, PhysicsSystem::MeshGravity);
+			physicsSystem.gravity = (PhysicsSystem::Gravity)gravity;
+			ImGui::SliderFloat("Opening angle", &physicsSystem.barnesHut.theta, 0.0f, 1.5f);
+			ImGui::Text("Broadphase pairs: %d", (int)physicsSystem.CollisionPairs().size());
+			ImGui::Text("Contact manifolds: %d", (int)physicsSystem.narrowphase.manifolds().size());
+			ImGui::SliderInt("Contact iterations", &physicsSystem.contactSolver.iterations, 1, 50);
+			ImGui::Checkbox("Warm starting", &physicsSystem.contactSolver.warmStarting);
+			ImGui::Checkbox("Continuous collision", &physicsSystem.continuousCollisionEnabled);
+			ImGui::Text("Fast bodies: %d, impacts: %d", physicsSystem.continuousCollision.fastCount(), physicsSystem.continuousCollision.lastImpacts());
+			ImGui::Text("Cubes in view: %d / %d", visibleCount, cubeCount);
 			ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
 			ImGui::Text("Mouse position is: %.3f , %.3f", xmouse - SCREEN_WIDTH/2, ymouse - SCREEN_HEIGHT/2);
 			ImGui::Text("Camera position: %.3f, %.3f, %.3f", camera.position.x, camera.position.y, camera.position.z);
@@ -444,8 +436,9 @@ int main()
 		glClearColor(clear_color.x, clear_color.y, clear_color.z, clear_color.w);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 		cubeShader.SetFloat("ambientStrength", ambientLight);
-		cube.draw(view);
-		cube2.draw(view);
+		for (int i = 0; i < cubeCount; i++) {
+			if (visible[i]) cubes[i]->draw(view);
+		}
 		ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
 
 		glfwMakeContextCurrent(window);
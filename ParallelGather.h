@@ -0,0 +1,80 @@
+#pragma once
+#include "Globals.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <vector>
+
+//Parallel, order-preserving compaction of the items that pass a filter, together with the
+//bounds of their positions. Items are split into fixed-size chunks: each chunk counts its
+//kept items and bounds them, a serial scan turns the counts into output offsets, and each
+//chunk then writes its items in order. Loops run over fixed chunk indices, so the output
+//order does not depend on how the pool splits the work.
+namespace ParallelGather {
+	enum {
+		Chunk = 4096
+	};
+
+	//Scratch space reused between gathers; Count() fills it for the Compact() that follows
+	struct Buffers {
+		std::vector<int> chunkStart;
+		std::vector<glm::vec3> chunkLo;
+		std::vector<glm::vec3> chunkHi;
+	};
+
+	//Counts the items in [0, count) for which keep(item) holds and bounds position(item)
+	//over them. Returns the count; with none, lo is +infinity and hi -infinity.
+	template <typename Keep, typename Position>
+	int Count(int count, Keep keep, Position position, Buffers& scratch, glm::vec3& lo, glm::vec3& hi) {
+		const int chunks = (count + Chunk - 1) / Chunk;
+		scratch.chunkStart.resize(chunks);
+		scratch.chunkLo.resize(chunks);
+		scratch.chunkHi.resize(chunks);
+
+		ThreadPool::Global().parallelFor(chunks, 1, [&](int first, int last) {
+			for (int c = first; c < last; c++) {
+				int n = 0;
+				glm::vec3 chunkLo(INFINITY, INFINITY, INFINITY);
+				glm::vec3 chunkHi(-INFINITY, -INFINITY, -INFINITY);
+				for (int i = c * Chunk; i < std::min((c + 1) * Chunk, count); i++) {
+					if (!keep(i)) continue;
+					const glm::vec3 p = position(i);
+					chunkLo = glm::vec3(std::min(chunkLo.x, p.x), std::min(chunkLo.y, p.y), std::min(chunkLo.z, p.z));
+					chunkHi = glm::vec3(std::max(chunkHi.x, p.x), std::max(chunkHi.y, p.y), std::max(chunkHi.z, p.z));
+					n++;
+				}
+				scratch.chunkStart[c] = n;
+				scratch.chunkLo[c] = chunkLo;
+				scratch.chunkHi[c] = chunkHi;
+			}
+		});
+
+		int total = 0;
+		lo = glm::vec3(INFINITY, INFINITY, INFINITY);
+		hi = glm::vec3(-INFINITY, -INFINITY, -INFINITY);
+		for (int c = 0; c < chunks; c++) {
+			const int n = scratch.chunkStart[c];
+			scratch.chunkStart[c] = total;
+			total += n;
+			const glm::vec3 chunkLo = scratch.chunkLo[c];
+			const glm::vec3 chunkHi = scratch.chunkHi[c];
+			lo = glm::vec3(std::min(lo.x, chunkLo.x), std::min(lo.y, chunkLo.y), std::min(lo.z, chunkLo.z));
+			hi = glm::vec3(std::max(hi.x, chunkHi.x), std::max(hi.y, chunkHi.y), std::max(hi.z, chunkHi.z));
+		}
+		return total;
+	}
+
+	//Calls emit(k, item) for every item kept by the last Count(), k being its index among
+	//them. keep must give the same answers as it did there.
+	template <typename Keep, typename Emit>
+	void Compact(int count, Keep keep, Emit emit, const Buffers& scratch) {
+		const int chunks = (count + Chunk - 1) / Chunk;
+		ThreadPool::Global().parallelFor(chunks, 1, [&](int first, int last) {
+			for (int c = first; c < last; c++) {
+				int k = scratch.chunkStart[c];
+				for (int i = c * Chunk; i < std::min((c + 1) * Chunk, count); i++) {
+					if (keep(i)) emit(k++, i);
+				}
+			}
+		});
+	}
+}
@@ -0,0 +1,297 @@
+#include "ParticleMesh.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+static const int SortChunk = 16384;
+static const int ChunkSize = 4096;
+
+static inline bool IsSource(const BodyStore& bodies, int i) {
+	return bodies.mass[i] > 0.0f && (bodies.isActive(i) || bodies.isSleeping(i));
+}
+
+//Maps u into [0, n); rounding can land exactly on n, which is the same cell as 0
+static inline float Wrap(float u, int n) {
+	u -= n * std::floor(u / n);
+	return u < n ? u : 0.0f;
+}
+
+void ParticleMesh::apply(BodyStore& bodies) {
+	const int n = gridSize;
+	//The fitted box leaves a cell of margin on each side, which needs at least four cells
+	assert(n >= 4 && (n & (n - 1)) == 0);
+	if (n != m_n) {
+		m_n = n;
+		m_fft.plan(n);
+		const size_t cells = (size_t)n * n * n;
+		m_density.resize(cells);
+		m_spectrum.resize(cells);
+		m_ax.resize(cells);
+		m_ay.resize(cells);
+		m_az.resize(cells);
+
+		std::vector<float> sine2(n);
+		for (int k = 0; k < n; k++) {
+			const float s = (float)std::sin(3.14159265358979323846 * k / n);
+			sine2[k] = s * s;
+		}
+		m_green.resize(cells);
+		for (int z = 0; z < n; z++) {
+			for (int y = 0; y < n; y++) {
+				for (int x = 0; x < n; x++) {
+					const float sum = sine2[x] + sine2[y] + sine2[z];
+					m_green[((size_t)z * n + y) * n + x] = sum > 0.0f ? 1.0f / sum : 0.0f;
+				}
+			}
+		}
+	}
+
+	gather(bodies);
+	if (m_ids.empty()) return;
+	deposit();
+	solve();
+	gradient();
+	interpolate(bodies);
+}
+
+//Compacts the massive live bodies in id order, places them on the grid and counting-sorts
+//them by z plane. The sort also runs over fixed chunks, so its order never depends on the pool.
+void ParticleMesh::gather(const BodyStore& bodies) {
+	ThreadPool& pool = ThreadPool::Global();
+	const int n = m_n;
+	auto source = [&](int i) { return IsSource(bodies, i); };
+	glm::vec3 lo, hi;
+	const int total = ParallelGather::Count(bodies.capacity(), source, [&](int i) { return bodies.currPos.get(i); }, m_gatherBuffers, lo, hi);
+	m_unsortedIds.resize(total);
+	m_ids.resize(total);
+	if (total == 0) return;
+
+	glm::vec3 origin = boxOrigin;
+	float size = boxSize;
+	if (size <= 0.0f) {
+		const glm::vec3 extent = hi - lo;
+		size = std::max(extent.x, std::max(extent.y, extent.z));
+		if (size <= 0.0f) size = 1.0f;
+		size *= (float)n / (n - 2);
+		origin = lo - glm::vec3(size / n, size / n, size / n);
+	}
+	m_cellSize = size / n;
+	const float inverseCell = 1.0f / m_cellSize;
+
+	m_ux.resize(total);
+	m_uy.resize(total);
+	m_uz.resize(total);
+	ParallelGather::Compact(bodies.capacity(), source, [&](int k, int i) {
+		m_unsortedIds[k] = i;
+		m_ux[k] = Wrap((bodies.currPos.x[i] - origin.x) * inverseCell, n);
+		m_uy[k] = Wrap((bodies.currPos.y[i] - origin.y) * inverseCell, n);
+		m_uz[k] = Wrap((bodies.currPos.z[i] - origin.z) * inverseCell, n);
+	}, m_gatherBuffers);
+
+	//Counting sort by plane: per-chunk counts, a scan over (plane, chunk), then a stable scatter
+	const int sortChunks = (total + SortChunk - 1) / SortChunk;
+	m_chunkPlanes.resize(sortChunks * n);
+	pool.parallelFor(sortChunks, 1, [&](int first, int last) {
+		for (int c = first; c < last; c++) {
+			int* planes = &m_chunkPlanes[c * n];
+			std::fill(planes, planes + n, 0);
+			for (int k = c * SortChunk; k < std::min((c + 1) * SortChunk, total); k++) planes[(int)m_uz[k]]++;
+		}
+	});
+	m_planeStart.resize(n + 1);
+	int offset = 0;
+	for (int p = 0; p < n; p++) {
+		m_planeStart[p] = offset;
+		for (int c = 0; c < sortChunks; c++) {
+			const int count = m_chunkPlanes[c * n + p];
+			m_chunkPlanes[c * n + p] = offset;
+			offset += count;
+		}
+	}
+	m_planeStart[n] = offset;
+
+	m_gx.resize(total);
+	m_gy.resize(total);
+	m_gz.resize(total);
+	m_mass.resize(total);
+	pool.parallelFor(sortChunks, 1, [&](int first, int last) {
+		for (int c = first; c < last; c++) {
+			int* cursor = &m_chunkPlanes[c * n];
+			for (int k = c * SortChunk; k < std::min((c + 1) * SortChunk, total); k++) {
+				const int slot = cursor[(int)m_uz[k]]++;
+				const int i = m_unsortedIds[k];
+				m_ids[slot] = i;
+				m_gx[slot] = m_ux[k];
+				m_gy[slot] = m_uy[k];
+				m_gz[slot] = m_uz[k];
+				m_mass[slot] = bodies.mass[i];
+			}
+		}
+	});
+}
+
+//A body in plane z spreads its mass over planes z and z + 1, so planes of one parity never
+//share a cell and can be deposited in parallel
+void ParticleMesh::deposit() {
+	ThreadPool& pool = ThreadPool::Global();
+	const int n = m_n;
+	const int mask = n - 1;
+	const int cells = n * n * n;
+	pool.parallelFor(cells, ChunkSize, [&](int begin, int end) {
+		std::fill(m_density.begin() + begin, m_density.begin() + end, 0.0f);
+	});
+
+	for (int parity = 0; parity < 2; parity++) {
+		pool.parallelFor(n / 2, 1, [&](int first, int last) {
+			for (int p = 2 * first + parity; p < 2 * last; p += 2) {
+				float* plane0 = &m_density[(size_t)p * n * n];
+				float* plane1 = &m_density[(size_t)((p + 1) & mask) * n * n];
+				for (int k = m_planeStart[p]; k < m_planeStart[p + 1]; k++) {
+					const int x0 = (int)m_gx[k];
+					const int y0 = (int)m_gy[k];
+					const float fx = m_gx[k] - x0;
+					const float fy = m_gy[k] - y0;
+					const float fz = m_gz[k] - p;
+					const int x1 = (x0 + 1) & mask;
+					const int y1 = (y0 + 1) & mask;
+					const float m0 = m_mass[k] * (1.0f - fz);
+					const float m1 = m_mass[k] * fz;
+					const float w00 = (1.0f - fx) * (1.0f - fy);
+					const float w10 = fx * (1.0f - fy);
+					const float w01 = (1.0f - fx) * fy;
+					const float w11 = fx * fy;
+					plane0[y0 * n + x0] += m0 * w00;
+					plane0[y0 * n + x1] += m0 * w10;
+					plane0[y1 * n + x0] += m0 * w01;
+					plane0[y1 * n + x1] += m0 * w11;
+					plane1[y0 * n + x0] += m1 * w00;
+					plane1[y0 * n + x1] += m1 * w10;
+					plane1[y1 * n + x0] += m1 * w01;
+					plane1[y1 * n + x1] += m1 * w11;
+				}
+			}
+		});
+	}
+}
+
+//With density rho = mass / h^3 and the discrete Laplacian's eigenvalues
+//-(4 / h^2) sum(sin^2(pi k / n)), Poisson's equation lap(phi) = 4 pi G rho gives
+//phi_k = -pi G / h * green_k * mass_k. The inverse transform's n^3 is folded in too.
+void ParticleMesh::solve() {
+	ThreadPool& pool = ThreadPool::Global();
+	const int n = m_n;
+	const int cells = n * n * n;
+	pool.parallelFor(cells, ChunkSize, [&](int begin, int end) {
+		for (int i = begin; i < end; i++) m_spectrum[i] = std::complex<float>(m_density[i], 0.0f);
+	});
+
+	transform(false);
+	const float scale = -3.14159265f * gravitationalConstant / (m_cellSize * (float)cells);
+	pool.parallelFor(cells, ChunkSize, [&](int begin, int end) {
+		for (int i = begin; i < end; i++) m_spectrum[i] *= scale * m_green[i];
+	});
+	transform(true);
+}
+
+void ParticleMesh::transform(bool inverse) {
+	ThreadPool& pool = ThreadPool::Global();
+	const int n = m_n;
+	std::complex<float>* data = m_spectrum.data();
+
+	//x lines are contiguous
+	pool.parallelFor(n * n, 16, [&](int begin, int end) {
+		for (int line = begin; line < end; line++) m_fft.transform(data + (size_t)line * n, inverse);
+	});
+
+	//y and z lines are copied out through a local buffer
+	pool.parallelFor(n, 1, [&](int first, int last) {
+		std::vector<std::complex<float>> column(n);
+		for (int z = first; z < last; z++) {
+			std::complex<float>* plane = data + (size_t)z * n * n;
+			for (int x = 0; x < n; x++) {
+				for (int y = 0; y < n; y++) column[y] = plane[y * n + x];
+				m_fft.transform(column.data(), inverse);
+				for (int y = 0; y < n; y++) plane[y * n + x] = column[y];
+			}
+		}
+	});
+	pool.parallelFor(n, 1, [&](int first, int last) {
+		std::vector<std::complex<float>> column(n);
+		for (int y = first; y < last; y++) {
+			for (int x = 0; x < n; x++) {
+				std::complex<float>* line = data + (size_t)y * n + x;
+				for (int z = 0; z < n; z++) column[z] = line[(size_t)z * n * n];
+				m_fft.transform(column.data(), inverse);
+				for (int z = 0; z < n; z++) line[(size_t)z * n * n] = column[z];
+			}
+		}
+	});
+}
+
+//Acceleration is minus the central-difference gradient of the potential
+void ParticleMesh::gradient() {
+	const int n = m_n;
+	const int mask = n - 1;
+	const float scale = -0.5f / m_cellSize;
+	const std::complex<float>* phi = m_spectrum.data();
+	ThreadPool::Global().parallelFor(n, 1, [&](int first, int last) {
+		for (int z = first; z < last; z++) {
+			const size_t zDown = (size_t)((z - 1) & mask) * n * n;
+			const size_t zUp = (size_t)((z + 1) & mask) * n * n;
+			for (int y = 0; y < n; y++) {
+				const size_t row = ((size_t)z * n + y) * n;
+				const size_t yDown = (size_t)((y - 1) & mask) * n;
+				const size_t yUp = (size_t)((y + 1) & mask) * n;
+				for (int x = 0; x < n; x++) {
+					const size_t i = row + x;
+					m_ax[i] = scale * (phi[row + ((x + 1) & mask)].real() - phi[row + ((x - 1) & mask)].real());
+					m_ay[i] = scale * (phi[(size_t)z * n * n + yUp + x].real() - phi[(size_t)z * n * n + yDown + x].real());
+					m_az[i] = scale * (phi[zUp + (size_t)y * n + x].real() - phi[zDown + (size_t)y * n + x].real());
+				}
+			}
+		}
+	});
+}
+
+//Same weights as the deposit, so a lone body feels no force from its own mass
+void ParticleMesh::interpolate(BodyStore& bodies) const {
+	const int n = m_n;
+	const int mask = n - 1;
+	ThreadPool::Global().parallelFor((int)m_ids.size(), ChunkSize, [&](int begin, int end) {
+		for (int k = begin; k < end; k++) {
+			const int i = m_ids[k];
+			if (!bodies.isActive(i)) continue;
+			const int x0 = (int)m_gx[k];
+			const int y0 = (int)m_gy[k];
+			const int z0 = (int)m_gz[k];
+			const float fx = m_gx[k] - x0;
+			const float fy = m_gy[k] - y0;
+			const float fz = m_gz[k] - z0;
+			const int x1 = (x0 + 1) & mask;
+			const int y1 = (y0 + 1) & mask;
+			const int z1 = (z0 + 1) & mask;
+			const size_t corner[8] = {
+				((size_t)z0 * n + y0) * n + x0, ((size_t)z0 * n + y0) * n + x1,
+				((size_t)z0 * n + y1) * n + x0, ((size_t)z0 * n + y1) * n + x1,
+				((size_t)z1 * n + y0) * n + x0, ((size_t)z1 * n + y0) * n + x1,
+				((size_t)z1 * n + y1) * n + x0, ((size_t)z1 * n + y1) * n + x1,
+			};
+			const float weight[8] = {
+				(1.0f - fx) * (1.0f - fy) * (1.0f - fz), fx * (1.0f - fy) * (1.0f - fz),
+				(1.0f - fx) * fy * (1.0f - fz), fx * fy * (1.0f - fz),
+				(1.0f - fx) * (1.0f - fy) * fz, fx * (1.0f - fy) * fz,
+				(1.0f - fx) * fy * fz, fx * fy * fz,
+			};
+			float ax = 0.0f, ay = 0.0f, az = 0.0f;
+			for (int c = 0; c < 8; c++) {
+				ax += weight[c] * m_ax[corner[c]];
+				ay += weight[c] * m_ay[corner[c]];
+				az += weight[c] * m_az[corner[c]];
+			}
+			bodies.force.x[i] += m_mass[k] * ax;
+			bodies.force.y[i] += m_mass[k] * ay;
+			bodies.force.z[i] += m_mass[k] * az;
+		}
+	});
+}
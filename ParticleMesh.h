@@ -0,0 +1,70 @@
+#pragma once
+#include "BodyStore.h"
+#include "Fft.h"
+#include "ParallelGather.h"
+#include <complex>
+#include <vector>
+
+//Long-range mutual gravitation by the particle-mesh method, for large and roughly uniform
+//distributions where even a tree walk is too slow.
+//
+//The box is split into gridSize^3 cells and treated as periodic. Each apply():
+//	- counting-sorts the massive live bodies by grid plane
+//	- deposits their mass onto the grid with cloud-in-cell weights. Even planes are done
+//	  in parallel, then odd planes, so no two threads touch the same cell.
+//	- solves Poisson's equation in k-space with the in-tree Fft, using the eigenvalues of
+//	  the discrete Laplacian so the solve matches the finite differences that follow
+//	- takes the acceleration as the central-difference gradient of the potential
+//	- interpolates it back to each awake body with the same cloud-in-cell weights
+//
+//Forces are smoothed over about two cells, so close encounters are much weaker than the
+//exact pull; the method is meant for the large-scale field. Static (massless) bodies are
+//ignored and sleeping bodies still attract. Results are independent of the thread count.
+class ParticleMesh {
+public:
+	//Adds the mesh force to every awake massive body
+	void apply(BodyStore& bodies);
+
+	//Cells per axis; must be a power of two, at least 4
+	int gridSize = 64;
+	//In simulation units
+	float gravitationalConstant = 1.0f;
+	//Edge length of the periodic box starting at boxOrigin. Bodies outside are wrapped in.
+	//0 fits a box around the bodies every apply, with a one cell margin; the periodic images
+	//then make the force only approximate near the faces.
+	float boxSize = 0.0f;
+	glm::vec3 boxOrigin = glm::vec3(0, 0, 0);
+
+	float lastCellSize() const { return m_cellSize; }
+private:
+	void gather(const BodyStore& bodies);
+	void deposit();
+	void solve();
+	void gradient();
+	void interpolate(BodyStore& bodies) const;
+	//Runs the 1D transform along every x, y and z line of m_spectrum
+	void transform(bool inverse);
+
+	int m_n = 0;
+	float m_cellSize = 0.0f;
+	Fft m_fft;
+
+	//Bodies in id order and their position in cells, wrapped into [0, gridSize)
+	std::vector<int> m_unsortedIds;
+	AlignedVector<float> m_ux, m_uy, m_uz;
+	ParallelGather::Buffers m_gatherBuffers;
+	//Per sort chunk: counts per plane, then their output offsets
+	std::vector<int> m_chunkPlanes;
+
+	//The same bodies sorted by z plane; plane p is [m_planeStart[p], m_planeStart[p + 1])
+	std::vector<int> m_ids;
+	AlignedVector<float> m_gx, m_gy, m_gz, m_mass;
+	std::vector<int> m_planeStart;
+
+	//Cell (x, y, z) is at (z * gridSize + y) * gridSize + x
+	AlignedVector<float> m_density;
+	std::vector<std::complex<float>> m_spectrum;
+	//1 / (sum of sin^2(pi k / n) over the axes) per wavenumber, 0 for the mean
+	AlignedVector<float> m_green;
+	AlignedVector<float> m_ax, m_ay, m_az;
+};
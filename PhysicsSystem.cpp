@@ -0,0 +1,340 @@
+#include "PhysicsSystem.h"
+#include "RotationKernels.h"
+#include <algorithm>
+
+const PhysicsSystem::IntegratorEntry PhysicsSystem::IntegratorRegistry[PhysicsSystem::IntegratorCount] = {
+	{ "ExplicitEuler", &PhysicsSystem::Step<Integrators::ExplicitEuler> },
+	{ "SemiImplicitEuler", &PhysicsSystem::Step<Integrators::SemiImplicitEuler> },
+	{ "Leapfrog", &PhysicsSystem::Step<Integrators::Leapfrog> },
+	{ "RK4", &PhysicsSystem::Step<Integrators::RK4> },
+	{ "Verlet", &PhysicsSystem::Step<Integrators::Verlet> },
+	{ "BackwardEuler", &PhysicsSystem::StepImplicit },
+	{ "XPBD", &PhysicsSystem::StepPositionBased },
+	{ "ProjectiveDynamics", &PhysicsSystem::StepProjective },
+};
+
+bool PhysicsSystem::FindIntegrator(const std::string& name, Integrator& out) {
+	for (int i = 0; i < IntegratorCount; i++) {
+		if (name == IntegratorRegistry[i].name) {
+			out = (Integrator)i;
+			return true;
+		}
+	}
+	return false;
+}
+
+void PhysicsSystem::update(float dt) {
+	if (dt <= 0.0f) return;
+
+	//Fast bodies are swept along their velocity so the broadphase pairs them with
+	//everything they may reach this step
+	if (continuousCollisionEnabled) continuousCollision.predict(bodies, dt);
+	else continuousCollision.clear(bodies);
+	UpdateBroadphase();
+	narrowphase.collide(bodies, CollisionPairs());
+	UpdateIslands();
+	m_islandsCurrent = true;
+	//Joint state picks up the last step's contact impulses and pushes before anything moves
+	if (articulation.size() > 0) articulation.gather(bodies);
+	(this->*IntegratorRegistry[integrator].step)(dt);
+	IntegrateRotation(dt);
+	//Links are moved as free bodies above, then put back on their joints
+	if (articulation.size() > 0) articulation.step(bodies, dt);
+	contactSolver.solve(bodies, Contacts(), islands, dt, integrator == Verlet);
+	if (continuousCollisionEnabled) continuousCollision.solve(bodies, CollisionPairs(), dt, integrator == Verlet);
+	m_lastDt = dt;
+
+	if (sleepEnabled) UpdateSleep();
+	m_islandsCurrent = false;
+}
+
+void PhysicsSystem::UpdateBroadphase() {
+	switch (broadphase) {
+	case SweepPrune:
+		if (m_lastBroadphase != SweepPrune) sweepAndPrune.reset();
+		sweepAndPrune.build(bodies);
+		break;
+	case Bvh:
+		if (m_lastBroadphase != Bvh) bvh.reset();
+		bvh.build(bodies);
+		break;
+	default:
+		hashGrid.build(bodies);
+		break;
+	}
+	m_lastBroadphase = broadphase;
+}
+
+const std::vector<BodyPair>& PhysicsSystem::CollisionPairs() const {
+	switch (broadphase) {
+	case SweepPrune: return sweepAndPrune.pairs();
+	case Bvh: return bvh.pairs();
+	default: return hashGrid.pairs();
+	}
+}
+
+//Jointed boxes usually overlap at the joint, and the joint already keeps them together
+const std::vector<ContactManifold>& PhysicsSystem::Contacts() {
+	const std::vector<ContactManifold>& all = narrowphase.manifolds();
+	if (articulation.size() == 0) return all;
+	m_contacts.clear();
+	for (size_t m = 0; m < all.size(); m++) {
+		if (!articulation.jointed(all[m].a, all[m].b)) m_contacts.push_back(all[m]);
+	}
+	return m_contacts;
+}
+
+void PhysicsSystem::UpdateIslands() {
+	islands.reset(bodies);
+	for (int s = 0; s < springs.size(); s++) {
+		islands.link(springs.bodyA[s], springs.bodyB[s]);
+	}
+	const std::vector<BodyPair>& pairs = CollisionPairs();
+	for (size_t p = 0; p < pairs.size(); p++) {
+		islands.link(pairs[p].a, pairs[p].b);
+	}
+	//An articulation sleeps and wakes tree by tree
+	for (int l = 0; l < articulation.size(); l++) {
+		if (articulation.parent(l) >= 0) islands.link(articulation.body(articulation.parent(l)), articulation.body(l));
+	}
+	//The fluid sleeps and wakes as one body of water
+	for (int p = 1; p < fluid.size(); p++) {
+		islands.link(fluid.particles[p - 1], fluid.particles[p]);
+	}
+	for (int e = 0; e < softBody.size(); e++) {
+		for (int k = 1; k < 4; k++) islands.link(softBody.corner[0][e], softBody.corner[k][e]);
+	}
+	islands.finish(springs.bodyA, springs.bodyB);
+}
+
+void PhysicsSystem::ComputeForces() {
+	bodies.clearForces();
+	ComputeGravity();
+	ComputeDrag();
+	ComputeSprings();
+	ComputeFluid();
+	ComputeSoftBody();
+}
+
+//Every scheme leaves the position from the start of the step in oldPos
+template <typename Policy>
+void PhysicsSystem::Step(float dt) {
+	static_assert(Policy::Stages >= 1 && Policy::Stages <= 4, "IntegrateStage dispatch covers up to 4 stages");
+
+	Integrators::StepContext context;
+	context.dt = dt;
+	context.dtRatio = m_lastDt > 0.0f ? dt / m_lastDt : 1.0f;
+
+	const int slots = bodies.capacity();
+	m_startPos.resize(slots);
+	m_startVel.resize(slots);
+	m_accumPos.resize(slots);
+	m_accumVel.resize(slots);
+
+	Vec3Stream& pos = bodies.currPos;
+	Vec3Stream& vel = bodies.velocity;
+	bodies.forEachActive([&](int i) {
+		m_startPos.x[i] = pos.x[i];
+		m_startPos.y[i] = pos.y[i];
+		m_startPos.z[i] = pos.z[i];
+		m_startVel.x[i] = vel.x[i];
+		m_startVel.y[i] = vel.y[i];
+		m_startVel.z[i] = vel.z[i];
+		Policy::Begin(context, m_startPos.x[i], m_startVel.x[i], pos.x[i], vel.x[i]);
+		Policy::Begin(context, m_startPos.y[i], m_startVel.y[i], pos.y[i], vel.y[i]);
+		Policy::Begin(context, m_startPos.z[i], m_startVel.z[i], pos.z[i], vel.z[i]);
+	});
+
+	for (int k = 0; k < Policy::Stages; k++) {
+		ComputeForces();
+		switch (k) {
+		case 0: IntegrateStage<Policy, 0>(context); break;
+		case 1: IntegrateStage<Policy, 1>(context); break;
+		case 2: IntegrateStage<Policy, 2>(context); break;
+		case 3: IntegrateStage<Policy, 3>(context); break;
+		}
+	}
+
+	Vec3Stream& old = bodies.oldPos;
+	bodies.forEachActive([&](int i) {
+		old.x[i] = m_startPos.x[i];
+		old.y[i] = m_startPos.y[i];
+		old.z[i] = m_startPos.z[i];
+	});
+}
+
+template <typename Policy, int K>
+void PhysicsSystem::IntegrateStage(const Integrators::StepContext& context) {
+	float* px = bodies.currPos.x.data();
+	float* py = bodies.currPos.y.data();
+	float* pz = bodies.currPos.z.data();
+	float* vx = bodies.velocity.x.data();
+	float* vy = bodies.velocity.y.data();
+	float* vz = bodies.velocity.z.data();
+	const float* ox = bodies.oldPos.x.data();
+	const float* oy = bodies.oldPos.y.data();
+	const float* oz = bodies.oldPos.z.data();
+	const float* sx = m_startPos.x.data();
+	const float* sy = m_startPos.y.data();
+	const float* sz = m_startPos.z.data();
+	const float* svx = m_startVel.x.data();
+	const float* svy = m_startVel.y.data();
+	const float* svz = m_startVel.z.data();
+	const float* fx = bodies.force.x.data();
+	const float* fy = bodies.force.y.data();
+	const float* fz = bodies.force.z.data();
+	const float* invMass = bodies.inverseMass.data();
+	float* ax = m_accumPos.x.data();
+	float* ay = m_accumPos.y.data();
+	float* az = m_accumPos.z.data();
+	float* avx = m_accumVel.x.data();
+	float* avy = m_accumVel.y.data();
+	float* avz = m_accumVel.z.data();
+
+	bodies.forEachActive([&](int i) {
+		Policy::template Stage<K>(context, sx[i], svx[i], ox[i], px[i], vx[i], fx[i] * invMass[i], ax[i], avx[i]);
+		Policy::template Stage<K>(context, sy[i], svy[i], oy[i], py[i], vy[i], fy[i] * invMass[i], ay[i], avy[i]);
+		Policy::template Stage<K>(context, sz[i], svz[i], oz[i], pz[i], vz[i], fz[i] * invMass[i], az[i], avz[i]);
+	});
+}
+
+//Islands sleep and wake as a unit, so a rig never has bodies frozen while still being
+//pulled by awake neighbours
+void PhysicsSystem::UpdateSleep() {
+	const float limit = sleepSpeed * sleepSpeed;
+	const float* vx = bodies.velocity.x.data();
+	const float* vy = bodies.velocity.y.data();
+	const float* vz = bodies.velocity.z.data();
+	const float* wx = bodies.angularVelocity.x.data();
+	const float* wy = bodies.angularVelocity.y.data();
+	const float* wz = bodies.angularVelocity.z.data();
+	const float* invMass = bodies.inverseMass.data();
+	int* rest = bodies.restSteps.data();
+
+	bodies.forEachActive([&](int i) {
+		if (invMass[i] == 0.0f) return;
+		if (vx[i] * vx[i] + vy[i] * vy[i] + vz[i] * vz[i] > limit ||
+			wx[i] * wx[i] + wy[i] * wy[i] + wz[i] * wz[i] > limit) rest[i] = 0;
+		else if (rest[i] < sleepSteps) rest[i]++;
+	});
+
+	const std::vector<int>& start = islands.bodyStart();
+	const std::vector<int>& members = islands.bodies();
+	for (int n = 0; n < islands.count(); n++) {
+		bool awake = false;
+		bool sleeping = false;
+		bool resting = true;
+		for (int k = start[n]; k < start[n + 1]; k++) {
+			const int i = members[k];
+			if (bodies.isSleeping(i)) {
+				sleeping = true;
+			}
+			else {
+				awake = true;
+				if (rest[i] < sleepSteps) resting = false;
+			}
+		}
+		if (!awake) continue;
+
+		if (resting) {
+			for (int k = start[n]; k < start[n + 1]; k++) bodies.sleep(members[k]);
+		}
+		else if (sleeping) {
+			for (int k = start[n]; k < start[n + 1]; k++) bodies.wake(members[k]);
+		}
+	}
+}
+
+//Every integrator shares this semi-implicit Euler step for rotation: torque from the last
+//force evaluation updates the angular velocity, which then turns the orientation. The
+//gyroscopic term is left out; it is small for the near-symmetric boxes simulated here.
+//Like the force kernels this runs densely over active ranges. Static bodies have zero
+//inverse inertia and sleeping ones zero angular velocity, so both come out unchanged.
+void PhysicsSystem::IntegrateRotation(float dt) {
+	QuatStream& q = bodies.orientation;
+	QuatStream& old = bodies.oldOrientation;
+	Vec3Stream& w = bodies.angularVelocity;
+	SymMat3Stream& inertia = bodies.inverseInertiaWorld;
+	bodies.forEachActiveRange([&](int begin, int end) {
+		std::copy(q.x.begin() + begin, q.x.begin() + end, old.x.begin() + begin);
+		std::copy(q.y.begin() + begin, q.y.begin() + end, old.y.begin() + begin);
+		std::copy(q.z.begin() + begin, q.z.begin() + end, old.z.begin() + begin);
+		std::copy(q.w.begin() + begin, q.w.begin() + end, old.w.begin() + begin);
+		const int count = end - begin;
+		RotationKernels::AngularVelocity(bodies.torque.x.data() + begin, bodies.torque.y.data() + begin, bodies.torque.z.data() + begin,
+			inertia.xx.data() + begin, inertia.yy.data() + begin, inertia.zz.data() + begin,
+			inertia.xy.data() + begin, inertia.xz.data() + begin, inertia.yz.data() + begin,
+			w.x.data() + begin, w.y.data() + begin, w.z.data() + begin, count, dt, kernelMode);
+		RotationKernels::Orientation(w.x.data() + begin, w.y.data() + begin, w.z.data() + begin,
+			q.x.data() + begin, q.y.data() + begin, q.z.data() + begin, q.w.data() + begin, count, dt, kernelMode);
+		RotationKernels::WorldInverseInertia(q.x.data() + begin, q.y.data() + begin, q.z.data() + begin, q.w.data() + begin,
+			bodies.inverseInertia.x.data() + begin, bodies.inverseInertia.y.data() + begin, bodies.inverseInertia.z.data() + begin,
+			inertia.xx.data() + begin, inertia.yy.data() + begin, inertia.zz.data() + begin,
+			inertia.xy.data() + begin, inertia.xz.data() + begin, inertia.yz.data() + begin, count, kernelMode);
+	});
+}
+
+void PhysicsSystem::StepImplicit(float dt) {
+	ComputeForces();
+	implicitSolver.step(bodies, springs, dragCoefficient, dt);
+}
+
+//Springs are constraints here, so they are left out of the forces. The rest are evaluated
+//once and held over the substeps.
+void PhysicsSystem::StepPositionBased(float dt) {
+	bodies.clearForces();
+	ComputeGravity();
+	ComputeDrag();
+	ComputeFluid();
+	ComputeSoftBody();
+	xpbd.step(bodies, springs, dt);
+}
+
+//As StepPositionBased, the springs are handled by the solver itself
+void PhysicsSystem::StepProjective(float dt) {
+	bodies.clearForces();
+	ComputeGravity();
+	ComputeDrag();
+	ComputeFluid();
+	ComputeSoftBody();
+	projectiveSolver.step(bodies, springs, dt);
+}
+
+//The force kernels run densely over each run of words holding an active body. Inactive
+//slots inside those runs get forces too, but the integrator never reads them.
+void PhysicsSystem::ComputeGravity() {
+	if (gravity == MutualGravity) {
+		barnesHut.apply(bodies);
+		return;
+	}
+	if (gravity == MeshGravity) {
+		particleMesh.apply(bodies);
+		return;
+	}
+	bodies.forEachActiveRange([&](int begin, int end) {
+		ForceKernels::Gravity(bodies.mass.data() + begin, bodies.force.y.data() + begin, end - begin, -9.81f, kernelMode);
+	});
+}
+
+void PhysicsSystem::ComputeDrag() {
+	bodies.forEachActiveRange([&](int begin, int end) {
+		ForceKernels::Drag(bodies.velocity.x.data() + begin, bodies.velocity.y.data() + begin, bodies.velocity.z.data() + begin,
+			bodies.force.x.data() + begin, bodies.force.y.data() + begin, bodies.force.z.data() + begin,
+			end - begin, dragCoefficient, kernelMode);
+		ForceKernels::Drag(bodies.angularVelocity.x.data() + begin, bodies.angularVelocity.y.data() + begin, bodies.angularVelocity.z.data() + begin,
+			bodies.torque.x.data() + begin, bodies.torque.y.data() + begin, bodies.torque.z.data() + begin,
+			end - begin, angularDragCoefficient, kernelMode);
+	});
+}
+
+void PhysicsSystem::ComputeSprings() {
+	springs.apply(bodies, kernelMode, m_islandsCurrent ? &islands : nullptr);
+}
+
+void PhysicsSystem::ComputeFluid() {
+	if (fluid.size() > 0) fluid.apply(bodies);
+}
+
+void PhysicsSystem::ComputeSoftBody() {
+	if (softBody.size() > 0) softBody.apply(bodies);
+}
@@ -0,0 +1,161 @@
+#pragma once
+#include "Globals.h"
+#include "BodyStore.h"
+#include "SpringNetwork.h"
+#include "ImplicitSolver.h"
+#include "XpbdSolver.h"
+#include "ProjectiveSolver.h"
+#include "IslandGraph.h"
+#include "SpatialHashGrid.h"
+#include "SweepAndPrune.h"
+#include "BvhBroadphase.h"
+#include "BoxNarrowphase.h"
+#include "ContactSolver.h"
+#include "ContinuousCollision.h"
+#include "BarnesHut.h"
+#include "ParticleMesh.h"
+#include "SphFluid.h"
+#include "SoftBody.h"
+#include "Articulation.h"
+#include "Integrators.h"
+
+class PhysicsSystem {
+public:
+	//Stepping schemes, see Integrators.h. Each maps to a step function compiled for that
+	//scheme, so the choice costs one indirect call per step and nothing per body.
+	enum Integrator {
+		ExplicitEuler,
+		SemiImplicitEuler,
+		Leapfrog,
+		RK4,
+		//Stormer-Verlet: stable for undamped springs up to dt < 2 / omega, where explicit
+		//Euler gains energy at any dt
+		Verlet,
+		//Linearized backward Euler through ImplicitSolver. Stable for stiff springs at
+		//frame-sized steps, at the cost of one sparse solve per step.
+		BackwardEuler,
+		//Springs as compliant distance constraints through xpbd. Stable at any stiffness
+		//with a fixed cost per step set by its substeps and iterations.
+		PositionBased,
+		//Projective dynamics through projectiveSolver: local spring projections against a
+		//global matrix factored once per topology, so stiff cloth costs a few solves per step
+		ProjectiveDynamics,
+		IntegratorCount
+	};
+
+	struct IntegratorEntry {
+		const char* name;
+		void (PhysicsSystem::*step)(float dt);
+	};
+	static const IntegratorEntry IntegratorRegistry[IntegratorCount];
+	//Looks an integrator up by its registry name, e.g. "RK4". Returns false if unknown.
+	static bool FindIntegrator(const std::string& name, Integrator& out);
+
+	//Broadphases produce the same pairs and can be swapped at any time for comparison
+	enum Broadphase {
+		//Rebuilt every step; best for many boxes of similar size
+		HashGrid,
+		//Persistent and incremental; best for coherent motion and mixed box sizes
+		SweepPrune,
+		//Dynamic AABB tree; also serves ray and frustum queries through bvh.tree
+		Bvh
+	};
+
+	//Field applied by ComputeGravity
+	enum Gravity {
+		//Constant downward pull of 9.81
+		UniformGravity,
+		//Every massive body attracts every other, through barnesHut. Replaces the uniform field.
+		MutualGravity,
+		//Long-range mutual attraction on a periodic grid, through particleMesh. Faster than
+		//the tree for very many bodies, but smoothed over a couple of grid cells.
+		MeshGravity
+	};
+
+	void update(float dt);
+
+	//Candidate pairs from the selected broadphase as of the last update()
+	const std::vector<BodyPair>& CollisionPairs() const;
+
+	//Clears the force accumulators and runs every force generator
+	void ComputeForces();
+	void ComputeGravity();
+	void ComputeDrag();
+	void ComputeSprings();
+	void ComputeFluid();
+	void ComputeSoftBody();
+
+	BodyStore bodies;
+	SpringNetwork springs;
+	//Fluid particles are bodies too; their pressure and viscosity forces join the others
+	SphFluid fluid;
+	//Tetrahedral finite elements over bodies; their elastic forces join the others
+	SoftBody softBody;
+	//Jointed trees of bodies, moved in joint space after the integrator and before contacts
+	Articulation articulation;
+	//ScalarReference gives bit-identical results to the SIMD kernels, for testing
+	ForceKernels::Mode kernelMode = ForceKernels::Vectorized;
+	Integrator integrator = ExplicitEuler;
+	ImplicitSolver implicitSolver;
+	XpbdSolver xpbd;
+	ProjectiveSolver projectiveSolver;
+	Gravity gravity = UniformGravity;
+	BarnesHut barnesHut;
+	ParticleMesh particleMesh;
+	//Run at the start of every update(). Overlapping boxes join islands, so a moving
+	//body wakes whatever it touches.
+	Broadphase broadphase = HashGrid;
+	SpatialHashGrid hashGrid;
+	SweepAndPrune sweepAndPrune;
+	BvhBroadphase bvh;
+	//Box contacts for the broadphase pairs, refreshed every update()
+	BoxNarrowphase narrowphase;
+	//Resolves the narrowphase contacts after the integrator, island by island
+	ContactSolver contactSolver;
+	//Catches bodies that would move through something within one step; only bodies moving
+	//a good part of their own size per step are swept and checked
+	bool continuousCollisionEnabled = true;
+	ContinuousCollision continuousCollision;
+	//Rebuilt at the start of every update()
+	IslandGraph islands;
+
+	//An island whose bodies have all been slower than sleepSpeed for sleepSteps consecutive
+	//steps is put to sleep and skipped by force accumulation and integration. Any awake,
+	//moving body in an island wakes the rest of it.
+	bool sleepEnabled = true;
+	float sleepSpeed = 0.05f;
+	int sleepSteps = 60;
+private:
+	void UpdateBroadphase();
+	void UpdateIslands();
+	void UpdateSleep();
+	//Narrowphase manifolds without those between a link and its parent
+	const std::vector<ContactManifold>& Contacts();
+	void IntegrateRotation(float dt);
+
+	template <typename Policy>
+	void Step(float dt);
+	template <typename Policy, int K>
+	void IntegrateStage(const Integrators::StepContext& context);
+	void StepImplicit(float dt);
+	void StepPositionBased(float dt);
+	void StepProjective(float dt);
+
+	//Start-of-step state and stage accumulators for the explicit schemes
+	Vec3Stream m_startPos;
+	Vec3Stream m_startVel;
+	Vec3Stream m_accumPos;
+	Vec3Stream m_accumVel;
+
+	std::vector<ContactManifold> m_contacts;
+
+	//Islands are only current during update(); direct ComputeSprings() calls ignore them
+	bool m_islandsCurrent = false;
+
+	//Persistent broadphases go stale while another one is in use
+	Broadphase m_lastBroadphase = HashGrid;
+
+	float dragCoefficient = 0.5f;
+	float angularDragCoefficient = 0.05f;
+	float m_lastDt = 0.0f;
+};
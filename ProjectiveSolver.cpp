@@ -0,0 +1,231 @@
+#include "ProjectiveSolver.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cmath>
+
+static const int ChunkSize = 2048;
+//Nested dissection stops splitting below this many bodies
+static const int LeafSize = 8;
+
+void ProjectiveSolver::step(BodyStore& bodies, SpringNetwork& springs, float dt) {
+	const int slots = bodies.capacity();
+	springs.updateAdjacency(slots);
+	bool rebuild = m_dirty || dt != m_dt || springs.topologyVersion() != m_topologyVersion || (int)m_row.size() != slots;
+	if (!rebuild && bodies.activeVersion() != m_activeVersion) rebuild = freeSetChanged(bodies, springs);
+	m_activeVersion = bodies.activeVersion();
+	if (rebuild) {
+		order(bodies, springs);
+		factor(bodies, springs, dt);
+		m_dirty = false;
+		m_dt = dt;
+		m_topologyVersion = springs.topologyVersion();
+	}
+
+	float* px = bodies.currPos.x.data();
+	float* py = bodies.currPos.y.data();
+	float* pz = bodies.currPos.z.data();
+	Vec3Stream& old = bodies.oldPos;
+	Vec3Stream& vel = bodies.velocity;
+	const Vec3Stream& force = bodies.force;
+	const float* invMass = bodies.inverseMass.data();
+	const float h = dt;
+	//A semi-implicit Euler step, which for the bodies in the system is the inertial
+	//prediction y = x + h v + h^2 f / m and the first guess
+	bodies.forEachActive([&](int i) {
+		old.x[i] = px[i];
+		old.y[i] = py[i];
+		old.z[i] = pz[i];
+		vel.x[i] += force.x[i] * invMass[i] * h;
+		vel.y[i] += force.y[i] * invMass[i] * h;
+		vel.z[i] += force.z[i] * invMass[i] * h;
+		px[i] += vel.x[i] * h;
+		py[i] += vel.y[i] * h;
+		pz[i] += vel.z[i] * h;
+	});
+
+	const int n = (int)m_body.size();
+	if (n == 0) return;
+	m_predictX.resize(n);
+	m_predictY.resize(n);
+	m_predictZ.resize(n);
+	m_rhs.resize(3 * n);
+	for (int k = 0; k < n; k++) {
+		const int b = m_body[k];
+		m_predictX[k] = px[b];
+		m_predictY[k] = py[b];
+		m_predictZ[k] = pz[b];
+	}
+
+	ThreadPool& pool = ThreadPool::Global();
+	const std::vector<int>& start = springs.adjacencyStart();
+	const std::vector<int>& adjacentSprings = springs.adjacencySprings();
+	const std::vector<int>& adjacentBodies = springs.adjacencyBodies();
+	for (int it = 0; it < iterations; it++) {
+		//Local step: each spring at body b is projected to its rest length along b's side
+		//of it, k r (x_b - x_o) / |x_b - x_o|. Both ends see the same spring, so the
+		//projection is done twice rather than written to shared data.
+		pool.parallelFor(n, ChunkSize, [&](int begin, int end) {
+			for (int k = begin; k < end; k++) {
+				const int b = m_body[k];
+				double sx = m_inertia[k] * m_predictX[k];
+				double sy = m_inertia[k] * m_predictY[k];
+				double sz = m_inertia[k] * m_predictZ[k];
+				for (int p = start[b]; p < start[b + 1]; p++) {
+					const int s = adjacentSprings[p];
+					const int o = adjacentBodies[p];
+					const float stiffness = springs.stiffness[s];
+					if (stiffness <= 0.0f || o == b) continue;
+					const float dx = px[b] - px[o];
+					const float dy = py[b] - py[o];
+					const float dz = pz[b] - pz[o];
+					const float length = std::sqrt(dx * dx + dy * dy + dz * dz);
+					if (length > 0.0f) {
+						const double scale = (double)stiffness * springs.restLength[s] / length;
+						sx += scale * dx;
+						sy += scale * dy;
+						sz += scale * dz;
+					}
+					//A pinned end is a known position, so it moves to the right hand side
+					if (m_row[o] < 0) {
+						sx += (double)stiffness * px[o];
+						sy += (double)stiffness * py[o];
+						sz += (double)stiffness * pz[o];
+					}
+				}
+				m_rhs[3 * k] = sx;
+				m_rhs[3 * k + 1] = sy;
+				m_rhs[3 * k + 2] = sz;
+			}
+		});
+
+		//Global step
+		m_factor.solve(m_rhs.data());
+		pool.parallelFor(n, ChunkSize, [&](int begin, int end) {
+			for (int k = begin; k < end; k++) {
+				const int b = m_body[k];
+				px[b] = (float)m_rhs[3 * k];
+				py[b] = (float)m_rhs[3 * k + 1];
+				pz[b] = (float)m_rhs[3 * k + 2];
+			}
+		});
+	}
+
+	const float inverseH = 1.0f / h;
+	for (int k = 0; k < n; k++) {
+		const int b = m_body[k];
+		vel.x[b] = (px[b] - old.x[b]) * inverseH;
+		vel.y[b] = (py[b] - old.y[b]) * inverseH;
+		vel.z[b] = (pz[b] - old.z[b]) * inverseH;
+	}
+}
+
+//Free bodies on at least one spring make up the system; a sleep or wake elsewhere in the
+//scene leaves it alone
+bool ProjectiveSolver::freeSetChanged(const BodyStore& bodies, const SpringNetwork& springs) {
+	const std::vector<int>& start = springs.adjacencyStart();
+	int count = 0;
+	bool changed = false;
+	bodies.forEachActive([&](int i) {
+		if (changed || bodies.inverseMass[i] <= 0.0f || start[i] == start[i + 1]) return;
+		if (m_row[i] < 0) changed = true;
+		count++;
+	});
+	return changed || count != (int)m_body.size();
+}
+
+void ProjectiveSolver::order(const BodyStore& bodies, const SpringNetwork& springs) {
+	const int slots = bodies.capacity();
+	const std::vector<int>& start = springs.adjacencyStart();
+	m_scratch.clear();
+	bodies.forEachActive([&](int i) {
+		if (bodies.inverseMass[i] > 0.0f && start[i] != start[i + 1]) m_scratch.push_back(i);
+	});
+	m_tag.assign(slots, -1);
+	m_nextTag = 0;
+	m_body.clear();
+	dissect(bodies, springs, 0, (int)m_scratch.size());
+
+	m_row.assign(slots, -1);
+	for (int k = 0; k < (int)m_body.size(); k++) m_row[m_body[k]] = k;
+}
+
+//Splitting at the median of the longest side cuts a cloth or rope across its narrowest
+//part, so the separator, eliminated last, is a thin band and each half fills in only
+//within itself
+void ProjectiveSolver::dissect(const BodyStore& bodies, const SpringNetwork& springs, int begin, int end) {
+	if (end - begin <= LeafSize) {
+		m_body.insert(m_body.end(), m_scratch.begin() + begin, m_scratch.begin() + end);
+		return;
+	}
+	glm::vec3 lo = bodies.currPos.get(m_scratch[begin]);
+	glm::vec3 hi = lo;
+	for (int k = begin + 1; k < end; k++) {
+		const glm::vec3 p = bodies.currPos.get(m_scratch[k]);
+		lo = glm::min(lo, p);
+		hi = glm::max(hi, p);
+	}
+	const glm::vec3 size = hi - lo;
+	const AlignedVector<float>& axis = size.x >= size.y && size.x >= size.z ? bodies.currPos.x : (size.y >= size.z ? bodies.currPos.y : bodies.currPos.z);
+	const int mid = begin + (end - begin) / 2;
+	std::nth_element(m_scratch.begin() + begin, m_scratch.begin() + mid, m_scratch.begin() + end, [&](int a, int b) {
+		return axis[a] < axis[b] || (axis[a] == axis[b] && a < b);
+	});
+
+	const int tag = m_nextTag++;
+	for (int k = begin; k < mid; k++) m_tag[m_scratch[k]] = tag;
+	const std::vector<int>& start = springs.adjacencyStart();
+	const std::vector<int>& adjacentBodies = springs.adjacencyBodies();
+	int split = end;
+	for (int k = mid; k < split;) {
+		const int b = m_scratch[k];
+		bool boundary = false;
+		for (int p = start[b]; p < start[b + 1] && !boundary; p++) boundary = m_tag[adjacentBodies[p]] == tag;
+		if (boundary) std::swap(m_scratch[k], m_scratch[--split]);
+		else k++;
+	}
+
+	dissect(bodies, springs, begin, mid);
+	dissect(bodies, springs, mid, split);
+	m_body.insert(m_body.end(), m_scratch.begin() + split, m_scratch.begin() + end);
+}
+
+//Column k holds the diagonal m / h^2 + sum k_s, then -k_s for each spring to an earlier row
+void ProjectiveSolver::factor(const BodyStore& bodies, const SpringNetwork& springs, float h) {
+	const std::vector<int>& start = springs.adjacencyStart();
+	const std::vector<int>& adjacentSprings = springs.adjacencySprings();
+	const std::vector<int>& adjacentBodies = springs.adjacencyBodies();
+	const int n = (int)m_body.size();
+	m_inertia.resize(n);
+	m_columnStart.assign(1, 0);
+	m_rows.clear();
+	m_values.clear();
+	for (int k = 0; k < n; k++) {
+		const int b = m_body[k];
+		m_inertia[k] = 1.0 / ((double)bodies.inverseMass[b] * h * h);
+		const int diagonal = (int)m_rows.size();
+		m_rows.push_back(k);
+		m_values.push_back(m_inertia[k]);
+		for (int p = start[b]; p < start[b + 1]; p++) {
+			const int o = adjacentBodies[p];
+			const float stiffness = springs.stiffness[adjacentSprings[p]];
+			if (stiffness <= 0.0f || o == b) continue;
+			m_values[diagonal] += stiffness;
+			const int row = m_row[o];
+			if (row >= 0 && row < k) {
+				m_rows.push_back(row);
+				m_values.push_back(-stiffness);
+			}
+		}
+		m_columnStart.push_back((int)m_rows.size());
+	}
+
+	m_factor.analyze(n, m_columnStart, m_rows);
+	m_factorizations++;
+	if (!m_factor.factor(m_columnStart, m_rows, m_values)) {
+		//Only a NaN mass or stiffness gets here; leave every body to the explicit step
+		m_body.clear();
+		std::fill(m_row.begin(), m_row.end(), -1);
+		m_columnStart.assign(1, 0);
+		m_factor.analyze(0, m_columnStart, m_rows);
+	}
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include "Globals.h"
+#include "BodyStore.h"
+#include "SpringNetwork.h"
+#include "SparseCholesky.h"
+#include <vector>
+
+//Projective dynamics (Bouaziz et al. 2014) for the spring network.
+//
+//Each spring's energy is the distance of its stretch from the nearest rest-length
+//configuration, so a step minimizes inertia plus those distances by alternating
+//	- a local step, projecting every spring onto its rest length along its current
+//	  direction. Done per body over the CSR adjacency, in parallel on the thread pool,
+//	  and fused into the right hand side it feeds.
+//	- a global step, solving (M / h^2 + L) x = M / h^2 y + sum k p for the new positions,
+//	  with L the stiffness-weighted graph Laplacian and y the inertial prediction
+//The global matrix depends only on the masses, the stiffnesses, dt and which bodies are
+//free, so it is the same for all three axes and every iteration. It is ordered by
+//geometric nested dissection and factored once into a SparseCholesky; a step after that
+//costs iterations back-substitutions. The factor is redone when the spring topology, the
+//set of free bodies or dt changes; call invalidate() after editing masses or stiffnesses.
+//
+//Bodies on no spring take a semi-implicit Euler step. Static and sleeping bodies pin the
+//springs they end. The energy has no spring damping term, so SpringNetwork::damping is
+//ignored; drag still acts as an external force. Like backward Euler, the method loses
+//energy rather than gain it. Any stiffness is stable, but the local/global alternation
+//converges slowly once springs are far stiffer than m / h^2: a very stiff rope then keeps
+//its length but swings as if through syrup unless given many iterations.
+class ProjectiveSolver {
+public:
+	//Advances every active body by dt. bodies.force must already hold the forces other than
+	//the springs.
+	void step(BodyStore& bodies, SpringNetwork& springs, float dt);
+	//Forces a new factorization on the next step
+	void invalidate() { m_dirty = true; }
+
+	//Local/global passes per step
+	int iterations = 10;
+
+	//Bodies in the global system, and entries of its factor below the diagonal
+	int systemSize() const { return m_factor.size(); }
+	int factorNonZeros() const { return m_factor.nonZeros(); }
+	//Number of factorizations so far; one per topology or dt change when all is well
+	int factorizations() const { return m_factorizations; }
+private:
+	//True if the bodies that would enter the system are not those of the current factor
+	bool freeSetChanged(const BodyStore& bodies, const SpringNetwork& springs);
+	void order(const BodyStore& bodies, const SpringNetwork& springs);
+	//Appends m_scratch[begin, end) to m_body: left half, right half, then the right bodies
+	//adjacent to the left half
+	void dissect(const BodyStore& bodies, const SpringNetwork& springs, int begin, int end);
+	void factor(const BodyStore& bodies, const SpringNetwork& springs, float h);
+
+	SparseCholesky m_factor;
+	bool m_dirty = true;
+	unsigned int m_topologyVersion = ~0u;
+	unsigned int m_activeVersion = ~0u;
+	float m_dt = 0.0f;
+	int m_factorizations = 0;
+
+	//Body of each system row in elimination order, and the row of each body (-1 if none)
+	std::vector<int> m_body;
+	std::vector<int> m_row;
+	//Scratch for the ordering: bodies to place, and the call that last tagged each body
+	std::vector<int> m_scratch;
+	std::vector<int> m_tag;
+	int m_nextTag = 0;
+
+	//Upper triangle of the global matrix by column in elimination order
+	std::vector<int> m_columnStart;
+	std::vector<int> m_rows;
+	std::vector<double> m_values;
+
+	//Per row: m / h^2 and the inertial prediction
+	std::vector<double> m_inertia;
+	std::vector<float> m_predictX, m_predictY, m_predictZ;
+	//Right hand side and then solution, x y z interleaved per row
+	std::vector<double> m_rhs;
+};
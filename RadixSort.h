@@ -0,0 +1,76 @@
+#pragma once
+#include "ThreadPool.h"
+#include <algorithm>
+#include <vector>
+
+//Parallel LSD radix sort of integer keys carrying an int payload, one 8-bit digit per pass.
+//Each fixed-size chunk counts its digits, a serial scan turns the counts into per-chunk
+//output offsets, and each chunk scatters in order. The sort is stable, so equal keys keep
+//their input order, and the result does not depend on the thread count. Digits every key
+//shares are skipped.
+namespace RadixSort {
+	enum {
+		Bits = 8,
+		Buckets = 1 << Bits,
+		Chunk = 16384
+	};
+
+	//Scratch space reused between sorts
+	template <typename Key>
+	struct Buffers {
+		std::vector<Key> keys;
+		std::vector<int> values;
+		std::vector<int> chunkDigits;
+	};
+
+	//Sorts by the low keyBits bits of each key
+	template <typename Key>
+	void SortPairs(std::vector<Key>& keys, std::vector<int>& values, int keyBits, Buffers<Key>& scratch) {
+		ThreadPool& pool = ThreadPool::Global();
+		const int count = (int)keys.size();
+		const int chunks = (count + Chunk - 1) / Chunk;
+		scratch.chunkDigits.resize(chunks * Buckets);
+		scratch.keys.resize(count);
+		scratch.values.resize(count);
+
+		for (int shift = 0; shift < keyBits; shift += Bits) {
+			pool.parallelFor(chunks, 1, [&](int first, int last) {
+				for (int c = first; c < last; c++) {
+					int* digits = &scratch.chunkDigits[c * Buckets];
+					std::fill(digits, digits + Buckets, 0);
+					for (int k = c * Chunk; k < std::min((c + 1) * Chunk, count); k++) digits[(keys[k] >> shift) & (Buckets - 1)]++;
+				}
+			});
+
+			int offset = 0;
+			bool shared = false;
+			for (int d = 0; d < Buckets; d++) {
+				int sum = 0;
+				for (int c = 0; c < chunks; c++) sum += scratch.chunkDigits[c * Buckets + d];
+				if (sum == count) {
+					shared = true;
+					break;
+				}
+				for (int c = 0; c < chunks; c++) {
+					const int n = scratch.chunkDigits[c * Buckets + d];
+					scratch.chunkDigits[c * Buckets + d] = offset;
+					offset += n;
+				}
+			}
+			if (shared) continue;
+
+			pool.parallelFor(chunks, 1, [&](int first, int last) {
+				for (int c = first; c < last; c++) {
+					int* cursor = &scratch.chunkDigits[c * Buckets];
+					for (int k = c * Chunk; k < std::min((c + 1) * Chunk, count); k++) {
+						const int slot = cursor[(keys[k] >> shift) & (Buckets - 1)]++;
+						scratch.keys[slot] = keys[k];
+						scratch.values[slot] = values[k];
+					}
+				}
+			});
+			keys.swap(scratch.keys);
+			values.swap(scratch.values);
+		}
+	}
+}
@@ -0,0 +1,138 @@
+#include "RotationKernels.h"
+#include "KernelOps.h"
+
+template <typename Ops>
+static inline void AngularVelocityAt(int i, const float* tx, const float* ty, const float* tz,
+	const float* ixx, const float* iyy, const float* izz, const float* ixy, const float* ixz, const float* iyz,
+	float* wx, float* wy, float* wz, float dt) {
+	typedef typename Ops::T T;
+	const T x = Ops::Load(tx + i);
+	const T y = Ops::Load(ty + i);
+	const T z = Ops::Load(tz + i);
+	const T xx = Ops::Load(ixx + i);
+	const T yy = Ops::Load(iyy + i);
+	const T zz = Ops::Load(izz + i);
+	const T xy = Ops::Load(ixy + i);
+	const T xz = Ops::Load(ixz + i);
+	const T yz = Ops::Load(iyz + i);
+	const T h = Ops::Set1(dt);
+	const T ax = Ops::Add(Ops::Add(Ops::Mul(xx, x), Ops::Mul(xy, y)), Ops::Mul(xz, z));
+	const T ay = Ops::Add(Ops::Add(Ops::Mul(xy, x), Ops::Mul(yy, y)), Ops::Mul(yz, z));
+	const T az = Ops::Add(Ops::Add(Ops::Mul(xz, x), Ops::Mul(yz, y)), Ops::Mul(zz, z));
+	Ops::Store(wx + i, Ops::Add(Ops::Load(wx + i), Ops::Mul(ax, h)));
+	Ops::Store(wy + i, Ops::Add(Ops::Load(wy + i), Ops::Mul(ay, h)));
+	Ops::Store(wz + i, Ops::Add(Ops::Load(wz + i), Ops::Mul(az, h)));
+}
+
+template <typename Ops>
+static inline void OrientationAt(int i, const float* wx, const float* wy, const float* wz,
+	float* qx, float* qy, float* qz, float* qw, float dt) {
+	typedef typename Ops::T T;
+	const T ox = Ops::Load(wx + i);
+	const T oy = Ops::Load(wy + i);
+	const T oz = Ops::Load(wz + i);
+	const T x = Ops::Load(qx + i);
+	const T y = Ops::Load(qy + i);
+	const T z = Ops::Load(qz + i);
+	const T w = Ops::Load(qw + i);
+	const T h = Ops::Set1(0.5f * dt);
+
+	//(w, 0) * q
+	const T dx = Ops::Sub(Ops::Add(Ops::Mul(ox, w), Ops::Mul(oy, z)), Ops::Mul(oz, y));
+	const T dy = Ops::Sub(Ops::Add(Ops::Mul(oy, w), Ops::Mul(oz, x)), Ops::Mul(ox, z));
+	const T dz = Ops::Sub(Ops::Add(Ops::Mul(oz, w), Ops::Mul(ox, y)), Ops::Mul(oy, x));
+	const T dw = Ops::Add(Ops::Add(Ops::Mul(ox, x), Ops::Mul(oy, y)), Ops::Mul(oz, z));
+
+	const T nx = Ops::Add(x, Ops::Mul(dx, h));
+	const T ny = Ops::Add(y, Ops::Mul(dy, h));
+	const T nz = Ops::Add(z, Ops::Mul(dz, h));
+	const T nw = Ops::Sub(w, Ops::Mul(dw, h));
+	const T length = Ops::Sqrt(Ops::Add(Ops::Add(Ops::Add(Ops::Mul(nx, nx), Ops::Mul(ny, ny)), Ops::Mul(nz, nz)), Ops::Mul(nw, nw)));
+	const T inv = Ops::Div(Ops::Set1(1.0f), length);
+	Ops::Store(qx + i, Ops::Mul(nx, inv));
+	Ops::Store(qy + i, Ops::Mul(ny, inv));
+	Ops::Store(qz + i, Ops::Mul(nz, inv));
+	Ops::Store(qw + i, Ops::Mul(nw, inv));
+}
+
+template <typename Ops>
+static inline void WorldInverseInertiaAt(int i, const float* qx, const float* qy, const float* qz, const float* qw,
+	const float* dx, const float* dy, const float* dz,
+	float* ixx, float* iyy, float* izz, float* ixy, float* ixz, float* iyz) {
+	typedef typename Ops::T T;
+	const T x = Ops::Load(qx + i);
+	const T y = Ops::Load(qy + i);
+	const T z = Ops::Load(qz + i);
+	const T w = Ops::Load(qw + i);
+	const T one = Ops::Set1(1.0f);
+	const T two = Ops::Set1(2.0f);
+
+	//Columns of R are the body axes in world space
+	const T xx = Ops::Mul(x, x), yy = Ops::Mul(y, y), zz = Ops::Mul(z, z);
+	const T xy = Ops::Mul(x, y), xz = Ops::Mul(x, z), yz = Ops::Mul(y, z);
+	const T wx = Ops::Mul(w, x), wy = Ops::Mul(w, y), wz = Ops::Mul(w, z);
+	const T r00 = Ops::Sub(one, Ops::Mul(two, Ops::Add(yy, zz)));
+	const T r10 = Ops::Mul(two, Ops::Add(xy, wz));
+	const T r20 = Ops::Mul(two, Ops::Sub(xz, wy));
+	const T r01 = Ops::Mul(two, Ops::Sub(xy, wz));
+	const T r11 = Ops::Sub(one, Ops::Mul(two, Ops::Add(xx, zz)));
+	const T r21 = Ops::Mul(two, Ops::Add(yz, wx));
+	const T r02 = Ops::Mul(two, Ops::Add(xz, wy));
+	const T r12 = Ops::Mul(two, Ops::Sub(yz, wx));
+	const T r22 = Ops::Sub(one, Ops::Mul(two, Ops::Add(xx, yy)));
+
+	//Entry (j, k) = sum over body axes a of d[a] * R[j][a] * R[k][a]
+	const T d0 = Ops::Load(dx + i);
+	const T d1 = Ops::Load(dy + i);
+	const T d2 = Ops::Load(dz + i);
+	const T a00 = Ops::Mul(d0, r00), a01 = Ops::Mul(d1, r01), a02 = Ops::Mul(d2, r02);
+	const T a10 = Ops::Mul(d0, r10), a11 = Ops::Mul(d1, r11), a12 = Ops::Mul(d2, r12);
+	const T a20 = Ops::Mul(d0, r20), a21 = Ops::Mul(d1, r21), a22 = Ops::Mul(d2, r22);
+	Ops::Store(ixx + i, Ops::Add(Ops::Add(Ops::Mul(a00, r00), Ops::Mul(a01, r01)), Ops::Mul(a02, r02)));
+	Ops::Store(iyy + i, Ops::Add(Ops::Add(Ops::Mul(a10, r10), Ops::Mul(a11, r11)), Ops::Mul(a12, r12)));
+	Ops::Store(izz + i, Ops::Add(Ops::Add(Ops::Mul(a20, r20), Ops::Mul(a21, r21)), Ops::Mul(a22, r22)));
+	Ops::Store(ixy + i, Ops::Add(Ops::Add(Ops::Mul(a00, r10), Ops::Mul(a01, r11)), Ops::Mul(a02, r12)));
+	Ops::Store(ixz + i, Ops::Add(Ops::Add(Ops::Mul(a00, r20), Ops::Mul(a01, r21)), Ops::Mul(a02, r22)));
+	Ops::Store(iyz + i, Ops::Add(Ops::Add(Ops::Mul(a10, r20), Ops::Mul(a11, r21)), Ops::Mul(a12, r22)));
+}
+
+void RotationKernels::AngularVelocity(const float* tx, const float* ty, const float* tz,
+	const float* ixx, const float* iyy, const float* izz, const float* ixy, const float* ixz, const float* iyz,
+	float* wx, float* wy, float* wz, int count, float dt, Mode mode) {
+	int i = 0;
+	if (mode == ForceKernels::Vectorized) {
+		for (; i + SIMD_WIDTH <= count; i += SIMD_WIDTH) {
+			AngularVelocityAt<VectorOps>(i, tx, ty, tz, ixx, iyy, izz, ixy, ixz, iyz, wx, wy, wz, dt);
+		}
+	}
+	for (; i < count; i++) {
+		AngularVelocityAt<ScalarOps>(i, tx, ty, tz, ixx, iyy, izz, ixy, ixz, iyz, wx, wy, wz, dt);
+	}
+}
+
+void RotationKernels::Orientation(const float* wx, const float* wy, const float* wz,
+	float* qx, float* qy, float* qz, float* qw, int count, float dt, Mode mode) {
+	int i = 0;
+	if (mode == ForceKernels::Vectorized) {
+		for (; i + SIMD_WIDTH <= count; i += SIMD_WIDTH) {
+			OrientationAt<VectorOps>(i, wx, wy, wz, qx, qy, qz, qw, dt);
+		}
+	}
+	for (; i < count; i++) {
+		OrientationAt<ScalarOps>(i, wx, wy, wz, qx, qy, qz, qw, dt);
+	}
+}
+
+void RotationKernels::WorldInverseInertia(const float* qx, const float* qy, const float* qz, const float* qw,
+	const float* dx, const float* dy, const float* dz,
+	float* ixx, float* iyy, float* izz, float* ixy, float* ixz, float* iyz, int count, Mode mode) {
+	int i = 0;
+	if (mode == ForceKernels::Vectorized) {
+		for (; i + SIMD_WIDTH <= count; i += SIMD_WIDTH) {
+			WorldInverseInertiaAt<VectorOps>(i, qx, qy, qz, qw, dx, dy, dz, ixx, iyy, izz, ixy, ixz, iyz);
+		}
+	}
+	for (; i < count; i++) {
+		WorldInverseInertiaAt<ScalarOps>(i, qx, qy, qz, qw, dx, dy, dz, ixx, iyy, izz, ixy, ixz, iyz);
+	}
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include "ForceKernels.h"
+
+//Batched rigid body rotation over structure-of-arrays body data, in the same style as
+//ForceKernels: SIMD_WIDTH lanes at a time with a scalar tail, and a ScalarReference mode
+//that runs everything through the tail with bit-identical results.
+//
+//The world inverse inertia is symmetric and stored as six arrays (xx, yy, zz, xy, xz, yz).
+//It is rebuilt from the body-space diagonal and the orientation, so a step never inverts
+//or multiplies a general 3x3 matrix.
+namespace RotationKernels {
+	typedef ForceKernels::Mode Mode;
+
+	//w += invInertia * torque * dt
+	void AngularVelocity(const float* tx, const float* ty, const float* tz,
+		const float* ixx, const float* iyy, const float* izz, const float* ixy, const float* ixz, const float* iyz,
+		float* wx, float* wy, float* wz, int count, float dt, Mode mode = ForceKernels::Vectorized);
+
+	//q += 0.5 * dt * (w, 0) * q, then renormalized
+	void Orientation(const float* wx, const float* wy, const float* wz,
+		float* qx, float* qy, float* qz, float* qw, int count, float dt, Mode mode = ForceKernels::Vectorized);
+
+	//invInertia = R * diag(d) * R^T with R the rotation of q
+	void WorldInverseInertia(const float* qx, const float* qy, const float* qz, const float* qw,
+		const float* dx, const float* dy, const float* dz,
+		float* ixx, float* iyy, float* izz, float* ixy, float* ixz, float* iyz, int count, Mode mode = ForceKernels::Vectorized);
+}
@@ -0,0 +1,124 @@
+#pragma once
+//Thin wrappers over the widest float vector the build targets.
+//AVX2 (8 lanes) when compiled with /arch:AVX2, SSE2 (4 lanes) otherwise on x86/x64,
+//plain scalar (1 lane) anywhere else. Kernels written against these stay identical
+//across targets; only SIMD_WIDTH changes.
+//
+//Only correctly rounded operations (add, sub, mul, div, sqrt) are wrapped, so a scalar
+//loop doing the same operations in the same order produces bit-identical results.
+#include <cmath>
+#include <cstring>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define SIMD_AVX2 1
+#define SIMD_WIDTH 8
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SIMD_SSE2 1
+#define SIMD_WIDTH 4
+#else
+#define SIMD_SCALAR 1
+#define SIMD_WIDTH 1
+#endif
+
+namespace Simd {
+#if SIMD_AVX2
+	typedef __m256 Float;
+	typedef __m256i Int;
+
+	inline Float Zero() { return _mm256_setzero_ps(); }
+	inline Float Set1(float v) { return _mm256_set1_ps(v); }
+	inline Float Load(const float* p) { return _mm256_loadu_ps(p); }
+	inline void Store(float* p, Float v) { _mm256_storeu_ps(p, v); }
+	inline Int LoadInt(const int* p) { return _mm256_loadu_si256((const __m256i*)p); }
+	inline Float Gather(const float* base, Int index) { return _mm256_i32gather_ps(base, index, 4); }
+	inline Float Add(Float a, Float b) { return _mm256_add_ps(a, b); }
+	inline Float Sub(Float a, Float b) { return _mm256_sub_ps(a, b); }
+	inline Float Mul(Float a, Float b) { return _mm256_mul_ps(a, b); }
+	inline Float Div(Float a, Float b) { return _mm256_div_ps(a, b); }
+	inline Float Sqrt(Float a) { return _mm256_sqrt_ps(a); }
+	inline Float Min(Float a, Float b) { return _mm256_min_ps(a, b); }
+	inline Float Max(Float a, Float b) { return _mm256_max_ps(a, b); }
+	inline Float NotEqual(Float a, Float b) { return _mm256_cmp_ps(a, b, _CMP_NEQ_UQ); }
+	inline Float Greater(Float a, Float b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+	inline Float And(Float a, Float b) { return _mm256_and_ps(a, b); }
+	inline Float Or(Float a, Float b) { return _mm256_or_ps(a, b); }
+	//Per lane: mask ? a : b
+	inline Float Select(Float mask, Float a, Float b) { return _mm256_blendv_ps(b, a, mask); }
+	inline int MoveMask(Float mask) { return _mm256_movemask_ps(mask); }
+#elif SIMD_SSE2
+	typedef __m128 Float;
+	typedef __m128i Int;
+
+	inline Float Zero() { return _mm_setzero_ps(); }
+	inline Float Set1(float v) { return _mm_set1_ps(v); }
+	inline Float Load(const float* p) { return _mm_loadu_ps(p); }
+	inline void Store(float* p, Float v) { _mm_storeu_ps(p, v); }
+	inline Int LoadInt(const int* p) { return _mm_loadu_si128((const __m128i*)p); }
+	inline Float Gather(const float* base, Int index) {
+		int i[4];
+		_mm_storeu_si128((__m128i*)i, index);
+		return _mm_set_ps(base[i[3]], base[i[2]], base[i[1]], base[i[0]]);
+	}
+	inline Float Add(Float a, Float b) { return _mm_add_ps(a, b); }
+	inline Float Sub(Float a, Float b) { return _mm_sub_ps(a, b); }
+	inline Float Mul(Float a, Float b) { return _mm_mul_ps(a, b); }
+	inline Float Div(Float a, Float b) { return _mm_div_ps(a, b); }
+	inline Float Sqrt(Float a) { return _mm_sqrt_ps(a); }
+	inline Float Min(Float a, Float b) { return _mm_min_ps(a, b); }
+	inline Float Max(Float a, Float b) { return _mm_max_ps(a, b); }
+	inline Float NotEqual(Float a, Float b) { return _mm_cmpneq_ps(a, b); }
+	inline Float Greater(Float a, Float b) { return _mm_cmpgt_ps(a, b); }
+	inline Float And(Float a, Float b) { return _mm_and_ps(a, b); }
+	inline Float Or(Float a, Float b) { return _mm_or_ps(a, b); }
+	inline Float Select(Float mask, Float a, Float b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+	inline int MoveMask(Float mask) { return _mm_movemask_ps(mask); }
+#else
+	typedef float Float;
+	typedef int Int;
+
+	inline float MaskBits(bool b) { unsigned int u = b ? ~0u : 0u; float f; memcpy(&f, &u, 4); return f; }
+	inline unsigned int Bits(float f) { unsigned int u; memcpy(&u, &f, 4); return u; }
+
+	inline Float Zero() { return 0.0f; }
+	inline Float Set1(float v) { return v; }
+	inline Float Load(const float* p) { return *p; }
+	inline void Store(float* p, Float v) { *p = v; }
+	inline Int LoadInt(const int* p) { return *p; }
+	inline Float Gather(const float* base, Int index) { return base[index]; }
+	inline Float Add(Float a, Float b) { return a + b; }
+	inline Float Sub(Float a, Float b) { return a - b; }
+	inline Float Mul(Float a, Float b) { return a * b; }
+	inline Float Div(Float a, Float b) { return a / b; }
+	inline Float Sqrt(Float a) { return sqrtf(a); }
+	inline Float Min(Float a, Float b) { return b < a ? b : a; }
+	inline Float Max(Float a, Float b) { return b > a ? b : a; }
+	inline Float NotEqual(Float a, Float b) { return MaskBits(a != b); }
+	inline Float Greater(Float a, Float b) { return MaskBits(a > b); }
+	inline Float And(Float a, Float b) { unsigned int u = Bits(a) & Bits(b); float f; memcpy(&f, &u, 4); return f; }
+	inline Float Or(Float a, Float b) { unsigned int u = Bits(a) | Bits(b); float f; memcpy(&f, &u, 4); return f; }
+	inline Float Select(Float mask, Float a, Float b) { return Bits(mask) ? a : b; }
+	inline int MoveMask(Float mask) { return Bits(mask) ? 1 : 0; }
+#endif
+
+	inline Float Negate(Float a) { return Sub(Zero(), a); }
+	inline Float Abs(Float a) { return Max(a, Negate(a)); }
+
+	//Length of (x, y, z), summed as (x*x + y*y) + z*z to match the scalar kernels
+	inline Float Length(Float x, Float y, Float z) {
+		return Sqrt(Add(Add(Mul(x, x), Mul(y, y)), Mul(z, z)));
+	}
+
+	//Normalizes (x, y, z) in place and returns the original length.
+	//Zero-length lanes come out as the zero vector instead of NaN.
+	inline Float NormalizeMasked(Float& x, Float& y, Float& z) {
+		Float length = Length(x, y, z);
+		Float nonZero = NotEqual(length, Zero());
+		Float inv = And(Div(Set1(1.0f), length), nonZero);
+		x = Mul(x, inv);
+		y = Mul(y, inv);
+		z = Mul(z, inv);
+		return length;
+	}
+}
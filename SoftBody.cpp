@@ -0,0 +1,290 @@
+#include "SoftBody.h"
+#include "ThreadPool.h"
+#include "Simd.h"
+#include <cmath>
+
+using namespace Simd;
+
+//SIMD vectors of elements per task
+static const int VectorGrain = 32;
+//Keeps the rotation update finite when an element has collapsed to a point
+static const float RotationEpsilon = 1e-9f;
+
+//SIMD_WIDTH 3D vectors, one Float per component
+struct Vec {
+	Float x, y, z;
+};
+
+static inline Vec Make(Float x, Float y, Float z) { Vec v = { x, y, z }; return v; }
+static inline Vec Plus(const Vec& a, const Vec& b) { return Make(Add(a.x, b.x), Add(a.y, b.y), Add(a.z, b.z)); }
+static inline Vec Minus(const Vec& a, const Vec& b) { return Make(Sub(a.x, b.x), Sub(a.y, b.y), Sub(a.z, b.z)); }
+static inline Vec Scale(const Vec& a, Float s) { return Make(Mul(a.x, s), Mul(a.y, s), Mul(a.z, s)); }
+static inline Float Dot(const Vec& a, const Vec& b) { return Add(Add(Mul(a.x, b.x), Mul(a.y, b.y)), Mul(a.z, b.z)); }
+static inline Vec Cross(const Vec& a, const Vec& b) {
+	return Make(Sub(Mul(a.y, b.z), Mul(a.z, b.y)), Sub(Mul(a.z, b.x), Mul(a.x, b.z)), Sub(Mul(a.x, b.y), Mul(a.y, b.x)));
+}
+static inline Vec GatherVec(const Vec3Stream& s, Int index) {
+	return Make(Gather(s.x.data(), index), Gather(s.y.data(), index), Gather(s.z.data(), index));
+}
+
+//Columns of the rotation matrix of the unit quaternion (x, y, z, w)
+static inline void RotationColumns(Float x, Float y, Float z, Float w, Vec r[3]) {
+	const Float one = Set1(1.0f);
+	const Float two = Set1(2.0f);
+	const Float xx = Mul(x, x), yy = Mul(y, y), zz = Mul(z, z);
+	const Float xy = Mul(x, y), xz = Mul(x, z), yz = Mul(y, z);
+	const Float wx = Mul(w, x), wy = Mul(w, y), wz = Mul(w, z);
+	r[0] = Make(Sub(one, Mul(two, Add(yy, zz))), Mul(two, Add(xy, wz)), Mul(two, Sub(xz, wy)));
+	r[1] = Make(Mul(two, Sub(xy, wz)), Sub(one, Mul(two, Add(xx, zz))), Mul(two, Add(yz, wx)));
+	r[2] = Make(Mul(two, Add(xz, wy)), Mul(two, Sub(yz, wx)), Sub(one, Mul(two, Add(xx, yy))));
+}
+
+//Columns of E M for the edge matrix E with columns e and the row-major 3x3 matrix M
+static inline void TimesRestInverse(const Vec e[3], const Float m[9], Vec out[3]) {
+	for (int c = 0; c < 3; c++) {
+		out[c] = Plus(Plus(Scale(e[0], m[c]), Scale(e[1], m[3 + c])), Scale(e[2], m[6 + c]));
+	}
+}
+
+//Symmetric part of R^T A for the rotation columns r and the columns a: xx, yy, zz, xy, xz, yz
+static inline void SymmetricRotated(const Vec r[3], const Vec a[3], Float out[6]) {
+	const Float half = Set1(0.5f);
+	out[0] = Dot(r[0], a[0]);
+	out[1] = Dot(r[1], a[1]);
+	out[2] = Dot(r[2], a[2]);
+	out[3] = Mul(half, Add(Dot(r[0], a[1]), Dot(r[1], a[0])));
+	out[4] = Mul(half, Add(Dot(r[0], a[2]), Dot(r[2], a[0])));
+	out[5] = Mul(half, Add(Dot(r[1], a[2]), Dot(r[2], a[1])));
+}
+
+int SoftBody::add(const BodyStore& bodies, int a, int b, int c, int d, float youngsModulus, float poissonRatio) {
+	assert(a != b && a != c && a != d && b != c && b != d && c != d);
+	const glm::vec3 origin = bodies.currPos.get(a);
+	const glm::mat3 edges(bodies.currPos.get(b) - origin, bodies.currPos.get(c) - origin, bodies.currPos.get(d) - origin);
+	const float det = glm::determinant(edges);
+	const float scale = glm::length(edges[0]) * glm::length(edges[1]) * glm::length(edges[2]);
+	if (!(std::fabs(det) > 1e-6f * scale)) return -1;
+
+	const glm::mat3 inverse = glm::inverse(edges);
+	corner[0].push_back(a);
+	corner[1].push_back(b);
+	corner[2].push_back(c);
+	corner[3].push_back(d);
+	for (int row = 0; row < 3; row++) {
+		for (int col = 0; col < 3; col++) m_restInverse[row * 3 + col].push_back(inverse[col][row]);
+	}
+	m_restVolume.push_back(std::fabs(det) / 6.0f);
+	m_rotation[0].push_back(0.0f);
+	m_rotation[1].push_back(0.0f);
+	m_rotation[2].push_back(0.0f);
+	m_rotation[3].push_back(1.0f);
+	mu.push_back(youngsModulus / (2.0f * (1.0f + poissonRatio)));
+	lambda.push_back(youngsModulus * poissonRatio / ((1.0f + poissonRatio) * (1.0f - 2.0f * poissonRatio)));
+	m_topologyVersion++;
+	return size() - 1;
+}
+
+void SoftBody::reserve(int n) {
+	for (int k = 0; k < 4; k++) corner[k].reserve(n);
+	for (int k = 0; k < 9; k++) m_restInverse[k].reserve(n);
+	m_restVolume.reserve(n);
+	for (int k = 0; k < 4; k++) m_rotation[k].reserve(n);
+	mu.reserve(n);
+	lambda.reserve(n);
+}
+
+void SoftBody::clear() {
+	for (int k = 0; k < 4; k++) corner[k].clear();
+	for (int k = 0; k < 9; k++) m_restInverse[k].clear();
+	m_restVolume.clear();
+	for (int k = 0; k < 4; k++) m_rotation[k].clear();
+	mu.clear();
+	lambda.clear();
+	m_element.clear();
+	m_coloring.reset();
+	m_topologyVersion++;
+}
+
+void SoftBody::pack(const BodyStore& bodies) {
+	if (m_packedTopologyVersion == m_topologyVersion && m_packedActiveVersion == bodies.activeVersion()) return;
+
+	//Rotations live in the packed arrays between repacks
+	for (size_t k = 0; k < m_element.size(); k++) {
+		const int e = m_element[k];
+		if (e < 0) continue;
+		for (int j = 0; j < 4; j++) m_rotation[j][e] = m_packedRotation[j][k];
+	}
+
+	m_coloring.extend(size(), 4, bodies.capacity(), [this](int e, int k) { return corner[k][e]; });
+	const std::vector<int>& groupStart = m_coloring.groupStart();
+	const std::vector<int>& items = m_coloring.items();
+	const int groups = m_coloring.groupCount();
+	auto awake = [&](int e) {
+		return bodies.isActive(corner[0][e]) || bodies.isActive(corner[1][e]) || bodies.isActive(corner[2][e]) || bodies.isActive(corner[3][e]);
+	};
+
+	m_groupStart.assign(1, 0);
+	m_element.clear();
+	for (int g = 0; g < groups; g++) {
+		for (int i = groupStart[g]; i < groupStart[g + 1]; i++) {
+			if (awake(items[i])) m_element.push_back(items[i]);
+		}
+		while (m_element.size() % SIMD_WIDTH != 0) m_element.push_back(-1);
+		m_groupStart.push_back((int)m_element.size());
+	}
+	m_serialLast = m_coloring.hasOverflow();
+
+	const int count = (int)m_element.size();
+	for (int j = 0; j < 4; j++) m_packedCorner[j].resize(count);
+	for (int j = 0; j < 9; j++) m_packedInverse[j].resize(count);
+	m_packedVolume.resize(count);
+	m_packedMu.resize(count);
+	m_packedLambda.resize(count);
+	for (int j = 0; j < 4; j++) m_packedRotation[j].resize(count);
+	//Padding gathers body 0 and has no volume, so its forces come out zero
+	for (int k = 0; k < count; k++) {
+		const int e = m_element[k];
+		for (int j = 0; j < 4; j++) m_packedCorner[j][k] = e >= 0 ? corner[j][e] : 0;
+		for (int j = 0; j < 9; j++) m_packedInverse[j][k] = e >= 0 ? m_restInverse[j][e] : 0.0f;
+		m_packedVolume[k] = e >= 0 ? m_restVolume[e] : 0.0f;
+		m_packedMu[k] = e >= 0 ? mu[e] : 0.0f;
+		m_packedLambda[k] = e >= 0 ? lambda[e] : 0.0f;
+		for (int j = 0; j < 4; j++) m_packedRotation[j][k] = e >= 0 ? m_rotation[j][e] : (j == 3 ? 1.0f : 0.0f);
+	}
+
+	m_packedTopologyVersion = m_topologyVersion;
+	m_packedActiveVersion = bodies.activeVersion();
+}
+
+void SoftBody::apply(BodyStore& bodies) {
+	if (size() == 0) return;
+	pack(bodies);
+
+	float* fx = bodies.force.x.data();
+	float* fy = bodies.force.y.data();
+	float* fz = bodies.force.z.data();
+	const int iterations = rotationIterations;
+	const float beta = damping;
+
+	//Elements [k, k + SIMD_WIDTH), all of one color
+	auto block = [&](int k) {
+		Int index[4];
+		Vec x[4];
+		Vec v[4];
+		for (int j = 0; j < 4; j++) {
+			index[j] = LoadInt(&m_packedCorner[j][k]);
+			x[j] = GatherVec(bodies.currPos, index[j]);
+			v[j] = GatherVec(bodies.velocity, index[j]);
+		}
+		Float m[9];
+		for (int j = 0; j < 9; j++) m[j] = Load(&m_packedInverse[j][k]);
+		const Vec edges[3] = { Minus(x[1], x[0]), Minus(x[2], x[0]), Minus(x[3], x[0]) };
+		const Vec rates[3] = { Minus(v[1], v[0]), Minus(v[2], v[0]), Minus(v[3], v[0]) };
+		Vec deformation[3];
+		Vec deformationRate[3];
+		TimesRestInverse(edges, m, deformation);
+		TimesRestInverse(rates, m, deformationRate);
+
+		//Each iteration turns R about sum(r_i x f_i) / |sum(r_i . f_i)|, which vanishes once
+		//R^T F is symmetric. The quaternion takes a first-order step along that turn and is
+		//renormalized, which has the same fixed point as the exact exponential.
+		Float qx = Load(&m_packedRotation[0][k]);
+		Float qy = Load(&m_packedRotation[1][k]);
+		Float qz = Load(&m_packedRotation[2][k]);
+		Float qw = Load(&m_packedRotation[3][k]);
+		Vec r[3];
+		const Float half = Set1(0.5f);
+		for (int it = 0; it < iterations; it++) {
+			RotationColumns(qx, qy, qz, qw, r);
+			const Vec turn = Plus(Plus(Cross(r[0], deformation[0]), Cross(r[1], deformation[1])), Cross(r[2], deformation[2]));
+			const Float along = Add(Add(Dot(r[0], deformation[0]), Dot(r[1], deformation[1])), Dot(r[2], deformation[2]));
+			const Vec w = Scale(turn, Div(half, Add(Abs(along), Set1(RotationEpsilon))));
+			//q += (0, w) q, with w already halved
+			const Float nx = Add(qx, Add(Mul(w.x, qw), Sub(Mul(w.y, qz), Mul(w.z, qy))));
+			const Float ny = Add(qy, Add(Mul(w.y, qw), Sub(Mul(w.z, qx), Mul(w.x, qz))));
+			const Float nz = Add(qz, Add(Mul(w.z, qw), Sub(Mul(w.x, qy), Mul(w.y, qx))));
+			const Float nw = Sub(qw, Add(Add(Mul(w.x, qx), Mul(w.y, qy)), Mul(w.z, qz)));
+			const Float inv = Div(Set1(1.0f), Sqrt(Add(Add(Mul(nx, nx), Mul(ny, ny)), Add(Mul(nz, nz), Mul(nw, nw)))));
+			qx = Mul(nx, inv);
+			qy = Mul(ny, inv);
+			qz = Mul(nz, inv);
+			qw = Mul(nw, inv);
+		}
+		Store(&m_packedRotation[0][k], qx);
+		Store(&m_packedRotation[1][k], qy);
+		Store(&m_packedRotation[2][k], qz);
+		Store(&m_packedRotation[3][k], qw);
+		RotationColumns(qx, qy, qz, qw, r);
+
+		//Strain plus damped strain rate, in the element's rotated frame
+		Float strain[6];
+		Float strainRate[6];
+		SymmetricRotated(r, deformation, strain);
+		SymmetricRotated(r, deformationRate, strainRate);
+		const Float one = Set1(1.0f);
+		const Float b = Set1(beta);
+		Float e[6];
+		for (int j = 0; j < 6; j++) {
+			e[j] = Add(j < 3 ? Sub(strain[j], one) : strain[j], Mul(b, strainRate[j]));
+		}
+
+		//Stress 2 mu e + lambda tr(e) I, rotated back: P = R sigma
+		const Float twoMu = Mul(Set1(2.0f), Load(&m_packedMu[k]));
+		const Float pressure = Mul(Load(&m_packedLambda[k]), Add(Add(e[0], e[1]), e[2]));
+		const Float sxx = Add(Mul(twoMu, e[0]), pressure);
+		const Float syy = Add(Mul(twoMu, e[1]), pressure);
+		const Float szz = Add(Mul(twoMu, e[2]), pressure);
+		const Float sxy = Mul(twoMu, e[3]);
+		const Float sxz = Mul(twoMu, e[4]);
+		const Float syz = Mul(twoMu, e[5]);
+		const Vec p[3] = {
+			Plus(Plus(Scale(r[0], sxx), Scale(r[1], sxy)), Scale(r[2], sxz)),
+			Plus(Plus(Scale(r[0], sxy), Scale(r[1], syy)), Scale(r[2], syz)),
+			Plus(Plus(Scale(r[0], sxz), Scale(r[1], syz)), Scale(r[2], szz))
+		};
+
+		//Corner j > 0 gets -V P times row j of Dm^-1; corner 0 balances them
+		const Float volume = Negate(Load(&m_packedVolume[k]));
+		float out[12][SIMD_WIDTH];
+		Vec total = Make(Zero(), Zero(), Zero());
+		for (int j = 1; j < 4; j++) {
+			const Float* row = &m[(j - 1) * 3];
+			const Vec f = Scale(Plus(Plus(Scale(p[0], row[0]), Scale(p[1], row[1])), Scale(p[2], row[2])), volume);
+			total = Plus(total, f);
+			Store(out[j * 3], f.x);
+			Store(out[j * 3 + 1], f.y);
+			Store(out[j * 3 + 2], f.z);
+		}
+		Store(out[0], Negate(total.x));
+		Store(out[1], Negate(total.y));
+		Store(out[2], Negate(total.z));
+
+		for (int lane = 0; lane < SIMD_WIDTH; lane++) {
+			if (m_element[k + lane] < 0) continue;
+			for (int j = 0; j < 4; j++) {
+				const int body = m_packedCorner[j][k + lane];
+				fx[body] += out[j * 3][lane];
+				fy[body] += out[j * 3 + 1][lane];
+				fz[body] += out[j * 3 + 2][lane];
+			}
+		}
+	};
+
+	ThreadPool& pool = ThreadPool::Global();
+	const int groups = (int)m_groupStart.size() - 1;
+	for (int g = 0; g < groups; g++) {
+		const int first = m_groupStart[g];
+		const int vectors = (m_groupStart[g + 1] - first) / SIMD_WIDTH;
+		auto run = [&](int begin, int end) {
+			for (int n = begin; n < end; n++) block(first + n * SIMD_WIDTH);
+		};
+		if (m_serialLast && g == groups - 1) {
+			//Overflow elements may share corners; lanes scatter one after another, so on one
+			//thread that is safe
+			run(0, vectors);
+		}
+		else {
+			pool.parallelFor(vectors, VectorGrain, run);
+		}
+	}
+}
@@ -0,0 +1,90 @@
+#pragma once
+#include "Globals.h"
+#include "AlignedAllocator.h"
+#include "BodyStore.h"
+#include "GraphColoring.h"
+#include <vector>
+
+//Volumetric soft bodies: linear co-rotational finite elements on tetrahedra whose four
+//corners are bodies of the BodyStore. Any number of separate meshes can share one list.
+//
+//Each element stores the inverse of its rest edge matrix Dm and its rest volume. Per step,
+//with Ds the current edge matrix, F = Ds Dm^-1 is split into a rotation R and a stretch:
+//	- R is found by Muller et al.'s rotation extraction ("A Robust Method to Extract the
+//	  Rotational Part of Deformations", 2016), warm started from the element's last R, so
+//	  one or two iterations per step are enough. Unlike a polar decomposition it stays a
+//	  proper rotation when an element is turned inside out, so inverted elements push back.
+//	- the strain is the symmetric part of R^T F - I, which ignores rotation but stays
+//	  linear in the stretch; stress is linear in it (Lame parameters from Young's modulus
+//	  and Poisson's ratio), rotated back by R, and turned into corner forces.
+//The element loop runs SIMD_WIDTH elements at a time, gathering corners from the body store
+//and using only the operations of Simd.h.
+//
+//Forces are assembled through a graph coloring of the elements over their corners, so
+//elements of one color share no body and write bodies.force without atomics. The elements
+//with an awake corner are copied into color order once per topology or sleep change, so each
+//color is a contiguous range that is computed and scattered by one parallel pass. Color
+//ranges are padded to whole SIMD vectors; padding lanes compute nothing useful and are not
+//scattered.
+//
+//Forces are explicit: keep dt below about edge * sqrt(density / youngsModulus) for the
+//smallest element, or use a smaller step. Corner bodies usually have no collision shape;
+//PhysicsSystem links the corners of every element into one island, so a mesh sleeps and
+//wakes as a whole.
+class SoftBody {
+public:
+	//Adds the element with corners a, b, c, d at their current positions as its rest shape.
+	//Corners may come in either winding. Returns the element index, or -1 if the four
+	//corners are flat.
+	int add(const BodyStore& bodies, int a, int b, int c, int d, float youngsModulus = 5e4f, float poissonRatio = 0.3f);
+	void reserve(int n);
+	void clear();
+	int size() const { return (int)corner[0].size(); }
+
+	//Adds elastic and damping forces of every element with an awake corner to bodies.force
+	void apply(BodyStore& bodies);
+
+	//Stiffness-proportional damping, seconds: the strain rate times this is added to the
+	//strain. It is explicit too and stiffer than the elasticity, so keep it below half of dt.
+	float damping = 0.001f;
+	//Rotation extraction iterations per step, from last step's rotation
+	int rotationIterations = 2;
+
+	//Corner bodies of each element
+	AlignedVector<int> corner[4];
+	//Lame parameters of each element
+	AlignedVector<float> mu;
+	AlignedVector<float> lambda;
+	float restVolume(int element) const { return m_restVolume[element]; }
+
+	//Bumped on every topology change so dependent caches know to rebuild
+	unsigned int topologyVersion() const { return m_topologyVersion; }
+	int colorCount() { return m_coloring.groupCount(); }
+private:
+	//Copies the elements with an awake corner into color order
+	void pack(const BodyStore& bodies);
+
+	//Per element: rest edge matrix inverse, row-major, its rest volume, and the rotation of
+	//the last step as a quaternion
+	AlignedVector<float> m_restInverse[9];
+	AlignedVector<float> m_restVolume;
+	AlignedVector<float> m_rotation[4];
+
+	GraphColoring m_coloring;
+	unsigned int m_topologyVersion = 0;
+	unsigned int m_packedTopologyVersion = ~0u;
+	unsigned int m_packedActiveVersion = ~0u;
+
+	//Awake elements in color order, each color padded to whole SIMD vectors. Color g is
+	//[m_groupStart[g], m_groupStart[g + 1]); m_element is -1 on padding.
+	std::vector<int> m_groupStart;
+	//The last color is the coloring's overflow group, whose elements may share bodies
+	bool m_serialLast = false;
+	AlignedVector<int> m_element;
+	AlignedVector<int> m_packedCorner[4];
+	AlignedVector<float> m_packedInverse[9];
+	AlignedVector<float> m_packedVolume;
+	AlignedVector<float> m_packedMu;
+	AlignedVector<float> m_packedLambda;
+	AlignedVector<float> m_packedRotation[4];
+};
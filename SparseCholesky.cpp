@@ -0,0 +1,102 @@
+#include "SparseCholesky.h"
+
+//The nonzeros of row k of L are the nodes reached walking up the elimination tree from
+//each nonzero A(i, k), i < k, until a node already visited for k
+void SparseCholesky::analyze(int n, const std::vector<int>& columnStart, const std::vector<int>& rows) {
+	m_n = n;
+	m_parent.assign(n, -1);
+	m_count.assign(n, 0);
+	m_flag.assign(n, -1);
+	for (int k = 0; k < n; k++) {
+		m_flag[k] = k;
+		for (int p = columnStart[k]; p < columnStart[k + 1]; p++) {
+			for (int i = rows[p]; i < k && m_flag[i] != k; i = m_parent[i]) {
+				if (m_parent[i] == -1) m_parent[i] = k;
+				m_count[i]++;
+				m_flag[i] = k;
+			}
+		}
+	}
+	m_columnStart.assign(n + 1, 0);
+	for (int k = 0; k < n; k++) m_columnStart[k + 1] = m_columnStart[k] + m_count[k];
+	m_rows.resize(m_columnStart[n]);
+	m_values.resize(m_columnStart[n]);
+	m_diagonal.resize(n);
+	m_pattern.resize(n);
+	m_y.assign(n, 0.0);
+}
+
+//Row k of L solves L(0:k, 0:k) D y = A(0:k, k) over the pattern found from the tree, in
+//topological order; the columns of L grow by one entry each as rows are appended
+bool SparseCholesky::factor(const std::vector<int>& columnStart, const std::vector<int>& rows, const std::vector<double>& values) {
+	const int n = m_n;
+	for (int k = 0; k < n; k++) {
+		m_y[k] = 0.0;
+		int top = n;
+		m_flag[k] = k;
+		m_count[k] = 0;
+		for (int p = columnStart[k]; p < columnStart[k + 1]; p++) {
+			int i = rows[p];
+			m_y[i] += values[p];
+			int length = 0;
+			for (; m_flag[i] != k; i = m_parent[i]) {
+				m_pattern[length++] = i;
+				m_flag[i] = k;
+			}
+			while (length > 0) m_pattern[--top] = m_pattern[--length];
+		}
+
+		double d = m_y[k];
+		m_y[k] = 0.0;
+		for (; top < n; top++) {
+			const int i = m_pattern[top];
+			const double yi = m_y[i];
+			m_y[i] = 0.0;
+			const int end = m_columnStart[i] + m_count[i];
+			for (int p = m_columnStart[i]; p < end; p++) m_y[m_rows[p]] -= m_values[p] * yi;
+			const double l = yi / m_diagonal[i];
+			d -= l * yi;
+			m_rows[end] = k;
+			m_values[end] = l;
+			m_count[i]++;
+		}
+		if (!(d > 0.0)) return false;
+		m_diagonal[k] = d;
+	}
+	return true;
+}
+
+//Column-oriented both ways: the forward pass scatters column j into the rows below it, the
+//backward pass gathers them
+void SparseCholesky::solve(double* b) const {
+	const int n = m_n;
+	for (int j = 0; j < n; j++) {
+		const double x = b[3 * j], y = b[3 * j + 1], z = b[3 * j + 2];
+		for (int p = m_columnStart[j]; p < m_columnStart[j + 1]; p++) {
+			double* row = b + 3 * m_rows[p];
+			const double l = m_values[p];
+			row[0] -= l * x;
+			row[1] -= l * y;
+			row[2] -= l * z;
+		}
+	}
+	for (int j = 0; j < n; j++) {
+		const double inverse = 1.0 / m_diagonal[j];
+		b[3 * j] *= inverse;
+		b[3 * j + 1] *= inverse;
+		b[3 * j + 2] *= inverse;
+	}
+	for (int j = n - 1; j >= 0; j--) {
+		double x = b[3 * j], y = b[3 * j + 1], z = b[3 * j + 2];
+		for (int p = m_columnStart[j]; p < m_columnStart[j + 1]; p++) {
+			const double* row = b + 3 * m_rows[p];
+			const double l = m_values[p];
+			x -= l * row[0];
+			y -= l * row[1];
+			z -= l * row[2];
+		}
+		b[3 * j] = x;
+		b[3 * j + 1] = y;
+		b[3 * j + 2] = z;
+	}
+}
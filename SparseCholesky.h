@@ -0,0 +1,40 @@
+#pragma once
+#include <vector>
+
+//Sparse LDL^T factorization of a symmetric positive definite matrix, for systems whose
+//sparsity is fixed so one factorization serves many solves.
+//
+//The matrix is given as its upper triangle by column, already permuted into elimination
+//order: a fill-reducing order matters far more than anything here. analyze() builds the
+//elimination tree and the column counts of L from the pattern alone; factor() then fills
+//in L and D with the up-looking algorithm (Davis, "Algorithm 849: A concise sparse
+//Cholesky factorization package"). Values are doubles so stiff systems keep their digits.
+class SparseCholesky {
+public:
+	//Column k of the upper triangle holds rows[columnStart[k] .. columnStart[k + 1]), all <= k
+	void analyze(int n, const std::vector<int>& columnStart, const std::vector<int>& rows);
+	//Values in the same layout as the pattern given to analyze(). False if the matrix is
+	//not positive definite; the factor is then unusable.
+	bool factor(const std::vector<int>& columnStart, const std::vector<int>& rows, const std::vector<double>& values);
+	//Overwrites b with the solution of A x = b for three right hand sides at once, stored
+	//interleaved: row i of each is b[3 * i], b[3 * i + 1], b[3 * i + 2]
+	void solve(double* b) const;
+
+	int size() const { return m_n; }
+	//Entries of L below the diagonal
+	int nonZeros() const { return m_n > 0 ? m_columnStart[m_n] : 0; }
+private:
+	int m_n = 0;
+	std::vector<int> m_parent;
+	//Column j of L is m_rows / m_values [m_columnStart[j] .. m_columnStart[j + 1])
+	std::vector<int> m_columnStart;
+	std::vector<int> m_rows;
+	std::vector<double> m_values;
+	std::vector<double> m_diagonal;
+
+	//Scratch for factor()
+	std::vector<int> m_count;
+	std::vector<int> m_flag;
+	std::vector<int> m_pattern;
+	std::vector<double> m_y;
+};
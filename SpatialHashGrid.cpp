@@ -0,0 +1,199 @@
+#include "SpatialHashGrid.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cmath>
+
+static const int ChunkSize = 256;
+static const uint64_t EmptyKey = ~0ull;
+
+//Offsets that are lexicographically after (0, 0, 0): half of the 26 neighbours
+static const int ForwardNeighbours[13][3] = {
+	{ 0, 0, 1 },
+	{ 0, 1, -1 }, { 0, 1, 0 }, { 0, 1, 1 },
+	{ 1, -1, -1 }, { 1, -1, 0 }, { 1, -1, 1 },
+	{ 1, 0, -1 }, { 1, 0, 0 }, { 1, 0, 1 },
+	{ 1, 1, -1 }, { 1, 1, 0 }, { 1, 1, 1 },
+};
+
+//21 bits per axis, so cell coordinates wrap every 2^21 cells
+uint64_t SpatialHashGrid::CellKey(int x, int y, int z) {
+	return ((uint64_t)(x & 0x1FFFFF) << 42) | ((uint64_t)(y & 0x1FFFFF) << 21) | (uint64_t)(z & 0x1FFFFF);
+}
+
+static inline uint64_t HashKey(uint64_t key) {
+	return (key * 0x9E3779B97F4A7C15ull) >> 32;
+}
+
+//Linear probing; returns -1 if the cell is empty
+int SpatialHashGrid::findCell(uint64_t key) const {
+	uint64_t slot = HashKey(key) & m_tableMask;
+	while (m_tableKeys[slot] != EmptyKey) {
+		if (m_tableKeys[slot] == key) return m_tableCells[slot];
+		slot = (slot + 1) & m_tableMask;
+	}
+	return -1;
+}
+
+void SpatialHashGrid::build(const BodyStore& bodies) {
+	const int slots = bodies.capacity();
+	m_lo.resize(slots);
+	m_hi.resize(slots);
+	m_moving.resize(slots);
+	m_bodyIds.clear();
+
+	m_sweptIds.clear();
+
+	float largest = 0.0f;
+	for (int i = 0; i < slots; i++) {
+		if (!IsCollidable(bodies, i)) continue;
+		const glm::vec3 h = WorldHalfExtent(bodies, i);
+		SweptBounds(bodies, i, m_lo[i], m_hi[i]);
+		m_moving[i] = bodies.isActive(i) && bodies.inverseMass[i] != 0.0f;
+		largest = std::max(largest, 2.0f * std::max(h.x, std::max(h.y, h.z)));
+		if (bodies.sweep.get(i) != glm::vec3(0, 0, 0)) m_sweptIds.push_back(i);
+		else m_bodyIds.push_back(i);
+	}
+	m_cellSize = cellSize > 0.0f ? std::max(cellSize, largest) : largest;
+
+	const int count = (int)m_bodyIds.size();
+	m_pairs.clear();
+	m_cellCoord.clear();
+	m_cellStart.assign(1, 0);
+	if (count == 0 || m_cellSize <= 0.0f) {
+		collideSwept();
+		return;
+	}
+
+	//Table at most half full
+	uint64_t tableSize = 16;
+	while (tableSize < (uint64_t)count * 2) tableSize <<= 1;
+	m_tableMask = tableSize - 1;
+	m_tableKeys.assign(tableSize, EmptyKey);
+	m_tableCells.resize(tableSize);
+	m_bodyCell.resize(count);
+
+	const float inverseCell = 1.0f / m_cellSize;
+	for (int k = 0; k < count; k++) {
+		const int i = m_bodyIds[k];
+		glm::ivec3 c(
+			(int)std::floor(bodies.currPos.x[i] * inverseCell),
+			(int)std::floor(bodies.currPos.y[i] * inverseCell),
+			(int)std::floor(bodies.currPos.z[i] * inverseCell));
+		const uint64_t key = CellKey(c.x, c.y, c.z);
+
+		uint64_t slot = HashKey(key) & m_tableMask;
+		while (m_tableKeys[slot] != EmptyKey && m_tableKeys[slot] != key) {
+			slot = (slot + 1) & m_tableMask;
+		}
+		if (m_tableKeys[slot] == EmptyKey) {
+			m_tableKeys[slot] = key;
+			m_tableCells[slot] = (int)m_cellCoord.size();
+			m_cellCoord.push_back(c);
+		}
+		m_bodyCell[k] = m_tableCells[slot];
+	}
+
+	//Counting sort of bodies by cell; bodies keep id order within a cell
+	const int cells = (int)m_cellCoord.size();
+	m_cellStart.assign(cells + 1, 0);
+	for (int k = 0; k < count; k++) m_cellStart[m_bodyCell[k] + 1]++;
+	for (int c = 0; c < cells; c++) m_cellStart[c + 1] += m_cellStart[c];
+	m_sorted.resize(count);
+	std::vector<int> cursor(m_cellStart.begin(), m_cellStart.end() - 1);
+	for (int k = 0; k < count; k++) m_sorted[cursor[m_bodyCell[k]]++] = m_bodyIds[k];
+
+	//Each fixed-size chunk of cells writes its own list; joining them in chunk order keeps
+	//the output independent of scheduling
+	const int chunks = (cells + ChunkSize - 1) / ChunkSize;
+	m_chunkPairs.resize(chunks);
+	ThreadPool::Global().parallelFor(cells, ChunkSize, [&](int begin, int end) {
+		std::vector<BodyPair>& out = m_chunkPairs[begin / ChunkSize];
+		out.clear();
+		for (int c = begin; c < end; c++) collide(c, out);
+	});
+	for (int c = 0; c < chunks; c++) {
+		m_pairs.insert(m_pairs.end(), m_chunkPairs[c].begin(), m_chunkPairs[c].end());
+	}
+	collideSwept();
+}
+
+void SpatialHashGrid::collide(int cell, std::vector<BodyPair>& out) const {
+	const int begin = m_cellStart[cell];
+	const int end = m_cellStart[cell + 1];
+	auto test = [&](int a, int b) {
+		if (!m_moving[a] && !m_moving[b]) return;
+		if (!Overlaps(m_lo[a], m_hi[a], m_lo[b], m_hi[b])) return;
+		BodyPair pair;
+		pair.a = std::min(a, b);
+		pair.b = std::max(a, b);
+		out.push_back(pair);
+	};
+
+	for (int i = begin; i < end; i++) {
+		for (int j = i + 1; j < end; j++) test(m_sorted[i], m_sorted[j]);
+	}
+
+	const glm::ivec3 c = m_cellCoord[cell];
+	for (int n = 0; n < 13; n++) {
+		const int other = findCell(CellKey(c.x + ForwardNeighbours[n][0], c.y + ForwardNeighbours[n][1], c.z + ForwardNeighbours[n][2]));
+		if (other < 0) continue;
+		for (int i = begin; i < end; i++) {
+			for (int j = m_cellStart[other]; j < m_cellStart[other + 1]; j++) test(m_sorted[i], m_sorted[j]);
+		}
+	}
+}
+
+//Swept boxes can be far larger than a cell, so they are not binned. Each looks up the cells
+//its box covers, widened by one cell for the bodies binned by centre; when that range holds
+//more cells than are occupied, it walks the occupied cells instead. There are only ever a
+//few swept bodies, so this runs serially.
+void SpatialHashGrid::collideSwept() {
+	const int swept = (int)m_sweptIds.size();
+	if (swept == 0) return;
+	const float inverseCell = 1.0f / m_cellSize;
+	const int cells = (int)m_cellCoord.size();
+
+	for (int s = 0; s < swept; s++) {
+		const int a = m_sweptIds[s];
+		auto test = [&](int b) {
+			if (!m_moving[a] && !m_moving[b]) return;
+			if (!Overlaps(m_lo[a], m_hi[a], m_lo[b], m_hi[b])) return;
+			BodyPair pair;
+			pair.a = std::min(a, b);
+			pair.b = std::max(a, b);
+			m_pairs.push_back(pair);
+		};
+		auto testCell = [&](int cell) {
+			for (int k = m_cellStart[cell]; k < m_cellStart[cell + 1]; k++) test(m_sorted[k]);
+		};
+
+		if (cells > 0) {
+			const glm::ivec3 lo(
+				(int)std::floor(m_lo[a].x * inverseCell) - 1,
+				(int)std::floor(m_lo[a].y * inverseCell) - 1,
+				(int)std::floor(m_lo[a].z * inverseCell) - 1);
+			const glm::ivec3 hi(
+				(int)std::floor(m_hi[a].x * inverseCell) + 1,
+				(int)std::floor(m_hi[a].y * inverseCell) + 1,
+				(int)std::floor(m_hi[a].z * inverseCell) + 1);
+			const double range = (double)(hi.x - lo.x + 1) * (hi.y - lo.y + 1) * (hi.z - lo.z + 1);
+			if (range <= cells) {
+				for (int x = lo.x; x <= hi.x; x++) {
+					for (int y = lo.y; y <= hi.y; y++) {
+						for (int z = lo.z; z <= hi.z; z++) {
+							const int cell = findCell(CellKey(x, y, z));
+							if (cell >= 0) testCell(cell);
+						}
+					}
+				}
+			}
+			else {
+				for (int cell = 0; cell < cells; cell++) {
+					const glm::ivec3 c = m_cellCoord[cell];
+					if (c.x >= lo.x && c.x <= hi.x && c.y >= lo.y && c.y <= hi.y && c.z >= lo.z && c.z <= hi.z) testCell(cell);
+				}
+			}
+		}
+		for (int t = s + 1; t < swept; t++) test(m_sweptIds[t]);
+	}
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include "Broadphase.h"
+#include <cstdint>
+#include <vector>
+
+//Uniform grid broadphase over the box extents in a BodyStore.
+//
+//Each body is binned by its center into a cube cell at least as large as the biggest box,
+//so any overlapping pair sits in the same or adjacent cells. The occupied cells live in an
+//open-addressed hash table, and bodies are counting-sorted by cell so each cell's bodies are
+//contiguous. Both are rebuilt from scratch every step. Each cell is then tested against
+//itself and its 13 forward neighbours, which finds every overlapping pair exactly once.
+//
+//Works best when boxes are of similar size; one huge box inflates every cell. Bodies with a
+//sweep (see BodyStore::sweep) are kept out of the cells and look up the cells they cross,
+//so a fast body does not inflate them.
+class SpatialHashGrid {
+public:
+	void build(const BodyStore& bodies);
+
+	//Pairs whose boxes overlap, in a deterministic order independent of the thread count
+	const std::vector<BodyPair>& pairs() const { return m_pairs; }
+
+	//Cell edge length; 0 derives it each build from the largest box
+	float cellSize = 0.0f;
+	float lastCellSize() const { return m_cellSize; }
+	int cellCount() const { return (int)m_cellStart.size() - 1; }
+private:
+	static uint64_t CellKey(int x, int y, int z);
+	int findCell(uint64_t key) const;
+	void collide(int cell, std::vector<BodyPair>& out) const;
+	void collideSwept();
+
+	float m_cellSize = 0.0f;
+
+	//Bounds of every body, indexed by body id
+	std::vector<glm::vec3> m_lo;
+	std::vector<glm::vec3> m_hi;
+	//Awake and dynamic; pairs of two bodies that cannot move are skipped
+	std::vector<unsigned char> m_moving;
+
+	//Hash table from cell key to cell index; m_tableMask + 1 slots
+	std::vector<uint64_t> m_tableKeys;
+	std::vector<int> m_tableCells;
+	uint64_t m_tableMask = 0;
+
+	//Per collidable body: id and cell
+	std::vector<int> m_bodyIds;
+	std::vector<int> m_bodyCell;
+	//Collidable bodies with a sweep; not in any cell
+	std::vector<int> m_sweptIds;
+
+	//Bodies of cell c are m_sorted[m_cellStart[c] .. m_cellStart[c + 1])
+	std::vector<glm::ivec3> m_cellCoord;
+	std::vector<int> m_cellStart;
+	std::vector<int> m_sorted;
+
+	std::vector<std::vector<BodyPair>> m_chunkPairs;
+	std::vector<BodyPair> m_pairs;
+};
@@ -0,0 +1,242 @@
+#include "SphFluid.h"
+#include "ThreadPool.h"
+#include "Simd.h"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+
+static const int GatherChunk = 4096;
+static const int ChunkSize = 256;
+//Grids over a sparse spray would be mostly empty; beyond this many cells per particle the
+//cells are widened instead, which only costs more distance tests
+static const int MaxCellsPerParticle = 8;
+static const float Pi = 3.14159265f;
+
+int SphFluid::add(int body) {
+	particles.push_back(body);
+	return (int)particles.size() - 1;
+}
+
+void SphFluid::apply(BodyStore& bodies) {
+	gather(bodies);
+	if (m_ids.empty()) return;
+	buildCells();
+	computeDensity();
+	computeForces(bodies);
+}
+
+//Compacts the live particles in list order and gives each its cell key
+void SphFluid::gather(const BodyStore& bodies) {
+	ThreadPool& pool = ThreadPool::Global();
+	const int count = size();
+	auto live = [&](int p) { return bodies.isActive(particles[p]) || bodies.isSleeping(particles[p]); };
+	glm::vec3 lo, hi;
+	const int total = ParallelGather::Count(count, live, [&](int p) { return bodies.currPos.get(particles[p]); }, m_gatherBuffers, lo, hi);
+	m_ids.resize(total);
+	m_keys.resize(total);
+	if (total == 0) return;
+
+	//Grid over the particle bounds
+	m_origin = lo;
+	m_cellSize = smoothingRadius;
+	const glm::vec3 extent = hi - lo;
+	for (;;) {
+		m_dims = glm::ivec3((int)(extent.x / m_cellSize) + 1, (int)(extent.y / m_cellSize) + 1, (int)(extent.z / m_cellSize) + 1);
+		const double cells = (double)m_dims.x * m_dims.y * m_dims.z;
+		const double limit = (double)total * MaxCellsPerParticle + 64.0;
+		if (cells <= limit) break;
+		m_cellSize *= std::max(1.01f, (float)std::cbrt(cells / limit));
+	}
+	const float inverseCell = 1.0f / m_cellSize;
+	const glm::ivec3 dims = m_dims;
+
+	ParallelGather::Compact(count, live, [&](int k, int p) {
+		const int i = particles[p];
+		const int x = std::min((int)((bodies.currPos.x[i] - lo.x) * inverseCell), dims.x - 1);
+		const int y = std::min((int)((bodies.currPos.y[i] - lo.y) * inverseCell), dims.y - 1);
+		const int z = std::min((int)((bodies.currPos.z[i] - lo.z) * inverseCell), dims.z - 1);
+		m_ids[k] = i;
+		m_keys[k] = (unsigned int)((z * dims.y + y) * dims.x + x);
+	}, m_gatherBuffers);
+
+	//Cell-ordered copies, filled once the order is known. One vector of zero padding lets
+	//the neighbour loops read past the last particle.
+	const int padded = total + SIMD_WIDTH;
+	m_px.assign(padded, 0.0f);
+	m_py.assign(padded, 0.0f);
+	m_pz.assign(padded, 0.0f);
+	m_vx.assign(padded, 0.0f);
+	m_vy.assign(padded, 0.0f);
+	m_vz.assign(padded, 0.0f);
+	m_mass.assign(padded, 0.0f);
+	m_density.assign(padded, 0.0f);
+	m_pressure.assign(padded, 0.0f);
+	m_volume.assign(padded, 0.0f);
+
+	int keyBits = 1;
+	while (keyBits < 32 && ((size_t)1 << keyBits) < (size_t)m_dims.x * m_dims.y * m_dims.z) keyBits++;
+	RadixSort::SortPairs(m_keys, m_ids, keyBits, m_sortBuffers);
+
+	pool.parallelFor(total, GatherChunk, [&](int begin, int end) {
+		for (int k = begin; k < end; k++) {
+			const int i = m_ids[k];
+			m_px[k] = bodies.currPos.x[i];
+			m_py[k] = bodies.currPos.y[i];
+			m_pz[k] = bodies.currPos.z[i];
+			m_vx[k] = bodies.velocity.x[i];
+			m_vy[k] = bodies.velocity.y[i];
+			m_vz[k] = bodies.velocity.z[i];
+			m_mass[k] = bodies.mass[i];
+		}
+	});
+}
+
+//The first and last particle of each run of equal keys mark that cell's range
+void SphFluid::buildCells() {
+	ThreadPool& pool = ThreadPool::Global();
+	const int cells = m_dims.x * m_dims.y * m_dims.z;
+	const int count = (int)m_keys.size();
+	m_cellBegin.resize(cells);
+	m_cellEnd.resize(cells);
+	pool.parallelFor(cells, GatherChunk, [&](int begin, int end) {
+		std::fill(m_cellBegin.begin() + begin, m_cellBegin.begin() + end, 0);
+		std::fill(m_cellEnd.begin() + begin, m_cellEnd.begin() + end, 0);
+	});
+	pool.parallelFor(count, GatherChunk, [&](int begin, int end) {
+		for (int k = begin; k < end; k++) {
+			const unsigned int key = m_keys[k];
+			if (k == 0 || m_keys[k - 1] != key) m_cellBegin[key] = k;
+			if (k == count - 1 || m_keys[k + 1] != key) m_cellEnd[key] = k + 1;
+		}
+	});
+}
+
+template <typename Fn>
+void SphFluid::forEachNeighbourRange(int k, Fn fn) const {
+	const int key = (int)m_keys[k];
+	const int x = key % m_dims.x;
+	const int y = (key / m_dims.x) % m_dims.y;
+	const int z = key / (m_dims.x * m_dims.y);
+	const int x0 = std::max(x - 1, 0);
+	const int x1 = std::min(x + 1, m_dims.x - 1);
+	for (int cz = std::max(z - 1, 0); cz <= std::min(z + 1, m_dims.z - 1); cz++) {
+		for (int cy = std::max(y - 1, 0); cy <= std::min(y + 1, m_dims.y - 1); cy++) {
+			const int row = (cz * m_dims.y + cy) * m_dims.x;
+			int begin = INT_MAX;
+			int end = 0;
+			for (int cx = x0; cx <= x1; cx++) {
+				if (m_cellEnd[row + cx] == 0) continue;
+				begin = std::min(begin, m_cellBegin[row + cx]);
+				end = m_cellEnd[row + cx];
+			}
+			if (begin < end) fn(begin, end);
+		}
+	}
+}
+
+//Lane numbers, for masking off the lanes of a vector that run past the end of a range
+static const float LaneIndex[8] = { 0, 1, 2, 3, 4, 5, 6, 7 };
+
+static inline float HorizontalSum(Simd::Float v) {
+	float lanes[SIMD_WIDTH];
+	Simd::Store(lanes, v);
+	float sum = 0.0f;
+	for (int lane = 0; lane < SIMD_WIDTH; lane++) sum += lanes[lane];
+	return sum;
+}
+
+//Poly6 kernel; each particle's own mass is included. Ranges are read a whole vector at a
+//time; the particle arrays are padded so the last vector never runs off the end.
+void SphFluid::computeDensity() {
+	const float h2 = smoothingRadius * smoothingRadius;
+	const float poly6 = 315.0f / (64.0f * Pi * std::pow(smoothingRadius, 9.0f));
+	const Simd::Float vh2 = Simd::Set1(h2);
+	const Simd::Float lanes = Simd::Load(LaneIndex);
+	ThreadPool::Global().parallelFor((int)m_ids.size(), ChunkSize, [&](int begin, int end) {
+		for (int k = begin; k < end; k++) {
+			const Simd::Float px = Simd::Set1(m_px[k]);
+			const Simd::Float py = Simd::Set1(m_py[k]);
+			const Simd::Float pz = Simd::Set1(m_pz[k]);
+			Simd::Float sum = Simd::Zero();
+			forEachNeighbourRange(k, [&](int first, int last) {
+				for (int j = first; j < last; j += SIMD_WIDTH) {
+					const Simd::Float valid = Simd::Greater(Simd::Set1((float)(last - j)), lanes);
+					const Simd::Float dx = Simd::Sub(Simd::Load(&m_px[j]), px);
+					const Simd::Float dy = Simd::Sub(Simd::Load(&m_py[j]), py);
+					const Simd::Float dz = Simd::Sub(Simd::Load(&m_pz[j]), pz);
+					const Simd::Float r2 = Simd::Add(Simd::Add(Simd::Mul(dx, dx), Simd::Mul(dy, dy)), Simd::Mul(dz, dz));
+					const Simd::Float w = Simd::Max(Simd::Sub(vh2, r2), Simd::Zero());
+					const Simd::Float m = Simd::And(Simd::Load(&m_mass[j]), valid);
+					sum = Simd::Add(sum, Simd::Mul(m, Simd::Mul(Simd::Mul(w, w), w)));
+				}
+			});
+			const float density = poly6 * HorizontalSum(sum);
+			m_density[k] = density;
+			m_pressure[k] = std::max(stiffness * (density - restDensity), 0.0f);
+			m_volume[k] = m_mass[k] / density;
+		}
+	});
+}
+
+//Symmetrized pressure with the spiky kernel gradient and viscosity with the viscosity
+//kernel Laplacian. Both give a force density; dividing by the particle's density gives its
+//acceleration. Coincident particles, the particle itself included, are masked out.
+void SphFluid::computeForces(BodyStore& bodies) const {
+	const float h = smoothingRadius;
+	const float spiky = 45.0f / (Pi * std::pow(h, 6.0f));
+	const Simd::Float vh = Simd::Set1(h);
+	const Simd::Float vh2 = Simd::Set1(h * h);
+	const Simd::Float half = Simd::Set1(0.5f);
+	const Simd::Float mu = Simd::Set1(viscosity);
+	const Simd::Float lanes = Simd::Load(LaneIndex);
+	ThreadPool::Global().parallelFor((int)m_ids.size(), ChunkSize, [&](int begin, int end) {
+		for (int k = begin; k < end; k++) {
+			const int i = m_ids[k];
+			if (!bodies.isActive(i)) continue;
+			const Simd::Float px = Simd::Set1(m_px[k]);
+			const Simd::Float py = Simd::Set1(m_py[k]);
+			const Simd::Float pz = Simd::Set1(m_pz[k]);
+			const Simd::Float vx = Simd::Set1(m_vx[k]);
+			const Simd::Float vy = Simd::Set1(m_vy[k]);
+			const Simd::Float vz = Simd::Set1(m_vz[k]);
+			const Simd::Float pressure = Simd::Set1(m_pressure[k]);
+			Simd::Float fx = Simd::Zero(), fy = Simd::Zero(), fz = Simd::Zero();
+			forEachNeighbourRange(k, [&](int first, int last) {
+				for (int j = first; j < last; j += SIMD_WIDTH) {
+					const Simd::Float dx = Simd::Sub(px, Simd::Load(&m_px[j]));
+					const Simd::Float dy = Simd::Sub(py, Simd::Load(&m_py[j]));
+					const Simd::Float dz = Simd::Sub(pz, Simd::Load(&m_pz[j]));
+					const Simd::Float r2 = Simd::Add(Simd::Add(Simd::Mul(dx, dx), Simd::Mul(dy, dy)), Simd::Mul(dz, dz));
+					const Simd::Float valid = Simd::And(Simd::Greater(Simd::Set1((float)(last - j)), lanes),
+						Simd::And(Simd::Greater(vh2, r2), Simd::Greater(r2, Simd::Zero())));
+					const Simd::Float r = Simd::Sqrt(r2);
+					const Simd::Float q = Simd::Sub(vh, r);
+					const Simd::Float share = Simd::And(Simd::Load(&m_volume[j]), valid);
+					const Simd::Float push = Simd::And(Simd::Div(Simd::Mul(Simd::Mul(share, Simd::Mul(half, Simd::Add(pressure, Simd::Load(&m_pressure[j])))), Simd::Mul(q, q)), r), valid);
+					const Simd::Float drag = Simd::Mul(Simd::Mul(share, mu), q);
+					fx = Simd::Add(fx, Simd::Add(Simd::Mul(push, dx), Simd::Mul(drag, Simd::Sub(Simd::Load(&m_vx[j]), vx))));
+					fy = Simd::Add(fy, Simd::Add(Simd::Mul(push, dy), Simd::Mul(drag, Simd::Sub(Simd::Load(&m_vy[j]), vy))));
+					fz = Simd::Add(fz, Simd::Add(Simd::Mul(push, dz), Simd::Mul(drag, Simd::Sub(Simd::Load(&m_vz[j]), vz))));
+				}
+			});
+			const float scale = spiky * m_volume[k];
+			float force[3] = { scale * HorizontalSum(fx), scale * HorizontalSum(fy), scale * HorizontalSum(fz) };
+
+			if (useContainer) {
+				const float m = m_mass[k];
+				const float p[3] = { m_px[k], m_py[k], m_pz[k] };
+				const float v[3] = { m_vx[k], m_vy[k], m_vz[k] };
+				for (int axis = 0; axis < 3; axis++) {
+					const float below = container.lo[axis] - p[axis];
+					const float above = p[axis] - container.hi[axis];
+					if (below > 0.0f) force[axis] += m * (wallStiffness * below - wallDamping * std::min(v[axis], 0.0f));
+					else if (above > 0.0f) force[axis] -= m * (wallStiffness * above + wallDamping * std::max(v[axis], 0.0f));
+				}
+			}
+
+			bodies.force.x[i] += force[0];
+			bodies.force.y[i] += force[1];
+			bodies.force.z[i] += force[2];
+		}
+	});
+}
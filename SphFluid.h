@@ -0,0 +1,88 @@
+#pragma once
+#include "BodyStore.h"
+#include "Aabb.h"
+#include "ParallelGather.h"
+#include "RadixSort.h"
+#include <vector>
+
+//Weakly compressible smoothed-particle hydrodynamics over a set of bodies.
+//
+//Fluid particles are ordinary bodies, so the integrator moves them and gravity and drag act
+//on them like on any other body; apply() only adds the pressure and viscosity forces
+//(Muller et al. 2003 kernels). Each apply():
+//	- bins the live particles into cubic cells at least one smoothing radius wide
+//	- radix sorts them by cell, a few counting-sort passes on the thread pool
+//	- copies positions, velocities and masses into cell order, so every neighbour loop
+//	  streams through contiguous memory. The body store itself keeps its ids.
+//	- finds each cell's range in the sorted order. Cells are numbered x fastest, so the
+//	  three cells of a row are one contiguous range and a neighbour search is 9 ranges.
+//	- computes density and pressure, then pressure and viscosity forces, one particle at a
+//	  time and a SIMD vector of neighbours at a time, with no writes to shared data
+//
+//Particles should have no collision shape; the optional container keeps them in with a
+//penalty spring instead. PhysicsSystem links every particle into one island, so the fluid
+//falls asleep and wakes as a whole.
+class SphFluid {
+public:
+	int add(int body);
+	void reserve(int n) { particles.reserve(n); }
+	void clear() { particles.clear(); }
+	int size() const { return (int)particles.size(); }
+
+	//Adds pressure, viscosity and container forces to every awake particle
+	void apply(BodyStore& bodies);
+
+	//Body id of each particle
+	AlignedVector<int> particles;
+
+	//Kernel support; neighbours further apart than this do not interact
+	float smoothingRadius = 0.2f;
+	float restDensity = 1000.0f;
+	//Pressure is stiffness * (density - restDensity), never negative. Sound speed is
+	//sqrt(stiffness); keep it below about 0.4 * smoothingRadius / dt.
+	float stiffness = 50.0f;
+	float viscosity = 2.0f;
+
+	//Particles leaving the container are pushed back by a damped spring, per unit mass
+	bool useContainer = false;
+	Aabb container = { glm::vec3(-5, 0, -5), glm::vec3(5, 10, 5) };
+	float wallStiffness = 5000.0f;
+	float wallDamping = 70.0f;
+
+	//Density of particle k of the last apply(), in cell order; see sortedIds(). Padded
+	//past the last particle.
+	const AlignedVector<float>& densities() const { return m_density; }
+	const std::vector<int>& sortedIds() const { return m_ids; }
+	float lastCellSize() const { return m_cellSize; }
+private:
+	void gather(const BodyStore& bodies);
+	void buildCells();
+	void computeDensity();
+	void computeForces(BodyStore& bodies) const;
+	//Calls fn(begin, end) for the sorted ranges of the cells around particle k
+	template <typename Fn>
+	void forEachNeighbourRange(int k, Fn fn) const;
+
+	//Live particles and their cell, sorted by cell
+	std::vector<int> m_ids;
+	std::vector<unsigned int> m_keys;
+	RadixSort::Buffers<unsigned int> m_sortBuffers;
+	ParallelGather::Buffers m_gatherBuffers;
+
+	//Grid of m_dims cells from m_origin. Cell c holds sorted particles
+	//[m_cellBegin[c], m_cellEnd[c]); both are 0 for an empty cell.
+	glm::vec3 m_origin = glm::vec3(0, 0, 0);
+	float m_cellSize = 0.0f;
+	glm::ivec3 m_dims = glm::ivec3(0, 0, 0);
+	std::vector<int> m_cellBegin;
+	std::vector<int> m_cellEnd;
+
+	//Per particle in cell order
+	AlignedVector<float> m_px, m_py, m_pz;
+	AlignedVector<float> m_vx, m_vy, m_vz;
+	AlignedVector<float> m_mass;
+	AlignedVector<float> m_density;
+	AlignedVector<float> m_pressure;
+	//Mass over density
+	AlignedVector<float> m_volume;
+};
@@ -0,0 +1,191 @@
+#include "SpringNetwork.h"
+#include "ThreadPool.h"
+
+int SpringNetwork::add(int a, int b, float k, float c, float rest) {
+	assert(a >= 0 && b >= 0 && a != b);
+	bodyA.push_back(a);
+	bodyB.push_back(b);
+	stiffness.push_back(k);
+	damping.push_back(c);
+	restLength.push_back(rest);
+	m_topologyVersion++;
+	return (int)bodyA.size() - 1;
+}
+
+void SpringNetwork::reserve(int n) {
+	bodyA.reserve(n);
+	bodyB.reserve(n);
+	stiffness.reserve(n);
+	damping.reserve(n);
+	restLength.reserve(n);
+}
+
+void SpringNetwork::clear() {
+	bodyA.clear();
+	bodyB.clear();
+	stiffness.clear();
+	damping.clear();
+	restLength.clear();
+	m_coloring.reset();
+	m_topologyVersion++;
+}
+
+void SpringNetwork::apply(BodyStore& bodies, ForceKernels::Mode mode, const IslandGraph* islands) {
+	updateAwake(bodies);
+	const bool allAwake = m_allAwake;
+	const int count = allAwake ? size() : (int)m_awakeSprings.size();
+	m_forceX.resize(count);
+	m_forceY.resize(count);
+	m_forceZ.resize(count);
+
+	ThreadPool& pool = ThreadPool::Global();
+	if (!allAwake) {
+		m_packedA.resize(count);
+		m_packedB.resize(count);
+		m_packedStiffness.resize(count);
+		m_packedDamping.resize(count);
+		m_packedRestLength.resize(count);
+		pool.parallelFor(count, 4096, [&](int begin, int end) {
+			for (int i = begin; i < end; i++) {
+				const int s = m_awakeSprings[i];
+				m_packedA[i] = bodyA[s];
+				m_packedB[i] = bodyB[s];
+				m_packedStiffness[i] = stiffness[s];
+				m_packedDamping[i] = damping[s];
+				m_packedRestLength[i] = restLength[s];
+			}
+		});
+	}
+	const int* a = allAwake ? bodyA.data() : m_packedA.data();
+	const int* b = allAwake ? bodyB.data() : m_packedB.data();
+	const float* k = allAwake ? stiffness.data() : m_packedStiffness.data();
+	const float* c = allAwake ? damping.data() : m_packedDamping.data();
+	const float* rest = allAwake ? restLength.data() : m_packedRestLength.data();
+
+	pool.parallelFor(count, 4096, [&](int begin, int end) {
+		ForceKernels::SpringForces(a + begin, b + begin, k + begin, c + begin, rest + begin, end - begin,
+			bodies.currPos.x.data(), bodies.currPos.y.data(), bodies.currPos.z.data(),
+			bodies.velocity.x.data(), bodies.velocity.y.data(), bodies.velocity.z.data(),
+			m_forceX.data() + begin, m_forceY.data() + begin, m_forceZ.data() + begin, mode);
+	});
+
+	float* fx = bodies.force.x.data();
+	float* fy = bodies.force.y.data();
+	float* fz = bodies.force.z.data();
+
+	//Many small islands: each island scatters its own springs, with no barrier between colors.
+	//Only the worst island is serial, so fall back to colors when one island dominates.
+	if (islands && islands->largestSpringCount() * 4 * pool.threadCount() <= size()) {
+		const std::vector<int>& springStart = islands->springStart();
+		const std::vector<int>& islandSprings = islands->springs();
+		pool.parallelFor(islands->count(), 64, [&](int begin, int end) {
+			for (int n = begin; n < end; n++) {
+				for (int i = springStart[n]; i < springStart[n + 1]; i++) {
+					const int s = islandSprings[i];
+					const int f = allAwake ? s : m_packedIndex[s];
+					if (f < 0) continue;
+					//Static endpoints are shared between islands and never read their force
+					const int a = bodyA[s];
+					const int b = bodyB[s];
+					if (islands->islandOf(a) == n) {
+						fx[a] += m_forceX[f];
+						fy[a] += m_forceY[f];
+						fz[a] += m_forceZ[f];
+					}
+					if (islands->islandOf(b) == n) {
+						fx[b] -= m_forceX[f];
+						fy[b] -= m_forceY[f];
+						fz[b] -= m_forceZ[f];
+					}
+				}
+			}
+		});
+		return;
+	}
+
+	updateColoring(bodies.capacity());
+	const std::vector<int>& groupStart = m_coloring.groupStart();
+	const std::vector<int>& items = m_coloring.items();
+	const int groups = m_coloring.groupCount();
+	for (int g = 0; g < groups; g++) {
+		const int* group = items.data() + groupStart[g];
+		auto scatter = [&](int begin, int end) {
+			for (int i = begin; i < end; i++) {
+				const int s = group[i];
+				const int f = allAwake ? s : m_packedIndex[s];
+				if (f < 0) continue;
+				const int a = bodyA[s];
+				const int b = bodyB[s];
+				fx[a] += m_forceX[f];
+				fy[a] += m_forceY[f];
+				fz[a] += m_forceZ[f];
+				fx[b] -= m_forceX[f];
+				fy[b] -= m_forceY[f];
+				fz[b] -= m_forceZ[f];
+			}
+		};
+		const int n = groupStart[g + 1] - groupStart[g];
+		if (m_coloring.hasOverflow() && g == groups - 1) {
+			scatter(0, n);
+		}
+		else {
+			pool.parallelFor(n, 2048, scatter);
+		}
+	}
+}
+
+void SpringNetwork::updateAwake(const BodyStore& bodies) {
+	if (m_awakeTopologyVersion == m_topologyVersion && m_awakeActiveVersion == bodies.activeVersion()) return;
+
+	const int count = size();
+	m_awakeSprings.clear();
+	m_packedIndex.resize(count);
+	for (int s = 0; s < count; s++) {
+		if (bodies.isActive(bodyA[s]) || bodies.isActive(bodyB[s])) {
+			m_packedIndex[s] = (int)m_awakeSprings.size();
+			m_awakeSprings.push_back(s);
+		}
+		else {
+			m_packedIndex[s] = -1;
+		}
+	}
+	m_allAwake = (int)m_awakeSprings.size() == count;
+
+	m_awakeTopologyVersion = m_topologyVersion;
+	m_awakeActiveVersion = bodies.activeVersion();
+}
+
+void SpringNetwork::updateColoring(int bodyCount) {
+	m_coloring.extend(size(), 2, bodyCount, [this](int s, int k) {
+		return k == 0 ? bodyA[s] : bodyB[s];
+	});
+}
+
+void SpringNetwork::updateAdjacency(int bodyCount) {
+	if (m_adjacencyVersion == m_topologyVersion && m_adjacencyBodyCount == bodyCount) return;
+
+	const int count = size();
+	m_adjacencyStart.assign(bodyCount + 1, 0);
+	for (int s = 0; s < count; s++) {
+		m_adjacencyStart[bodyA[s] + 1]++;
+		m_adjacencyStart[bodyB[s] + 1]++;
+	}
+	for (int i = 0; i < bodyCount; i++) {
+		m_adjacencyStart[i + 1] += m_adjacencyStart[i];
+	}
+
+	m_adjacencySprings.resize(count * 2);
+	m_adjacencyBodies.resize(count * 2);
+	std::vector<int> cursor(m_adjacencyStart.begin(), m_adjacencyStart.end() - 1);
+	for (int s = 0; s < count; s++) {
+		int slot = cursor[bodyA[s]]++;
+		m_adjacencySprings[slot] = s;
+		m_adjacencyBodies[slot] = bodyB[s];
+		slot = cursor[bodyB[s]]++;
+		m_adjacencySprings[slot] = s;
+		m_adjacencyBodies[slot] = bodyA[s];
+	}
+
+	m_adjacencyVersion = m_topologyVersion;
+	m_adjacencyBodyCount = bodyCount;
+}
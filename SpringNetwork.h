@@ -0,0 +1,79 @@
+#pragma once
+#include "Globals.h"
+#include "AlignedAllocator.h"
+#include "BodyStore.h"
+#include "ForceKernels.h"
+#include "GraphColoring.h"
+#include "IslandGraph.h"
+#include <vector>
+
+//Flat list of damped springs between bodies in a BodyStore.
+//Per-spring data lives in parallel arrays indexed by spring id; the body -> spring
+//adjacency is kept as a compressed sparse row (CSR) view that is rebuilt lazily
+//whenever the topology changes.
+//Springs whose endpoints are both asleep or inactive are skipped.
+//Springs are also graph-colored so that forces can be scattered in parallel: springs of
+//one color share no endpoint, so each color is written by all threads without atomics.
+class SpringNetwork {
+public:
+	int add(int a, int b, float stiffness = 8.0f, float damping = 0.1f, float restLength = 1.0f);
+	void reserve(int n);
+	void clear();
+	int size() const { return (int)bodyA.size(); }
+
+	//Evaluates every spring in one batched pass, then scatters the forces into bodies.force
+	//one color at a time. Both passes run on the global thread pool.
+	//Given islands built over this network, the scatter instead runs one task per island
+	//when no island is large enough to stall the others; static bodies then get no force.
+	void apply(BodyStore& bodies, ForceKernels::Mode mode = ForceKernels::Vectorized, const IslandGraph* islands = nullptr);
+
+	//Colors any springs added since the last call; a clear() triggers a full recolor
+	void updateColoring(int bodyCount);
+	GraphColoring& coloring() { return m_coloring; }
+
+	//Rebuilds the CSR view if the topology or body count changed since the last call.
+	//Springs touching body i are adjacencySprings[adjacencyStart[i] .. adjacencyStart[i + 1]),
+	//and adjacencyBodies holds the body on the other end of each of those springs.
+	void updateAdjacency(int bodyCount);
+	const std::vector<int>& adjacencyStart() const { return m_adjacencyStart; }
+	const std::vector<int>& adjacencySprings() const { return m_adjacencySprings; }
+	const std::vector<int>& adjacencyBodies() const { return m_adjacencyBodies; }
+
+	//Bumped on every topology change so dependent caches know to rebuild
+	unsigned int topologyVersion() const { return m_topologyVersion; }
+
+	AlignedVector<int> bodyA;
+	AlignedVector<int> bodyB;
+	AlignedVector<float> stiffness;
+	AlignedVector<float> damping;
+	AlignedVector<float> restLength;
+private:
+	void updateAwake(const BodyStore& bodies);
+
+	//Springs with an awake endpoint, rebuilt when the topology or the awake set changes.
+	//When some springs sleep, the awake ones are packed into contiguous arrays each step.
+	std::vector<int> m_awakeSprings;
+	std::vector<int> m_packedIndex;
+	bool m_allAwake = true;
+	unsigned int m_awakeTopologyVersion = ~0u;
+	unsigned int m_awakeActiveVersion = ~0u;
+	AlignedVector<int> m_packedA;
+	AlignedVector<int> m_packedB;
+	AlignedVector<float> m_packedStiffness;
+	AlignedVector<float> m_packedDamping;
+	AlignedVector<float> m_packedRestLength;
+
+	//Per awake spring force on endpoint a from the last apply()
+	AlignedVector<float> m_forceX;
+	AlignedVector<float> m_forceY;
+	AlignedVector<float> m_forceZ;
+
+	GraphColoring m_coloring;
+
+	std::vector<int> m_adjacencyStart;
+	std::vector<int> m_adjacencySprings;
+	std::vector<int> m_adjacencyBodies;
+	unsigned int m_adjacencyVersion = ~0u;
+	int m_adjacencyBodyCount = -1;
+	unsigned int m_topologyVersion = 0;
+};
@@ -0,0 +1,172 @@
+#include "SweepAndPrune.h"
+#include <algorithm>
+
+uint64_t SweepAndPrune::PairKey(int a, int b) {
+	return ((uint64_t)(uint32_t)std::min(a, b) << 32) | (uint32_t)std::max(a, b);
+}
+
+//At equal values a min sorts before a max, so touching boxes count as overlapping
+//just like in Overlaps()
+bool SweepAndPrune::before(const Endpoint& a, const Endpoint& b) const {
+	return a.value < b.value || (a.value == b.value && !(a.data & 1) && (b.data & 1));
+}
+
+void SweepAndPrune::reset() {
+	for (int axis = 0; axis < 3; axis++) m_axes[axis].clear();
+	m_inSweep.clear();
+	m_overlaps.clear();
+	m_overlapIndex.clear();
+	m_pairs.clear();
+}
+
+void SweepAndPrune::build(const BodyStore& bodies) {
+	const int slots = bodies.capacity();
+	if ((int)m_inSweep.size() > slots) reset();
+	m_lo.resize(slots);
+	m_hi.resize(slots);
+	m_inSweep.resize(slots, 0);
+
+	int added = 0;
+	syncProxies(bodies, added);
+
+	for (int axis = 0; axis < 3; axis++) {
+		std::vector<Endpoint>& e = m_axes[axis];
+		for (size_t i = 0; i < e.size(); i++) {
+			const int body = e[i].data >> 1;
+			e[i].value = (e[i].data & 1) ? m_hi[body][axis] : m_lo[body][axis];
+		}
+	}
+
+	//Insertion sort is quadratic when many boxes arrive at once, e.g. on the first build
+	const int proxies = (int)m_axes[0].size() / 2;
+	if (added * 8 > proxies) {
+		rebuild();
+	}
+	else {
+		for (int axis = 0; axis < 3; axis++) sortAxis(axis);
+	}
+
+	m_pairs.clear();
+	for (size_t p = 0; p < m_overlaps.size(); p++) {
+		const int a = m_overlaps[p].a;
+		const int b = m_overlaps[p].b;
+		if ((bodies.isActive(a) && bodies.inverseMass[a] != 0.0f) ||
+			(bodies.isActive(b) && bodies.inverseMass[b] != 0.0f)) {
+			m_pairs.push_back(m_overlaps[p]);
+		}
+	}
+}
+
+//New boxes are appended past the end of every axis, where they overlap nothing, and are
+//moved into place by the next sort. Boxes that went away are dropped with their pairs.
+void SweepAndPrune::syncProxies(const BodyStore& bodies, int& added) {
+	bool removed = false;
+	for (int i = 0; i < (int)m_inSweep.size(); i++) {
+		const bool collidable = IsCollidable(bodies, i);
+		if (collidable) SweptBounds(bodies, i, m_lo[i], m_hi[i]);
+		if (collidable && !m_inSweep[i]) {
+			for (int axis = 0; axis < 3; axis++) {
+				Endpoint lo = { m_lo[i][axis], i * 2 };
+				Endpoint hi = { m_hi[i][axis], i * 2 + 1 };
+				m_axes[axis].push_back(lo);
+				m_axes[axis].push_back(hi);
+			}
+			m_inSweep[i] = 1;
+			added++;
+		}
+		else if (!collidable && m_inSweep[i]) {
+			m_inSweep[i] = 0;
+			removed = true;
+		}
+	}
+	if (!removed) return;
+
+	for (int axis = 0; axis < 3; axis++) {
+		std::vector<Endpoint>& e = m_axes[axis];
+		e.erase(std::remove_if(e.begin(), e.end(), [this](const Endpoint& p) {
+			return !m_inSweep[p.data >> 1];
+		}), e.end());
+	}
+	m_overlaps.erase(std::remove_if(m_overlaps.begin(), m_overlaps.end(), [this](const BodyPair& p) {
+		return !m_inSweep[p.a] || !m_inSweep[p.b];
+	}), m_overlaps.end());
+	m_overlapIndex.clear();
+	for (size_t p = 0; p < m_overlaps.size(); p++) {
+		m_overlapIndex[PairKey(m_overlaps[p].a, m_overlaps[p].b)] = (int)p;
+	}
+}
+
+//A min moving below another box's max may start an overlap; a max moving below another
+//box's min ends one. Whether a started overlap is real is checked on all three axes with
+//this step's bounds, so the set is exact once every axis is sorted.
+void SweepAndPrune::sortAxis(int axis) {
+	std::vector<Endpoint>& e = m_axes[axis];
+	const int count = (int)e.size();
+	for (int i = 1; i < count; i++) {
+		const Endpoint key = e[i];
+		int j = i - 1;
+		while (j >= 0 && before(key, e[j])) {
+			const int a = key.data >> 1;
+			const int b = e[j].data >> 1;
+			if (!(key.data & 1) && (e[j].data & 1)) {
+				if (Overlaps(m_lo[a], m_hi[a], m_lo[b], m_hi[b])) addPair(a, b);
+			}
+			else if ((key.data & 1) && !(e[j].data & 1)) {
+				removePair(a, b);
+			}
+			e[j + 1] = e[j];
+			j--;
+		}
+		e[j + 1] = key;
+	}
+}
+
+//Full sort and a single sweep along x, for the first build or a large batch of new boxes
+void SweepAndPrune::rebuild() {
+	for (int axis = 0; axis < 3; axis++) {
+		std::sort(m_axes[axis].begin(), m_axes[axis].end(), [this](const Endpoint& a, const Endpoint& b) {
+			return before(a, b);
+		});
+	}
+
+	m_overlaps.clear();
+	m_overlapIndex.clear();
+	m_active.clear();
+	const std::vector<Endpoint>& e = m_axes[0];
+	for (size_t i = 0; i < e.size(); i++) {
+		const int body = e[i].data >> 1;
+		if (e[i].data & 1) {
+			std::vector<int>::iterator it = std::find(m_active.begin(), m_active.end(), body);
+			*it = m_active.back();
+			m_active.pop_back();
+			continue;
+		}
+		for (size_t k = 0; k < m_active.size(); k++) {
+			const int other = m_active[k];
+			if (Overlaps(m_lo[body], m_hi[body], m_lo[other], m_hi[other])) addPair(body, other);
+		}
+		m_active.push_back(body);
+	}
+}
+
+void SweepAndPrune::addPair(int a, int b) {
+	const uint64_t key = PairKey(a, b);
+	if (m_overlapIndex.count(key)) return;
+	m_overlapIndex[key] = (int)m_overlaps.size();
+	BodyPair pair;
+	pair.a = std::min(a, b);
+	pair.b = std::max(a, b);
+	m_overlaps.push_back(pair);
+}
+
+void SweepAndPrune::removePair(int a, int b) {
+	std::unordered_map<uint64_t, int>::iterator it = m_overlapIndex.find(PairKey(a, b));
+	if (it == m_overlapIndex.end()) return;
+	const int index = it->second;
+	m_overlapIndex.erase(it);
+	if (index != (int)m_overlaps.size() - 1) {
+		m_overlaps[index] = m_overlaps.back();
+		m_overlapIndex[PairKey(m_overlaps[index].a, m_overlaps[index].b)] = index;
+	}
+	m_overlaps.pop_back();
+}
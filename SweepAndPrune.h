@@ -0,0 +1,53 @@
+#pragma once
+#include "Broadphase.h"
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+//Incremental sweep-and-prune broadphase over the box extents in a BodyStore.
+//
+//Each axis keeps a sorted array of box endpoints that persists between steps. Every
+//build refreshes the endpoint values and re-sorts with insertion sort, which is close
+//to O(n) when bodies only move a little. Each swap of a min past a max starts or ends an
+//overlap on that axis, and the persistent pair set is updated from those swaps alone.
+//
+//Unlike a uniform grid, the cost does not depend on how box sizes are distributed, so a
+//huge static floor is as cheap as any other box.
+class SweepAndPrune {
+public:
+	void build(const BodyStore& bodies);
+	//Drops all state; the next build sorts from scratch
+	void reset();
+
+	//Overlapping pairs with at least one awake dynamic body
+	const std::vector<BodyPair>& pairs() const { return m_pairs; }
+	int overlapCount() const { return (int)m_overlaps.size(); }
+private:
+	//data = body * 2 + (1 if this is the max end)
+	struct Endpoint {
+		float value;
+		int data;
+	};
+
+	static uint64_t PairKey(int a, int b);
+	bool before(const Endpoint& a, const Endpoint& b) const;
+	void syncProxies(const BodyStore& bodies, int& added);
+	void sortAxis(int axis);
+	void rebuild();
+	void addPair(int a, int b);
+	void removePair(int a, int b);
+
+	std::vector<Endpoint> m_axes[3];
+
+	//Bounds of every body, indexed by body id
+	std::vector<glm::vec3> m_lo;
+	std::vector<glm::vec3> m_hi;
+	std::vector<unsigned char> m_inSweep;
+
+	//Persistent overlap set: every pair overlapping on all three axes
+	std::vector<BodyPair> m_overlaps;
+	std::unordered_map<uint64_t, int> m_overlapIndex;
+
+	std::vector<BodyPair> m_pairs;
+	std::vector<int> m_active;
+};
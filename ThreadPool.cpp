@@ -0,0 +1,83 @@
+#include "ThreadPool.h"
+
+static thread_local bool t_insideLoop = false;
+
+ThreadPool::ThreadPool(int threadCount) {
+	if (threadCount <= 0) threadCount = (int)std::thread::hardware_concurrency();
+	if (threadCount <= 0) threadCount = 1;
+	m_next = 0;
+	for (int i = 0; i < threadCount - 1; i++) {
+		m_workers.push_back(std::thread(&ThreadPool::workerLoop, this));
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_quit = true;
+	}
+	m_wake.notify_all();
+	for (size_t i = 0; i < m_workers.size(); i++) {
+		m_workers[i].join();
+	}
+}
+
+ThreadPool& ThreadPool::Global() {
+	static ThreadPool pool;
+	return pool;
+}
+
+void ThreadPool::parallelFor(int count, int grain, const std::function<void(int, int)>& body) {
+	if (count <= 0) return;
+	if (grain < 1) grain = 1;
+	if (count <= grain || m_workers.empty() || t_insideLoop) {
+		body(0, count);
+		return;
+	}
+
+	std::lock_guard<std::mutex> submit(m_submit);
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_body = &body;
+		m_count = count;
+		m_grain = grain;
+		m_next = 0;
+		m_busy = (int)m_workers.size();
+		m_generation++;
+	}
+	m_wake.notify_all();
+
+	runChunks();
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_done.wait(lock, [this] { return m_busy == 0; });
+	m_body = nullptr;
+}
+
+void ThreadPool::workerLoop() {
+	unsigned int seen = 0;
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_wake.wait(lock, [&] { return m_quit || m_generation != seen; });
+			if (m_quit) return;
+			seen = m_generation;
+		}
+
+		runChunks();
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (--m_busy == 0) m_done.notify_one();
+	}
+}
+
+void ThreadPool::runChunks() {
+	t_insideLoop = true;
+	for (;;) {
+		int begin = m_next.fetch_add(m_grain);
+		if (begin >= m_count) break;
+		int end = begin + m_grain < m_count ? begin + m_grain : m_count;
+		(*m_body)(begin, end);
+	}
+	t_insideLoop = false;
+}
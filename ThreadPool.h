@@ -0,0 +1,42 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//Fixed set of worker threads for data-parallel loops.
+//parallelFor blocks until every chunk is done; the calling thread works too.
+//Calls made from inside a running loop execute inline, so nested use cannot deadlock.
+class ThreadPool {
+public:
+	//0 threads = one per hardware thread
+	explicit ThreadPool(int threadCount = 0);
+	~ThreadPool();
+
+	//Process-wide pool shared by the physics passes
+	static ThreadPool& Global();
+
+	int threadCount() const { return (int)m_workers.size() + 1; }
+
+	//Calls body(begin, end) on chunks of [0, count), each at most grain long
+	void parallelFor(int count, int grain, const std::function<void(int, int)>& body);
+private:
+	void workerLoop();
+	void runChunks();
+
+	std::vector<std::thread> m_workers;
+	std::mutex m_submit;
+	std::mutex m_mutex;
+	std::condition_variable m_wake;
+	std::condition_variable m_done;
+
+	const std::function<void(int, int)>* m_body = nullptr;
+	int m_count = 0;
+	int m_grain = 1;
+	std::atomic<int> m_next;
+	int m_busy = 0;
+	unsigned int m_generation = 0;
+	bool m_quit = false;
+};
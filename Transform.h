@@ -0,0 +1,21 @@
+#pragma once
+#include "Globals.h"
+#include "Aabb.h"
+
+struct Transform {
+	glm::quat rotation;
+	glm::vec3 position;
+	glm::vec3 scale;
+};
+
+//World bounds of a unit cube placed by t: each rotated axis contributes its absolute
+//extent along the world axes
+inline Aabb BoxAabb(const Transform& t) {
+	glm::mat3 r = glm::mat3_cast(t.rotation);
+	glm::vec3 h = 0.5f * t.scale;
+	glm::vec3 extent = glm::abs(r[0]) * h.x + glm::abs(r[1]) * h.y + glm::abs(r[2]) * h.z;
+	Aabb box;
+	box.lo = t.position - extent;
+	box.hi = t.position + extent;
+	return box;
+}
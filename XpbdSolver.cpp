@@ -0,0 +1,199 @@
+#include "XpbdSolver.h"
+#include "Simd.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace Simd;
+
+void XpbdSolver::step(BodyStore& bodies, SpringNetwork& springs, float dt) {
+	const int slots = bodies.capacity();
+	m_startPos.resize(slots);
+	m_weight.assign(slots, 0.0f);
+	springs.updateColoring(slots);
+	pack(springs);
+
+	Vec3Stream& pos = bodies.currPos;
+	Vec3Stream& old = bodies.oldPos;
+	Vec3Stream& vel = bodies.velocity;
+	const Vec3Stream& force = bodies.force;
+	const float* invMass = bodies.inverseMass.data();
+	bodies.forEachActive([&](int i) {
+		m_weight[i] = invMass[i];
+		m_startPos.x[i] = pos.x[i];
+		m_startPos.y[i] = pos.y[i];
+		m_startPos.z[i] = pos.z[i];
+	});
+
+	ThreadPool& pool = ThreadPool::Global();
+	const int groups = (int)m_groupStart.size() - 1;
+	const float h = dt / substeps;
+	for (int sub = 0; sub < substeps; sub++) {
+		bodies.forEachActive([&](int i) {
+			old.x[i] = pos.x[i];
+			old.y[i] = pos.y[i];
+			old.z[i] = pos.z[i];
+			vel.x[i] += force.x[i] * invMass[i] * h;
+			vel.y[i] += force.y[i] * invMass[i] * h;
+			vel.z[i] += force.z[i] * invMass[i] * h;
+			pos.x[i] += vel.x[i] * h;
+			pos.y[i] += vel.y[i] * h;
+			pos.z[i] += vel.z[i] * h;
+		});
+		std::fill(m_lambda.begin(), m_lambda.end(), 0.0f);
+
+		for (int it = 0; it < iterations; it++) {
+			for (int g = 0; g < groups; g++) {
+				const int first = m_groupStart[g];
+				const int count = m_groupStart[g + 1] - first;
+				if (m_overflow && g == groups - 1) {
+					project(bodies, first, first + count, h, false);
+				}
+				else {
+					pool.parallelFor(count, 2048, [&](int begin, int end) {
+						project(bodies, first + begin, first + end, h, true);
+					});
+				}
+			}
+		}
+
+		const float inverseH = 1.0f / h;
+		bodies.forEachActive([&](int i) {
+			vel.x[i] = (pos.x[i] - old.x[i]) * inverseH;
+			vel.y[i] = (pos.y[i] - old.y[i]) * inverseH;
+			vel.z[i] = (pos.z[i] - old.z[i]) * inverseH;
+		});
+	}
+
+	bodies.forEachActive([&](int i) {
+		old.x[i] = m_startPos.x[i];
+		old.y[i] = m_startPos.y[i];
+		old.z[i] = m_startPos.z[i];
+	});
+}
+
+//Redone every step so edits to stiffness and damping take effect; it is cheap next to
+//substeps * iterations projections
+void XpbdSolver::pack(SpringNetwork& springs) {
+	GraphColoring& coloring = springs.coloring();
+	const std::vector<int>& groupStart = coloring.groupStart();
+	const std::vector<int>& items = coloring.items();
+	const int groups = coloring.groupCount();
+	m_overflow = coloring.hasOverflow();
+
+	m_bodyA.clear();
+	m_bodyB.clear();
+	m_restLength.clear();
+	m_compliance.clear();
+	m_dampingRatio.clear();
+	m_groupStart.assign(1, 0);
+	for (int g = 0; g < groups; g++) {
+		for (int k = groupStart[g]; k < groupStart[g + 1]; k++) {
+			const int s = items[k];
+			if (springs.stiffness[s] <= 0.0f) continue;
+			m_bodyA.push_back(springs.bodyA[s]);
+			m_bodyB.push_back(springs.bodyB[s]);
+			m_restLength.push_back(springs.restLength[s]);
+			m_compliance.push_back(1.0f / springs.stiffness[s]);
+			m_dampingRatio.push_back(springs.damping[s] / springs.stiffness[s]);
+		}
+		m_groupStart.push_back((int)m_bodyA.size());
+	}
+	m_lambda.resize(m_bodyA.size());
+}
+
+//Per the XPBD paper, with C the spring's stretch and its gradient the unit vector along the
+//spring: compliance alpha = 1 / (k h^2), damping gamma = c / (k h), and
+//	dlambda = (-C - alpha lambda - gamma grad C . (x - oldPos)) / ((1 + gamma) (wa + wb) + alpha)
+void XpbdSolver::project(BodyStore& bodies, int begin, int end, float h, bool independent) {
+	float* px = bodies.currPos.x.data();
+	float* py = bodies.currPos.y.data();
+	float* pz = bodies.currPos.z.data();
+	const float* ox = bodies.oldPos.x.data();
+	const float* oy = bodies.oldPos.y.data();
+	const float* oz = bodies.oldPos.z.data();
+	const float* w = m_weight.data();
+	const float inverseH = 1.0f / h;
+	const float inverseH2 = inverseH * inverseH;
+
+	int k = begin;
+#if !SIMD_SCALAR
+	const Float one = Set1(1.0f);
+	const Float invH = Set1(inverseH);
+	const Float invH2 = Set1(inverseH2);
+	float moveX[SIMD_WIDTH], moveY[SIMD_WIDTH], moveZ[SIMD_WIDTH], scaleA[SIMD_WIDTH], scaleB[SIMD_WIDTH];
+	for (; independent && k + SIMD_WIDTH <= end; k += SIMD_WIDTH) {
+		const Int ia = LoadInt(m_bodyA.data() + k);
+		const Int ib = LoadInt(m_bodyB.data() + k);
+		const Float ax = Gather(px, ia), ay = Gather(py, ia), az = Gather(pz, ia);
+		const Float bx = Gather(px, ib), by = Gather(py, ib), bz = Gather(pz, ib);
+		Float dx = Sub(ax, bx), dy = Sub(ay, by), dz = Sub(az, bz);
+		const Float length = NormalizeMasked(dx, dy, dz);
+
+		const Float moved = Add(Add(
+			Mul(dx, Sub(Sub(ax, Gather(ox, ia)), Sub(bx, Gather(ox, ib)))),
+			Mul(dy, Sub(Sub(ay, Gather(oy, ia)), Sub(by, Gather(oy, ib))))),
+			Mul(dz, Sub(Sub(az, Gather(oz, ia)), Sub(bz, Gather(oz, ib)))));
+		const Float wa = Gather(w, ia);
+		const Float wb = Gather(w, ib);
+		const Float weight = Add(wa, wb);
+		const Float alpha = Mul(Load(m_compliance.data() + k), invH2);
+		const Float gamma = Mul(Load(m_dampingRatio.data() + k), invH);
+		const Float lambda = Load(m_lambda.data() + k);
+		const Float c = Sub(length, Load(m_restLength.data() + k));
+
+		Float delta = Div(Sub(Negate(c), Add(Mul(alpha, lambda), Mul(gamma, moved))), Add(Mul(Add(one, gamma), weight), alpha));
+		delta = And(delta, Greater(weight, Zero()));
+		Store(m_lambda.data() + k, Add(lambda, delta));
+
+		Store(moveX, dx);
+		Store(moveY, dy);
+		Store(moveZ, dz);
+		Store(scaleA, Mul(wa, delta));
+		Store(scaleB, Mul(wb, delta));
+		//No two springs of a color share a body, so the lanes scatter without conflicts
+		for (int l = 0; l < SIMD_WIDTH; l++) {
+			const int a = m_bodyA[k + l];
+			const int b = m_bodyB[k + l];
+			px[a] += scaleA[l] * moveX[l];
+			py[a] += scaleA[l] * moveY[l];
+			pz[a] += scaleA[l] * moveZ[l];
+			px[b] -= scaleB[l] * moveX[l];
+			py[b] -= scaleB[l] * moveY[l];
+			pz[b] -= scaleB[l] * moveZ[l];
+		}
+	}
+#endif
+	for (; k < end; k++) {
+		const int a = m_bodyA[k];
+		const int b = m_bodyB[k];
+		const float weight = w[a] + w[b];
+		if (weight == 0.0f) continue;
+
+		float dx = px[a] - px[b];
+		float dy = py[a] - py[b];
+		float dz = pz[a] - pz[b];
+		const float length = std::sqrt(dx * dx + dy * dy + dz * dz);
+		const float inv = length != 0.0f ? 1.0f / length : 0.0f;
+		dx *= inv;
+		dy *= inv;
+		dz *= inv;
+
+		const float moved =
+			dx * ((px[a] - ox[a]) - (px[b] - ox[b])) +
+			dy * ((py[a] - oy[a]) - (py[b] - oy[b])) +
+			dz * ((pz[a] - oz[a]) - (pz[b] - oz[b]));
+		const float alpha = m_compliance[k] * inverseH2;
+		const float gamma = m_dampingRatio[k] * inverseH;
+		const float c = length - m_restLength[k];
+		const float delta = (-c - alpha * m_lambda[k] - gamma * moved) / ((1.0f + gamma) * weight + alpha);
+		m_lambda[k] += delta;
+
+		px[a] += w[a] * delta * dx;
+		py[a] += w[a] * delta * dy;
+		pz[a] += w[a] * delta * dz;
+		px[b] -= w[b] * delta * dx;
+		py[b] -= w[b] * delta * dy;
+		pz[b] -= w[b] * delta * dz;
+	}
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include "Globals.h"
+#include "BodyStore.h"
+#include "SpringNetwork.h"
+
+//Extended position-based dynamics (Macklin et al. 2016) for the spring network.
+//
+//Each spring becomes a compliant distance constraint with compliance 1 / stiffness, and
+//its damping becomes constraint damping along the spring, so a rig behaves like the force
+//based springs at small steps. The step is split into substeps; each one
+//	- moves every body by its velocity after the external forces, remembering where it
+//	  started in oldPos
+//	- projects the constraints iterations times, one spring color at a time. Springs of one
+//	  color share no body, so each color runs in parallel on the thread pool, SIMD_WIDTH
+//	  springs at a time; the overflow group, if any, runs serially.
+//	- takes the velocity from the displacement since oldPos
+//After the last substep oldPos is put back to the start of the step, as for the other schemes.
+//
+//The constraint solve cannot diverge, so any stiffness is stable and the cost per step is
+//fixed by substeps * iterations. Too small a budget makes stiff rigs stretchier than their
+//stiffness, never unstable. Static, sleeping and inactive bodies are not moved.
+class XpbdSolver {
+public:
+	//Advances every active body by dt. bodies.force must already hold the forces other than
+	//the springs.
+	void step(BodyStore& bodies, SpringNetwork& springs, float dt);
+
+	int substeps = 8;
+	//Constraint passes per substep. More substeps converge faster than more iterations.
+	int iterations = 1;
+private:
+	//Copies the springs into color order, dropping those without stiffness
+	void pack(SpringNetwork& springs);
+	//Projects packed springs [begin, end). Only springs that share no body can be done a
+	//SIMD vector at a time; the overflow group goes one spring at a time.
+	void project(BodyStore& bodies, int begin, int end, float h, bool independent);
+
+	//Packed springs: color g is [m_groupStart[g], m_groupStart[g + 1])
+	std::vector<int> m_groupStart;
+	bool m_overflow = false;
+	AlignedVector<int> m_bodyA;
+	AlignedVector<int> m_bodyB;
+	AlignedVector<float> m_restLength;
+	//1 / stiffness, and damping / stiffness
+	AlignedVector<float> m_compliance;
+	AlignedVector<float> m_dampingRatio;
+	//Lagrange multiplier, reset every substep
+	AlignedVector<float> m_lambda;
+
+	//Per body inverse mass, 0 for bodies that must not move
+	AlignedVector<float> m_weight;
+	Vec3Stream m_startPos;
+};